@@ -0,0 +1,348 @@
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include "goq.h"
+#include "prof.h"
+#include "trace.h"
+#include "stats.h"
+
+// goqの処理の速さを測る
+//
+//   bench [-n 回数] [-w 空回し回数] [-s 乱数の種] [-f 名前] [-j JSONファイル] [SGF...]
+//
+// 引数にSGFファイルを渡すと、それを読み込む速さも測る。
+// -j - で標準出力にJSONを書き出す
+
+struct Bench
+{
+    std::string name;
+    std::function<void()> setup;  // 毎回、計測の前に呼ぶ（計測しない）
+    std::function<void()> run;
+};
+
+struct Result
+{
+    std::string name;
+    Stats st;
+};
+
+static int n_iter = 200;
+static int n_warmup = 20;
+static unsigned int seed = 1;
+
+// 乱数で合法手だけを打った棋譜を作る
+static std::vector<Move> random_game(std::mt19937& rng, int size, int n_moves)
+{
+    std::vector<Move> moves;
+    Board board(size);
+    std::uniform_int_distribution<int> dist(1, size);
+    int stone = CELL_BLACK;
+
+    for (int i = 0; i < n_moves; i++) {
+        // 打てる場所が見つからなければ終わり
+        bool found = false;
+
+        for (int retry = 0; retry < size * size; retry++) {
+            int x = dist(rng);
+            int y = dist(rng);
+            std::list<Move> hama;
+
+            if (board.make_move(stone, x, y, hama)) {
+                moves.push_back(Move(stone, x, y));
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            break;
+        }
+
+        stone = (stone == CELL_BLACK) ? CELL_WHITE : CELL_BLACK;
+    }
+
+    return moves;
+}
+
+static std::string move_to_sgf(const Move& m)
+{
+    std::string s = (m.cell == CELL_BLACK) ? "B" : "W";
+
+    return s + "[" + SGFPoint::point_to_val(m.x, m.y) + "]";
+}
+
+// 問題集を作る。各問題は本手順と、最初の応手の変化を持ち、最後の局面に記号がある
+static std::string make_collection(std::mt19937& rng, int n_games, int size, int n_moves)
+{
+    std::string s;
+
+    for (int i = 0; i < n_games; i++) {
+        std::vector<Move> moves = random_game(rng, size, n_moves);
+
+        s += "(;FF[4]GM[1]SZ[" + std::to_string(size) + "]";
+        s += "C[problem " + std::to_string(i + 1) + "]";
+
+        if (moves.size() < 3) {
+            s += ")\n";
+            continue;
+        }
+
+        s += ";" + move_to_sgf(moves[0]);
+
+        s += "(";
+        for (int j = 1; j < (int) moves.size(); j++) {
+            s += ";" + move_to_sgf(moves[j]);
+        }
+
+        Move last = moves.back();
+        s += "MA[" + SGFPoint::point_to_val(moves[0].x, moves[0].y) + "]";
+        s += "TR[" + SGFPoint::point_to_val(moves[1].x, moves[1].y) + "]";
+        s += "CR[" + SGFPoint::point_to_val(moves[2].x, moves[2].y) + "]";
+        s += "LB[" + SGFPoint::point_to_val(last.x, last.y) + ":A]";
+        s += ")";
+
+        // 変化: 2手目を別の場所に打つ
+        std::vector<Move> alt = random_game(rng, size, 2);
+        Move m = moves[1];
+        if (alt.size() == 2 && (alt[1].x != m.x || alt[1].y != m.y) &&
+                (alt[1].x != moves[0].x || alt[1].y != moves[0].y)) {
+            s += "(;W[" + SGFPoint::point_to_val(alt[1].x, alt[1].y) + "])";
+        }
+
+        s += ")\n";
+    }
+
+    return s;
+}
+
+static bool read_file(const std::string& filename, std::string& s)
+{
+    std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+
+    if (!ifs) {
+        std::cerr << "Error: couldn't open file: " << filename << std::endl;
+        return false;
+    }
+
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    s = oss.str();
+
+    return true;
+}
+
+static Result run_bench(const Bench& b)
+{
+    using clock = std::chrono::steady_clock;
+
+    for (int i = 0; i < n_warmup; i++) {
+        if (b.setup) {
+            b.setup();
+        }
+        b.run();
+    }
+
+    std::vector<double> samples;
+    samples.reserve(n_iter);
+
+    for (int i = 0; i < n_iter; i++) {
+        if (b.setup) {
+            b.setup();
+        }
+
+        auto start = clock::now();
+        b.run();
+        auto end = clock::now();
+
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+
+    Result r;
+    r.name = b.name;
+    r.st = summarize(samples);
+
+    return r;
+}
+
+static void print_text(std::ostream& os, const std::vector<Result>& results)
+{
+    os << "name                              n      p50(us)    p90(us)    p99(us)" << std::endl;
+
+    for (auto& r : results) {
+        char buf[256];
+        snprintf(buf, sizeof(buf), "%-30s %6d %10.2f %10.2f %10.2f",
+                r.name.c_str(), r.st.n, r.st.p50 / 1000, r.st.p90 / 1000, r.st.p99 / 1000);
+        os << buf << std::endl;
+    }
+}
+
+static void print_json(std::ostream& os, const std::vector<Result>& results)
+{
+    os << "{\"seed\": " << seed << ", \"iterations\": " << n_iter
+        << ", \"warmup\": " << n_warmup << ", \"unit\": \"ns\", \"results\": [";
+
+    for (int i = 0; i < (int) results.size(); i++) {
+        const Result& r = results[i];
+        os << (i == 0 ? "\n" : ",\n");
+        os << "  {\"name\": " << json_str(r.name) << ", \"n\": " << r.st.n
+            << ", \"min\": " << r.st.min << ", \"mean\": " << r.st.mean
+            << ", \"p50\": " << r.st.p50 << ", \"p90\": " << r.st.p90
+            << ", \"p99\": " << r.st.p99 << ", \"max\": " << r.st.max << "}";
+    }
+
+    os << "\n]}" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    prof_init();
+    trace_init();
+
+    std::string filter = "";
+    std::string json = "";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:w:s:f:j:")) != -1) {
+        switch (opt) {
+        case 'n':
+            n_iter = atoi(optarg);
+            break;
+        case 'w':
+            n_warmup = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, nullptr, 10);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'j':
+            json = optarg;
+            break;
+        default:
+            std::cerr << "usage: bench [-n iterations] [-w warmup] [-s seed] [-f filter] [-j json] [SGF...]" << std::endl;
+            return 2;
+        }
+    }
+
+    if (n_iter < 1) {
+        n_iter = 1;
+    }
+
+    std::mt19937 rng(seed);
+    std::vector<Bench> benches;
+
+    // Board::make_move
+    std::vector<Move> moves = random_game(rng, 19, 250);
+    benches.push_back({"board.make_move", nullptr, [&moves]() {
+        Board board(19);
+        std::list<Move> hama;
+        for (auto& m : moves) {
+            board.make_move(m.cell, m.x, m.y, hama);
+        }
+    }});
+
+    // G::load
+    std::string synthetic = make_collection(rng, 100, 19, 60);
+    benches.push_back({"g.load.synthetic", nullptr, [&synthetic]() {
+        G g;
+        std::istringstream is(synthetic);
+        g.load(Gmode::ANSWER, is);
+    }});
+
+    std::list<std::string> files;  // lambdaが参照するので要素が動かないlistにする
+    for (int i = optind; i < argc; i++) {
+        std::string s;
+        if (!read_file(argv[i], s)) {
+            continue;
+        }
+
+        files.push_back(s);
+        const std::string& data = files.back();
+        benches.push_back({std::string("g.load.") + argv[i], nullptr, [&data]() {
+            G g;
+            std::istringstream is(data);
+            g.load(Gmode::ANSWER, is);
+        }});
+    }
+
+    // 読み込み済みの問題集に対する操作
+    G g;
+    std::istringstream is(synthetic);
+    g.load(Gmode::ANSWER, is);
+
+    benches.push_back({"node.to_sgf", nullptr, [&g]() {
+        for (auto game : g.get_games()) {
+            game->get_root()->to_sgf();
+        }
+    }});
+
+    benches.push_back({"game.write_sgf", nullptr, [&g]() {
+        std::ostringstream os;
+        for (auto game : g.get_games()) {
+            game->write_sgf(os);
+        }
+    }});
+
+    // 本手順の最後まで進めた局面
+    Game& game = g.current();
+    while (game.redo()) {
+    }
+
+    benches.push_back({"route.redo_history", nullptr, [&g, &game]() {
+        game.get_route().redo_history(g);
+    }});
+
+    benches.push_back({"game.update_markups", nullptr, [&game]() {
+        game.update_markups();
+    }});
+
+    // 解答モードで正解を打つ（相手の応手も含む）。
+    // 解答モードで読むと並べ替えるので、毎回同じ問題になるように最初の1局だけを読む
+    G solve;
+    std::istringstream solve_is(g.get_games().front()->get_sgf());
+    solve.load(Gmode::SOLVE, solve_is);
+    Game& solve_game = solve.current();
+    std::vector<Move> next = solve_game.get_next();
+
+    if (next.empty()) {
+        std::cerr << "Error: synthetic problem has no answer" << std::endl;
+        return 1;
+    }
+
+    Move answer = next.back();
+
+    benches.push_back({"game.put_stone.solve", [&solve_game]() {
+        while (solve_game.undo()) {
+        }
+    }, [&solve_game, answer]() {
+        solve_game.put_stone(answer.cell, answer.x, answer.y);
+    }});
+
+    std::vector<Result> results;
+    for (auto& b : benches) {
+        if (filter != "" && b.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        results.push_back(run_bench(b));
+    }
+
+    if (json == "-") {
+        print_json(std::cout, results);
+    } else {
+        print_text(std::cout, results);
+
+        if (json != "") {
+            std::ofstream ofs(json);
+            print_json(ofs, results);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <cmath>
+#include "bloom.h"
+
+// 索引の二分探索と同じビットを使わないように混ぜ直す
+static inline uint64_t mix(uint64_t z)
+{
+    z = (z ^ (z >> 33)) * 0xff51afd7ed558ccdULL;
+    z = (z ^ (z >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+    return z ^ (z >> 33);
+}
+
+void BloomFilter::init(uint64_t n_keys, int bits_per_key)
+{
+    uint64_t bits = n_keys * bits_per_key;
+    uint64_t block_bits = BLOOM_BLOCK_WORDS * 64;
+
+    m_n_blocks = (bits + block_bits - 1) / block_bits;
+    if (m_n_blocks == 0) {
+        m_n_blocks = 1;
+    }
+
+    m_own.assign(m_n_blocks * BLOOM_BLOCK_WORDS, 0);
+    m_words = m_own.data();
+}
+
+void BloomFilter::attach(const uint64_t* words, uint64_t n_blocks)
+{
+    m_own.clear();
+    m_words = words;
+    m_n_blocks = n_blocks;
+}
+
+// 混ぜ直した値の上位でブロックを選び、キーを9ビットずつ使ってブロック内の位置にする
+void BloomFilter::add(uint64_t key)
+{
+    uint64_t h = mix(key);
+    uint64_t* block = &m_own[((h >> 32) % m_n_blocks) * BLOOM_BLOCK_WORDS];
+    uint64_t bits = key;
+
+    for (int i = 0; i < BLOOM_K; i++) {
+        int b = bits & 511;
+        block[b >> 6] |= 1ULL << (b & 63);
+        bits >>= 9;
+    }
+}
+
+bool BloomFilter::may_contain(uint64_t key) const
+{
+    if (m_n_blocks == 0) {
+        return true;
+    }
+
+    uint64_t h = mix(key);
+    const uint64_t* block = &m_words[((h >> 32) % m_n_blocks) * BLOOM_BLOCK_WORDS];
+    uint64_t bits = key;
+
+    for (int i = 0; i < BLOOM_K; i++) {
+        int b = bits & 511;
+        if (!(block[b >> 6] & (1ULL << (b & 63)))) {
+            return false;
+        }
+        bits >>= 9;
+    }
+
+    return true;
+}
+
+double BloomFilter::expected_fpr(uint64_t n_keys) const
+{
+    double m = (double) m_n_blocks * BLOOM_BLOCK_WORDS * 64;
+
+    if (m == 0) {
+        return 1;
+    }
+
+    return std::pow(1 - std::exp(-BLOOM_K * (double) n_keys / m), BLOOM_K);
+}
@@ -0,0 +1,39 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// キャッシュラインごとに分けたBloomフィルタ。1つのキーのビットは全部同じ
+// 64バイトのブロックに入れるので、引くときに読むのは1キャッシュラインだけ。
+// キーはZobristハッシュのような一様な64ビット値を想定している
+
+#define BLOOM_BLOCK_WORDS (8)  // 64バイト
+#define BLOOM_K (7)  // 1つのキーで立てるビットの数
+
+class BloomFilter
+{
+    std::vector<uint64_t> m_own;  // 作るときだけ使う
+    const uint64_t* m_words = nullptr;
+    uint64_t m_n_blocks = 0;
+public:
+    // n_keys個のキーを入れるとき、1キーあたりbits_per_keyビットにする
+    void init(uint64_t n_keys, int bits_per_key);
+    // mmapした領域をそのまま使う
+    void attach(const uint64_t* words, uint64_t n_blocks);
+
+    bool empty() const { return m_n_blocks == 0; };
+
+    void add(uint64_t key);
+    bool may_contain(uint64_t key) const;
+
+    const uint64_t* data() const { return m_words; };
+    uint64_t n_blocks() const { return m_n_blocks; };
+    size_t size_bytes() const { return m_n_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t); };
+
+    // n_keys個入れたときの偽陽性率の見積もり（ブロックに分けない場合の式）
+    double expected_fpr(uint64_t n_keys) const;
+};
+
+#endif
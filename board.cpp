@@ -1,4 +1,6 @@
+#include <array>
 #include "board.h"
+#include "prof.h"
 
 Board::Board(int size)
     : size(size)
@@ -168,7 +170,7 @@ bool Board::has_stone(const Point& pt) const
     return has_stone(pt.x, pt.y);
 }
 
-inline bool Board::is_out(int x, int y) const
+bool Board::is_out(int x, int y) const
 {
     if (x < 1 || x > size || y < 1 || y > size) {
         return true;
@@ -252,6 +254,8 @@ static std::array<Point, 4> ruld = {Point(1, 0), Point(0, 1), Point(-1, 0), Poin
 
 bool Board::make_move(int cell, int x, int y, std::list<Move>& hama)
 {
+    PROF_SCOPE("board.make_move");
+
     // pass
     if (x == 20 && y == 20) {
         is_pass = true;
@@ -293,7 +297,7 @@ bool Board::make_move(int cell, int x, int y, std::list<Move>& hama)
     }
 
     // 石が敵に囲まれているか？
-    std::map<std::string, bool> memo;
+    Visited memo;
     if (is_surrounded(memo, val, x, y)) {
         int opponent = get_opponent(val);
         bool can_kill = false;
@@ -354,27 +358,15 @@ bool Board::make_move(int cell, int x, int y, std::list<Move>& hama)
     return true;
 }
 
-static std::string make_key(int x, int y)
-{
-    std::string s = std::to_string(x);
-    s += "x";
-    s += std::to_string(y);
-
-    return s;
-}
-
 // 敵に囲まれているか調べる
-bool Board::is_surrounded(std::map<std::string, bool>& memo, int my_stone, int x, int y)
+bool Board::is_surrounded(Visited& memo, int my_stone, int x, int y)
 {
-    std::string key = make_key(x, y);
-
     // すでに調べた位置か？
-    std::map<std::string, bool>::iterator itr = memo.find(key);
-    if (itr != memo.end()) {
+    if (memo.cells[x][y]) {
         return true;
     }
 
-    memo[key] = true;
+    memo.cells[x][y] = true;
 
     int stone = get_val(x, y);
 
@@ -403,7 +395,7 @@ int Board::take_prisoners_if_ok(int my_stone, int x, int y, std::list<Move>& ham
         return 0;
     }
 
-    std::map<std::string, bool> memo;
+    Visited memo;
     if (is_surrounded(memo, opponent, x, y)) {
         return take_prisoners(opponent, x, y, hama);
     }
@@ -1,6 +1,7 @@
 #ifndef BOARD_H
 #define BOARD_H
 
+#include <algorithm>
 #include <iostream>
 #include <list>
 #include <map>
@@ -66,6 +67,15 @@ struct Move
 Move rotate(int n, int size, Move m);
 Move flip(int n, Move m);
 
+// is_surrounded()で調べ済みの位置
+struct Visited
+{
+    bool cells[CELLS_SIZE][CELLS_SIZE];
+
+    Visited() { clear(); };
+    void clear() { std::fill(&cells[0][0], &cells[0][0] + CELLS_SIZE * CELLS_SIZE, false); };
+};
+
 class Board
 {
     int size;
@@ -115,7 +125,7 @@ public:
     std::vector<Move>& get_kifu() { return kifu; };
 
     bool make_move(int cell, int x, int y, std::list<Move>& hama);
-    bool is_surrounded(std::map<std::string, bool>& memo, int my_stone, int x, int y);
+    bool is_surrounded(Visited& memo, int my_stone, int x, int y);
     int take_prisoners_if_ok(int my_stone, int x, int y, std::list<Move>& hama);
     int take_prisoners(int stone, int x, int y, std::list<Move>& hama);
 };
@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <cmath>
+#include "board_snapshot.h"
+#include "opening_trie.h"
+#include "prof.h"
+#include "trace.h"
+
+void make_snapshot(G& g, const OpeningTrie* trie, BoardSnapshot& s)
+{
+    PROF_SCOPE("snapshot.make");
+    TRACE_SCOPE("snapshot.make");
+
+    Game& game = g.current();
+
+    game.update_markups();
+
+    int board_size = g.board.get_size();
+
+    s.size = board_size;
+    s.mode = game.get_mode();
+    s.my_stone = game.flip(game.get_my_stone());
+    s.looks.assign(board_size * board_size, CellLook());
+
+    Point last = game.transform(g.board.get_last());
+
+    for (int x = 1; x <= board_size; x++) {
+        for (int y = 1; y <= board_size; y++) {
+            Point pos = game.transform(Point(x, y));
+            CellLook& look = s.looks[(pos.y-1) * board_size + (pos.x-1)];
+
+            look.cell = game.flip(g.board.get_cell(x, y));
+            look.last = pos == last && !game.is_auto_increment();
+        }
+    }
+
+    // 自動インクリメント数字
+    if (game.is_auto_increment()) {
+        for (auto label : game.get_numbers()) {
+            if (!g.board.has_stone(label.x, label.y)) {
+                continue;
+            }
+
+            int cell = game.flip(g.board.get_cell(label.x, label.y));
+
+            if (cell & LBL_MASK) {
+                continue;
+            }
+
+            Point pt = game.transform(Point(label.x, label.y));
+            s.looks[(pt.y-1) * board_size + (pt.x-1)].number = label.label;
+        }
+    }
+
+    // 変化
+    Gmode mode = s.mode;
+    if (mode == Gmode::ANSWER || mode == Gmode::KIFU) {
+        std::vector<struct Move> next = game.get_next();
+
+        if (mode == Gmode::KIFU && next.size() == 1) {
+            // 何もしない
+        } else {
+            for (int i = 0; i < (int) next.size(); i++) {
+                struct Move m = next[i];
+
+                if (m.x < 1 || m.x > board_size || m.y < 1 || m.y > board_size) {
+                    continue;
+                }
+
+                s.looks[(m.y-1) * board_size + (m.x-1)].next = std::string(1, 'A' + i);
+            }
+        }
+    }
+
+    // 次の手の頻度
+    if (trie && (mode == Gmode::KIFU || mode == Gmode::FREE)) {
+        std::vector<TrieHint> hints;
+        trie->lookup(g.board, hints);
+
+        // 多い順なので、同じ交点に黒白両方あれば多い方になる
+        for (auto& h : hints) {
+            const Move& m = h.move;
+
+            if (m.x < 1 || m.x > board_size || m.y < 1 || m.y > board_size || g.board.has_stone(m.x, m.y)) {
+                continue;
+            }
+
+            Point pt = game.transform(Point(m.x, m.y));
+            CellLook& look = s.looks[(pt.y-1) * board_size + (pt.x-1)];
+
+            if (look.heat == 0) {
+                look.heat = std::max(1, (int) std::lround(h.ratio * 100));
+            }
+        }
+    }
+
+    // pass
+    s.pass = CELL_SPACE;
+    if (g.board.is_pass) {
+        s.pass = game.flip(g.board.pass_stone);
+        if (s.pass != CELL_BLACK && s.pass != CELL_WHITE) {
+            s.pass = CELL_OUT;
+        }
+    }
+}
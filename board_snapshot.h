@@ -0,0 +1,46 @@
+#ifndef BOARD_SNAPSHOT_H
+#define BOARD_SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "g.h"
+
+class OpeningTrie;
+
+// 1つの交点に描くもの。前回描いたときと比べて、変わった交点だけ描き直す
+struct CellLook
+{
+    int cell = CELL_SPACE;  // 石と記号、ラベル
+    bool last = false;  // 最後に打った石
+    bool focus = false;
+    int ghost = CELL_SPACE;  // フォーカス位置の半透明の石
+    std::string number;  // 自動インクリメント数字
+    std::string next;  // 変化の記号
+    int heat = 0;  // 次の手の頻度（%）。0なら描かない
+
+    bool operator==(const CellLook& o) const {
+        return cell == o.cell && last == o.last && focus == o.focus && ghost == o.ghost &&
+            number == o.number && next == o.next && heat == o.heat;
+    };
+    bool operator!=(const CellLook& o) const { return !(*this == o); };
+};
+
+// 盤を描くのに要るものを、モデルのスレッドで局面から作ったもの。作ったあとは変えない。
+// 座標は画面の向き（Game::transform()したあと）。
+// カーソルはUIが持つので、focusとghostは入れず、代わりにmy_stoneを入れる
+struct BoardSnapshot
+{
+    uint64_t seq = 0;  // 何番目に作ったか
+    uint64_t n_commands = 0;  // 作るまでに実行した操作の数
+    int size = 0;
+    Gmode mode = Gmode::CREATE;
+    std::vector<CellLook> looks;  // (y-1) * size + (x-1)
+    int pass = CELL_SPACE;
+    int my_stone = CELL_SPACE;  // フォーカス位置に半透明で描く石。CELL_SPACEなら描かない
+};
+
+// gの今の局面からsを作る。trieがあれば次の手の頻度も入れる
+void make_snapshot(G& g, const OpeningTrie* trie, BoardSnapshot& s);
+
+#endif
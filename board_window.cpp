@@ -1,7 +1,9 @@
-#include <wx/graphics.h>
+#include <cmath>
 #include "board_window.h"
 #include "frame.h"
 #include "node.h"
+#include "prof.h"
+#include "trace.h"
 
 #define POINT_W (3)
 
@@ -15,28 +17,10 @@ static int points_len13 = sizeof(points13) / sizeof(int[2]);
 static int points_len19 = sizeof(points19) / sizeof(int[2]);
 
 // 色
-static wxColour board_color(214, 130, 34);
-static wxBrush board_brush(board_color);
-
-static wxColour black_stone_colour(0x10, 0x10, 0x10);
-static wxColour white_stone_colour(0xe0, 0xe0, 0xe0);
-static wxBrush black_stone_brush(black_stone_colour);
-static wxBrush white_stone_brush(white_stone_colour);
-static wxBrush tr_black_stone_brush(wxColour(0x10, 0x10, 0x10, 0x80));
-static wxBrush tr_white_stone_brush(wxColour(0xe0, 0xe0, 0xe0, 0x80));
-static wxPen black_stone_pen(black_stone_colour, 3);
-static wxPen white_stone_pen(white_stone_colour, 3);
-
 static wxPen black_pen(*wxBLACK, 3);
-static wxPen white_pen(*wxWHITE, 3);
-static wxPen blue_pen(*wxBLUE, 5);
-static wxPen red_pen(*wxRED, 5);
-
-// 謎の数字
-static const double fzemgaqojefaslkjhfa = 0.866;
 
-BoardWindow::BoardWindow(MyFrame* frame, G& g)
-    : wxWindow(frame, wxID_ANY), g(g), frame(frame)
+BoardWindow::BoardWindow(MyFrame* frame)
+    : wxWindow(frame, wxID_ANY), frame(frame)
 {
     SetMinSize(wxSize(MIN_WIDTH, MIN_WIDTH));
 
@@ -55,129 +39,34 @@ BoardWindow::BoardWindow(MyFrame* frame, G& g)
     Bind(wxEVT_MOUSEWHEEL, &BoardWindow::OnWheel, this, wxID_ANY);
 }
 
-void DrawLabel(wxPaintDC& dc, wxFont* fonts[3], int stone, std::string s, int x, int y)
-{
-    if (stone == CELL_SPACE) {
-        dc.SetBackgroundMode(wxSOLID);
-        dc.SetTextForeground(*wxBLACK);
-        dc.SetTextBackground(board_color);
-    } else if (stone == CELL_BLACK) {
-        dc.SetTextForeground(*wxWHITE);
-    } else if (stone == CELL_WHITE) {
-        dc.SetTextForeground(*wxBLACK);
-    }
-
-    if (s.length() == 1) {
-        dc.SetFont(*fonts[0]);
-    } else if (s.length() == 2) {
-        dc.SetFont(*fonts[1]);
-    } else {
-        dc.SetFont(*fonts[2]);
-    }
-
-    wxCoord w, h;
-    dc.GetTextExtent(s, &w, &h);
-    dc.DrawText(s, x - w/2, y - h/2);
-    dc.SetBackgroundMode(wxTRANSPARENT);
-}
-
-void DrawMA(wxPaintDC& dc, wxPen* pen, int cell, double st_x, double st_y, double space_w)
-{
-    int ma_d = space_w / 3.5;
-    int sp = space_w / 2.5;
-
-    dc.SetPen(wxNullPen);
-    if ((cell & 3) == CELL_SPACE) {
-        dc.SetBrush(board_brush);
-    } else {
-        dc.SetBrush(wxNullBrush);
-    }
-    dc.DrawRectangle(st_x - sp, st_y - sp, sp*2, sp*2);
-
-    if (cell & CELL_MA) {
-        dc.SetPen(*pen);
-    } else {
-        dc.SetPen(red_pen);
-    }
-
-    dc.DrawLine(st_x - ma_d, st_y - ma_d, st_x + ma_d, st_y + ma_d);
-    dc.DrawLine(st_x + ma_d, st_y - ma_d, st_x - ma_d, st_y + ma_d);
-}
-
-void DrawTR(wxPaintDC& dc, wxPen* pen, int cell, double st_x, double st_y, double space_w)
-{
-    double tr_d1 = space_w / 2.9;
-    double tr_d2 = tr_d1 * fzemgaqojefaslkjhfa;
-    double tr_d3 = tr_d1 / 2;
-
-    int sp = space_w / 2;
-
-    dc.SetPen(wxNullPen);
-    if ((cell & 3) == CELL_SPACE) {
-        dc.SetBrush(board_brush);
-    } else {
-        dc.SetBrush(wxNullBrush);
-    }
-    dc.DrawRectangle(st_x - sp, st_y - sp, sp*2, sp*2);
-
-    dc.SetPen(*pen);
-
-    dc.DrawLine(st_x, st_y - tr_d1, st_x + tr_d2, st_y + tr_d3);
-    dc.DrawLine(st_x + tr_d2, st_y + tr_d3, st_x - tr_d2, st_y + tr_d3);
-    dc.DrawLine(st_x - tr_d2, st_y + tr_d3, st_x, st_y - tr_d1);
-}
-
-void DrawCR(wxPaintDC& dc, wxPen* pen, int cell, double st_x, double st_y, double space_w)
-{
-    double cr_r = space_w / 2.9;
-    int sp = space_w / 2;
-
-    dc.SetPen(wxNullPen);
-    if ((cell & 3) == CELL_SPACE) {
-        dc.SetBrush(board_brush);
-    } else {
-        dc.SetBrush(wxNullBrush);
-    }
-    dc.DrawRectangle(st_x - sp, st_y - sp, sp*2, sp*2);
-
-    if (cell & CELL_CR) {
-        dc.SetPen(*pen);
-    } else {
-        dc.SetPen(blue_pen);
-    }
-    dc.SetBrush(wxNullBrush);
-
-    dc.DrawCircle(st_x, st_y, cr_r);
-}
-
-void DrawStr(wxPaintDC& dc, wxFont* font, std::string s)
+void DrawStr(wxPaintDC& dc, const wxFont& font, std::string s)
 {
     dc.SetTextForeground(*wxBLACK);
-    dc.SetFont(*font);
+    dc.SetFont(font);
     dc.DrawText(s, 0, 0);
 }
 
-void BoardWindow::OnPaint(wxPaintEvent& e)
+// 背景、線、星をビットマップに描いておく。フォントもマスの大きさで決まるので作っておく
+void BoardWindow::update_layer()
 {
-    (void)e;
+    int board_size = this->board_size();
 
-    Game& game = g.current();
+    layer_width = width;
+    layer_board_size = board_size;
 
-    wxPaintDC dc(this);
-    wxGraphicsContext* gc = wxGraphicsContext::Create(dc);
-    if (!gc) {
+    if (width <= 0 || board_size <= 0) {
+        board_layer = wxNullBitmap;
         return;
     }
 
-    game.update_markups();
-
     // サイズ
-    int board_size = g.board.get_size();
     double space_w = double(width) / (board_size + 1);
-    double focus_w = space_w / 3;
     double pad = space_w;
     int lattice_w = width - pad * 2;
 
+    board_layer = wxBitmap(width, width);
+    wxMemoryDC dc(board_layer);
+
     // ボード背景
     dc.SetPen(wxNullPen);
     dc.SetBrush(board_brush);
@@ -222,200 +111,250 @@ void BoardWindow::OnPaint(wxPaintEvent& e)
         }
     }
 
-    // 石等
-    dc.SetPen(wxNullPen);
-
-    Point cur = g.board.get_cur();
-    Point last = game.transform(g.board.get_last());
+    dc.SelectObject(wxNullBitmap);
 
-    wxFont* fonts[3];
+    sprites.set_cell(space_w, GetContentScaleFactor());
+}
 
-    fonts[0] = new wxFont(space_w / 2, wxFONTFAMILY_DEFAULT,
-            wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
-    fonts[1] = new wxFont(space_w / 2.5, wxFONTFAMILY_DEFAULT,
-            wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
-    fonts[2] = new wxFont(space_w / 3, wxFONTFAMILY_DEFAULT,
-            wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+// (st_x, st_y)を中心にスプライトを貼る
+void BoardWindow::draw_sprite(wxDC& dc, const wxBitmap& bmp, double st_x, double st_y)
+{
+    double half = sprites.side() / 2.0;
 
-    for (int x = 1; x <= board_size; x++) {
-        for (int y = 1; y <= board_size; y++) {
-            Point pos = game.transform(Point(x, y));
-            int stone = game.flip(g.board.get_val(x, y));
-            int cell = game.flip(g.board.get_cell(x, y));
+    dc.DrawBitmap(bmp, std::lround(st_x - half), std::lround(st_y - half), true);
+}
 
-            if (cell == 0 && pos != cur) {
-                continue;
-            }
+// マスに描くラベルの文字列
+static std::string cell_label(int cell)
+{
+    std::string s;
+    int n = (cell & LBL_MASK) >> LBL_SHIFT;
+    char lb1 = (n & 0xff0000) >> 16;
+    char lb2 = (n & 0xff00) >> 8;
+    char lb3 = n & 0xff;
+    if (lb1 != 0) {
+        s += lb1;
+    }
+    if (lb2 != 0) {
+        s += lb2;
+    }
+    if (lb3 != 0) {
+        s += lb3;
+    }
 
-            double st_x = pad + space_w * (pos.x-1);
-            double st_y = pad + space_w * (pos.y-1);
-            double st_r = space_w / 2.1;
-
-            wxPen* stone_pen = &black_stone_pen;
-
-            if (stone == CELL_BLACK) {
-                stone_pen = &white_stone_pen;
-                dc.SetPen(wxNullPen);
-                dc.SetBrush(black_stone_brush);
-                dc.DrawCircle(st_x, st_y, st_r);
-            } else if (stone == CELL_WHITE) {
-                dc.SetPen(*wxBLACK_PEN);
-                dc.SetBrush(white_stone_brush);
-                dc.DrawCircle(st_x, st_y, st_r);
-            }
+    return s;
+}
 
-            if (cell & CELL_MA || cell & CELL_WRONG) {  // X
-                DrawMA(dc, stone_pen, cell, st_x, st_y, space_w);
-            } else if (cell & CELL_TR) {  // triangle
-                DrawTR(dc, stone_pen, cell, st_x, st_y, space_w);
-            } else if (cell & CELL_CR || cell & CELL_CORRECT) {  // circle
-                DrawCR(dc, stone_pen, cell, st_x, st_y, space_w);
-            } else if (cell & LBL_MASK) {
-                std::string s;
-                int n = (cell & LBL_MASK) >> LBL_SHIFT;
-                char lb1 = (n & 0xff0000) >> 16;
-                char lb2 = (n & 0xff00) >> 8;
-                char lb3 = n & 0xff;
-                if (lb1 != 0) {
-                    s += lb1;
-                }
-                if (lb2 != 0) {
-                    s += lb2;
-                }
-                if (lb3 != 0) {
-                    s += lb3;
-                }
+// 盤面の交点ごとに、描くもの（石、記号、ラベル、数字、フォーカス等）を求める。
+// 局面の分はスナップショットにあるので、カーソルと表示の切り替えだけ足す
+void BoardWindow::get_looks(std::vector<CellLook>& looks, int& pass)
+{
+    if (!snapshot) {
+        looks.clear();
+        pass = CELL_SPACE;
+        return;
+    }
 
-                DrawLabel(dc, fonts, stone, s, st_x, st_y);
-            }
+    looks = snapshot->looks;
+    pass = snapshot->pass;
 
-            // 最後に打った石
-            if (pos == last && !game.is_auto_increment()) {
-                dc.SetPen(wxNullPen);
-                dc.SetBrush(*wxRED_BRUSH);
+    int board_size = snapshot->size;
 
-                double last_x = st_x - focus_w / 2;
-                double last_y = st_y - focus_w / 2;
+    // フォーカス
+    if (cur) {
+        CellLook& look = looks[(cur.y-1) * board_size + (cur.x-1)];
+        int stone = look.cell & 7;
 
-                dc.DrawRectangle(last_x, last_y, focus_w, focus_w);
-            }
+        if (stone != CELL_SPACE || snapshot->my_stone == CELL_SPACE) {
+            look.focus = true;
+        } else {
+            look.ghost = snapshot->my_stone;
+        }
+    }
 
-            // フォーカス
-            if (pos == cur) {
-                int my_stone = game.flip(game.get_my_stone());
-                if (stone != CELL_SPACE || my_stone == CELL_SPACE) {
-                    dc.SetPen(wxNullPen);
-                    dc.SetBrush(*wxBLUE_BRUSH);
-
-                    double fc_x = st_x - focus_w / 2;
-                    double fc_y = st_y - focus_w / 2;
-
-                    dc.DrawRectangle(fc_x, fc_y, focus_w, focus_w);
-                } else {
-                    if (my_stone == CELL_BLACK) {
-                        gc->SetPen(wxNullPen);
-                        gc->SetBrush(tr_black_stone_brush);
-                    } else {
-                        gc->SetPen(wxNullPen);
-                        gc->SetBrush(tr_white_stone_brush);
-                    }
-
-                    gc->DrawEllipse(st_x - space_w/2, st_y - space_w/2, st_r*2, st_r*2);
-                }
-            }
+    // 次の手の頻度
+    if (!show_heat) {
+        for (auto& look : looks) {
+            look.heat = 0;
         }
     }
+}
+
+// 交点のスプライトが占める範囲
+wxRect BoardWindow::cell_rect(int x, int y)
+{
+    int board_size = this->board_size();
+    double space_w = double(width) / (board_size + 1);
+    double pad = space_w;
+    double half = sprites.side() / 2.0;
 
-    /*
-    // 記号
-    for (int i = 0; i < n_markups; i++) {
-        PID pid  = markups[i];
+    double st_x = pad + space_w * (x-1);
+    double st_y = pad + space_w * (y-1);
 
-        for (Point pt : game.markups(pid)) {
-            Point pos = game.transform(Point(pt.x, pt.y));
-            int stone = game.flip(g.board.get_val(pt.x, pt.y));
+    // 丸め誤差の分、1ピクセル広げる
+    return wxRect(std::lround(st_x - half) - 1, std::lround(st_y - half) - 1,
+            sprites.side() + 2, sprites.side() + 2);
+}
 
-            double st_x = pad + space_w * (pos.x-1);
-            double st_y = pad + space_w * (pos.y-1);
+// 前回描いたときから変わった交点だけ再描画する
+void BoardWindow::update_board()
+{
+    TRACE_SCOPE("board_window.update_board");
 
-            wxPen* pen = &black_stone_pen;
+    std::vector<CellLook> looks;
+    int pass;
 
-            if (stone == CELL_BLACK) {
-                pen = &white_stone_pen;
-            }
+    get_looks(looks, pass);
 
-            if (pid == PID::MA || pid  == PID::WRONG) {
-                DrawMA(dc, pen, stone, pid, st_x, st_y, space_w);
-            } else if (pid == PID::TR) {
-                DrawTR(dc, pen, stone, st_x, st_y, space_w);
-            } else if (pid == PID::CR || pid == PID::CORRECT) {
-                DrawCR(dc, pen, stone, pid, st_x, st_y, space_w);
-            }
+    int board_size = this->board_size();
+
+    if (looks.size() != painted.size() || layer_width != width || layer_board_size != board_size) {
+        painted.swap(looks);
+        painted_pass = pass;
+        Refresh();
+        return;
+    }
+
+    for (int i = 0; i < (int) looks.size(); i++) {
+        if (looks[i] != painted[i]) {
+            RefreshRect(cell_rect(i % board_size + 1, i / board_size + 1), false);
         }
     }
-    */
 
-    // 自動インクリメント数字の表示
-    if (game.is_auto_increment()) {
-        for (auto label : game.get_numbers()) {
-            if (!g.board.has_stone(label.x, label.y)) {
+    if (pass != painted_pass) {
+        double space_w = double(width) / (board_size + 1);
+        RefreshRect(wxRect(0, 0, width, std::ceil(space_w)), false);
+    }
+
+    painted.swap(looks);
+    painted_pass = pass;
+}
+
+void BoardWindow::set_snapshot(std::shared_ptr<const BoardSnapshot> s)
+{
+    if (!s || (snapshot && s->seq <= snapshot->seq)) {
+        return;
+    }
+
+    // 盤の大きさが変わったらカーソルは外す
+    if (snapshot && snapshot->size != s->size) {
+        cur = Point();
+    }
+
+    snapshot = s;
+    update_board();
+
+    if (replay) {
+        replay->on_snapshot();
+    }
+}
+
+uint64_t BoardWindow::n_posted()
+{
+    return frame->n_posted();
+}
+
+void BoardWindow::OnPaint(wxPaintEvent& e)
+{
+    (void)e;
+
+    PROF_SCOPE("board_window.paint");
+    TRACE_SCOPE("board_window.paint");
+
+    wxPaintDC dc(this);
+
+    // サイズ
+    int board_size = this->board_size();
+    double space_w = double(width) / (board_size + 1);
+    double pad = space_w;
+
+    if (layer_width != width || layer_board_size != board_size) {
+        update_layer();
+    }
+
+    // HiDPIの倍率が変わったときはスプライトだけ作り直す
+    sprites.set_cell(space_w, GetContentScaleFactor());
+
+    if (!board_layer.IsOk()) {
+        return;
+    }
+
+    // 無効になった範囲の外はwxPaintDCがクリップする
+    dc.DrawBitmap(board_layer, 0, 0);
+
+    get_looks(painted, painted_pass);
+
+    const wxRegion& update = GetUpdateRegion();
+
+    // 石等
+    for (int x = 1; x <= board_size; x++) {
+        for (int y = 1; y <= board_size; y++) {
+            const CellLook& look = painted[(y-1) * board_size + (x-1)];
+
+            if (look == CellLook()) {
                 continue;
             }
 
-            int cell = game.flip(g.board.get_cell(label.x, label.y));
-
-            if (cell & LBL_MASK) {
+            if (update.Contains(cell_rect(x, y)) == wxOutRegion) {
                 continue;
             }
 
-            int stone = game.flip(g.board.get_val(label.x, label.y));
-            Point pt = game.transform(Point(label.x, label.y));
-            double st_x = pad + space_w * (pt.x-1);
-            double st_y = pad + space_w * (pt.y-1);
+            PROF_COUNT("board_window.paint_cells", 1);
 
-            DrawLabel(dc, fonts, stone, label.label, st_x, st_y);
-        }
-    }
+            int cell = look.cell;
+            int stone = cell & 7;
 
-    // 変化
-    Gmode mode = game.get_mode();
-    if (mode == Gmode::ANSWER || mode == Gmode::KIFU) {
-        std::vector<struct Move> next = game.get_next();
+            double st_x = pad + space_w * (x-1);
+            double st_y = pad + space_w * (y-1);
 
-        if (mode == Gmode::KIFU && next.size() == 1) {
-            // 何もしない
-        } else {
-            for (int i = 0; i < (int) next.size(); i++) {
-                struct Move m = next[i];
+            if (stone == CELL_BLACK || stone == CELL_WHITE) {
+                draw_sprite(dc, sprites.stone(stone), st_x, st_y);
+            }
 
-                if (m.x == 0) {
-                    continue;
-                }
+            if (cell & CELL_MA || cell & CELL_WRONG) {  // X
+                draw_sprite(dc, sprites.markup(SPRITE_MA, stone, !(cell & CELL_MA)), st_x, st_y);
+            } else if (cell & CELL_TR) {  // triangle
+                draw_sprite(dc, sprites.markup(SPRITE_TR, stone, false), st_x, st_y);
+            } else if (cell & CELL_CR || cell & CELL_CORRECT) {  // circle
+                draw_sprite(dc, sprites.markup(SPRITE_CR, stone, !(cell & CELL_CR)), st_x, st_y);
+            } else if (cell & LBL_MASK) {
+                draw_sprite(dc, sprites.label(cell_label(cell), stone), st_x, st_y);
+            }
+
+            if (!look.number.empty()) {
+                draw_sprite(dc, sprites.label(look.number, stone), st_x, st_y);
+            }
 
-                std::string s(1, 'A' + i);
+            if (look.heat) {
+                draw_sprite(dc, sprites.heat(look.heat), st_x, st_y);
+            }
 
-                int stone = game.flip(g.board.get_val(m.x, m.y));
-                double st_x = pad + space_w * (m.x-1);
-                double st_y = pad + space_w * (m.y-1);
+            if (!look.next.empty()) {
+                draw_sprite(dc, sprites.label(look.next, stone), st_x, st_y);
+            }
 
-                DrawLabel(dc, fonts, stone, s, st_x, st_y);
+            // 最後に打った石
+            if (look.last) {
+                draw_sprite(dc, sprites.mark(SPRITE_LAST), st_x, st_y);
+            }
+
+            // フォーカス
+            if (look.focus) {
+                draw_sprite(dc, sprites.mark(SPRITE_FOCUS), st_x, st_y);
+            } else if (look.ghost != CELL_SPACE) {
+                draw_sprite(dc, sprites.ghost(look.ghost), st_x, st_y);
             }
         }
     }
 
-
     // pass
-    if (g.board.is_pass) {
-        if (game.flip(g.board.pass_stone) == CELL_BLACK) {
-            DrawStr(dc, fonts[0], "Black: pass");
-        } else if (game.flip(g.board.pass_stone) == CELL_WHITE) {
-            DrawStr(dc, fonts[0], "White: pass");
-        } else {
-            DrawStr(dc, fonts[0], "bug");
-        }
+    if (painted_pass == CELL_BLACK) {
+        DrawStr(dc, sprites.font(0), "Black: pass");
+    } else if (painted_pass == CELL_WHITE) {
+        DrawStr(dc, sprites.font(0), "White: pass");
+    } else if (painted_pass == CELL_OUT) {
+        DrawStr(dc, sprites.font(0), "bug");
     }
-
-    delete gc;
 }
 
 void BoardWindow::OnSize(wxSizeEvent& e)
@@ -427,13 +366,34 @@ void BoardWindow::OnSize(wxSizeEvent& e)
     int h = size.GetHeight();
     width = std::min(w, h);
 
+    if (width != layer_width) {
+        update_layer();
+    }
+
     Refresh();
 }
 
+// 入力を記録する
+static InputEvent mouse_input(InputType type, wxMouseEvent& e)
+{
+    InputEvent ev;
+    ev.type = type;
+    ev.x = e.GetX();
+    ev.y = e.GetY();
+    ev.wheel = e.GetWheelRotation();
+    ev.mods = (e.ShiftDown() ? INPUT_SHIFT : 0) | (e.ControlDown() ? INPUT_CTRL : 0);
+
+    return ev;
+}
+
 void BoardWindow::OnMove(wxMouseEvent& e)
 {
-    int board_size = g.board.get_size();
-    Point prev = g.current().transform(g.board.get_cur());
+    if (recorder) {
+        recorder->record(mouse_input(InputType::MOVE, e));
+    }
+
+    int board_size = this->board_size();
+    Point prev = cur;
 
     double space_w = double(width) / (board_size + 1);
     double pad = space_w;
@@ -442,12 +402,14 @@ void BoardWindow::OnMove(wxMouseEvent& e)
     int x = (e.GetX() - start) / space_w + 1;
     int y = (e.GetY() - start) / space_w + 1;
 
-    g.board.set_cur(x, y);
-
-    Point cur = g.current().transform(g.board.get_cur());
+    if (x < 1 || x > board_size || y < 1 || y > board_size) {
+        cur = Point();
+    } else {
+        cur = Point(x, y);
+    }
 
     if (prev != cur) {
-        Refresh();
+        update_board();
     }
 }
 
@@ -459,62 +421,69 @@ void BoardWindow::OnEnter(wxMouseEvent& e)
 
 void BoardWindow::OnLeave(wxMouseEvent& e)
 {
-    (void) e;
-
-    Point cur = g.board.get_cur();
+    if (recorder) {
+        recorder->record(mouse_input(InputType::LEAVE, e));
+    }
 
     if (cur) {
-        g.board.set_cur(0, 0);
-        Refresh();
+        cur = Point();
+        update_board();
     }
 }
 
 void BoardWindow::OnClick(wxMouseEvent& e)
 {
-    Point cur = g.current().rev_trans(g.board.get_cur());
+    TRACE_SCOPE("board_window.click");
 
-    SetFocus();
+    if (recorder && (e.LeftDown() || e.RightDown())) {
+        recorder->record(mouse_input(e.LeftDown() ? InputType::LEFT : InputType::RIGHT, e));
+    }
 
-    if (cur) {
-        if (g.board.has_stone(cur)) {
-            return;
-        }
+    SetFocus();
 
-        int stone;
+    if (!cur || !snapshot) {
+        return;
+    }
 
-        if (e.LeftDown()) {
-            stone = g.current().flip(CELL_BLACK);
-        } else if (e.RightDown()) {
-            stone = g.current().flip(CELL_WHITE);
-        } else {
-            return;
-        }
+    if (snapshot->looks[(cur.y-1) * snapshot->size + (cur.x-1)].cell & 7) {
+        return;
+    }
 
-        if (g.current().put_stone(stone, cur.x, cur.y)) {
-            Refresh();
-        }
+    if (!e.LeftDown() && !e.RightDown()) {
+        return;
     }
+
+    bool is_black = e.LeftDown();
+    Point pos = cur;
+
+    frame->post([is_black, pos](G& g) {
+        Game& game = g.current();
+        Point pt = game.rev_trans(pos);
+        game.put_stone(game.flip(is_black ? CELL_BLACK : CELL_WHITE), pt.x, pt.y);
+    });
 }
 
 void BoardWindow::OnWheel(wxMouseEvent& e)
 {
+    TRACE_SCOPE("board_window.wheel");
+
+    if (recorder) {
+        recorder->record(mouse_input(InputType::WHEEL, e));
+    }
+
     if (e.GetWheelRotation() < 0) {
-        if (g.current().redo()) {
-            Refresh();
-        }
+        frame->post([](G& g) { g.current().redo(); });
     } else {
-        if (g.current().undo()) {
-            Refresh();
-        }
+        frame->post([](G& g) { g.current().undo(); });
     }
 }
 
-void BoardWindow::OnKeyDown(wxKeyEvent& e)
+// キーの操作。モデルのスレッドで実行する。posはカーソルの交点（画面の向き）
+static void exec_key(G& g, int key, bool shift, bool ctrl, Point pos, const std::string& text)
 {
-    const int key = e.GetKeyCode();
     Game& game = g.current();
     Gmode mode = game.get_mode();
-    Point cur = game.rev_trans(g.board.get_cur());
+    Point cur = game.rev_trans(pos);
     int cell;
 
     switch (key) {
@@ -523,7 +492,6 @@ void BoardWindow::OnKeyDown(wxKeyEvent& e)
                 game.change_to_answer_mode();
             } else if (mode == Gmode::SOLVE) {
                 game.move_to_answer();
-                Refresh();
             }
             break;
 
@@ -537,38 +505,27 @@ void BoardWindow::OnKeyDown(wxKeyEvent& e)
                 cell = game.flip(CELL_WHITE);
             }
 
-            if (game.put_stone(cell, cur.x, cur.y)) {
-                Refresh();
-            }
+            game.put_stone(cell, cur.x, cur.y);
             break;
 
         case 'C':
-            if (e.ShiftDown()) {
+            if (shift) {
                 game.remove_comment();
             } else {
-                game.add_comment(frame->get_text());
+                game.add_comment(text);
             }
             break;
 
         case 'G':
-            if (e.ShiftDown()) {
-                if (g.prev_game()) {
-                    Refresh();
-                }
+            if (shift) {
+                g.prev_game();
             } else {
-                if (g.next_game()) {
-                    Refresh();
-                }
+                g.next_game();
             }
             break;
 
         case 'L':
-            {
-                std::string s = frame->get_text();
-                if (game.set_label(s, cur.x, cur.y)) {
-                    Refresh();
-                }
-            }
+            game.set_label(text, cur.x, cur.y);
             break;
 
         case 'P':
@@ -580,28 +537,20 @@ void BoardWindow::OnKeyDown(wxKeyEvent& e)
                     cell = CELL_BLACK;
                 }
 
-                if (game.put_stone(cell, 20, 20)) {
-                    Refresh();
-                }
+                game.put_stone(cell, 20, 20);
             }
             break;
 
         case 'K':
-            if (game.change_to_free_mode()) {
-                Refresh();
-            }
+            game.change_to_free_mode();
             break;
 
         case 'Q':
-            if (game.change_to_create_mode()) {
-                Refresh();
-            }
+            game.change_to_create_mode();
             break;
 
         case '@':
-            if (game.toggle_correct()) {
-                Refresh();
-            }
+            game.toggle_correct();
             break;
 
         case '.':
@@ -609,123 +558,95 @@ void BoardWindow::OnKeyDown(wxKeyEvent& e)
             break;
 
         case '1':
-            if (e.ShiftDown()) {
-                if (game.set_label("1", cur.x, cur.y)) {
-                    Refresh();
-                }
-            } else {
-                if (game.set_mark(CELL_CR, cur.x, cur.y)) {
-                    Refresh();
-                }
-            }
-            break;
-
         case '2':
-            if (e.ShiftDown()) {
-                if (game.set_label("2", cur.x, cur.y)) {
-                    Refresh();
-                }
-            } else {
-                if (game.set_mark(CELL_MA, cur.x, cur.y)) {
-                    Refresh();
-                }
-            }
-            break;
-
         case '3':
-            if (e.ShiftDown()) {
-                if (game.set_label("3", cur.x, cur.y)) {
-                    Refresh();
-                }
+            if (shift) {
+                game.set_label(std::string(1, key), cur.x, cur.y);
             } else {
-                if (game.set_mark(CELL_TR, cur.x, cur.y)) {
-                    Refresh();
-                }
+                game.set_mark(key == '1' ? CELL_CR : key == '2' ? CELL_MA : CELL_TR, cur.x, cur.y);
             }
             break;
 
         case '4':
-            if (e.ShiftDown()) {
-                if (game.set_label("4", cur.x, cur.y)) {
-                    Refresh();
-                }
-            }
-            break;
-
         case '5':
-            if (e.ShiftDown()) {
-                if (game.set_label("5", cur.x, cur.y)) {
-                    Refresh();
-                }
+            if (shift) {
+                game.set_label(std::string(1, key), cur.x, cur.y);
             }
             break;
 
         case '6':
-            if (e.ShiftDown()) {
-                if (game.set_label("6", cur.x, cur.y)) {
-                    Refresh();
-                }
-            } else {
-                g.new_game(6);
-                Refresh();
-            }
-            break;
-
         case '7':
-            if (e.ShiftDown()) {
-                if (game.set_label("7", cur.x, cur.y)) {
-                    Refresh();
-                }
-            } else {
-                g.new_game(9);
-                Refresh();
-            }
-            break;
-
         case '8':
-            if (e.ShiftDown()) {
-                if (game.set_label("8", cur.x, cur.y)) {
-                    Refresh();
-                }
-            } else {
-                g.new_game(13);
-                Refresh();
-            }
-            break;
-
         case '9':
-            if (e.ShiftDown()) {
-                if (game.set_label("9", cur.x, cur.y)) {
-                    Refresh();
-                }
+            if (shift) {
+                game.set_label(std::string(1, key), cur.x, cur.y);
             } else {
-                g.new_game(19);
-                Refresh();
+                g.new_game(key == '6' ? 6 : key == '7' ? 9 : key == '8' ? 13 : 19);
             }
             break;
 
         case WXK_LEFT:
-            if (game.undo()) {
-                Refresh();
-            }
+            game.undo();
             break;
 
         case WXK_RIGHT:
-            if (game.redo()) {
-                Refresh();
-            }
+            game.redo();
             break;
 
         case WXK_DELETE:
-            if (e.ControlDown()) {
-                if (g.delete_game()) {
-                    Refresh();
-                }
+            if (ctrl) {
+                g.delete_game();
             } else {
-                if (game.delete_node()) {
-                    Refresh();
-                }
+                game.delete_node();
             }
             break;
     }
 }
+
+void BoardWindow::OnKeyDown(wxKeyEvent& e)
+{
+    TRACE_SCOPE("board_window.key");
+
+    if (recorder) {
+        InputEvent ev;
+        ev.type = InputType::KEY;
+        ev.key = e.GetKeyCode();
+        ev.mods = (e.ShiftDown() ? INPUT_SHIFT : 0) | (e.ControlDown() ? INPUT_CTRL : 0);
+        recorder->record(ev);
+    }
+
+    const int key = e.GetKeyCode();
+
+    // 盤に関係しないものはここで済ませる
+    switch (key) {
+        case 'F':
+            frame->find_position();
+            return;
+
+        case 'S':
+            frame->search_comments();
+            return;
+
+        case 'H':
+            show_heat = !show_heat;
+            update_board();
+            return;
+
+        case WXK_F12:
+            PROF_DUMP();
+            return;
+    }
+
+    // 入力欄とカーソルは今の値を渡す
+    bool shift = e.ShiftDown();
+    bool ctrl = e.ControlDown();
+    Point pos = cur;
+    std::string text;
+    if (key == 'C' || key == 'L') {
+        text = frame->get_text();
+    }
+
+    frame->post([key, shift, ctrl, pos, text](G& g) {
+        exec_key(g, key, shift, ctrl, pos, text);
+    });
+}
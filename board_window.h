@@ -6,7 +6,12 @@
     #include <wx/wx.h>
 #endif
 
-#include "g.h"
+#include <string>
+#include <vector>
+
+#include "board_snapshot.h"
+#include "sprite_cache.h"
+#include "input_trace.h"
 
 class MyFrame;
 
@@ -15,15 +20,54 @@ class MyFrame;
 class BoardWindow : public wxWindow
 {
     int width = MIN_WIDTH;
-    G& g;
     MyFrame* frame;
 
+    // モデルのスレッドが作った最新の盤面。Gには触らない
+    std::shared_ptr<const BoardSnapshot> snapshot;
+    Point cur;  // カーソルのある交点（画面の向き）
+
+    // 背景、線、星はサイズが変わったときだけ描き直す
+    wxBitmap board_layer;
+    int layer_width = 0;
+    int layer_board_size = 0;
+
+    SpriteCache sprites;
+
+    // 前回描いた盤面
+    std::vector<CellLook> painted;
+    int painted_pass = CELL_SPACE;
+
+    InputRecorder* recorder = nullptr;
+    InputReplay* replay = nullptr;
+
+    // 定石・布石の木があれば、次の手の頻度を描く
+    bool show_heat = true;
+
+    int board_size() const { return snapshot ? snapshot->size : 0; };
+    void update_layer();
+    void draw_sprite(wxDC& dc, const wxBitmap& bmp, double st_x, double st_y);
+    void get_looks(std::vector<CellLook>& looks, int& pass);
+    wxRect cell_rect(int x, int y);
+
 public:
-    BoardWindow(MyFrame* frame, G& g);
+    BoardWindow(MyFrame* frame);
+
+    int get_width() { return width; };
+    void set_recorder(InputRecorder* r) { recorder = r; };
+    // 再生中はスナップショットを受け取るたびに知らせる
+    void set_replay(InputReplay* r) { replay = r; };
+
+    // モデルへ送った操作の数と、今描いているスナップショットまでに実行された操作の数
+    uint64_t n_posted();
+    uint64_t n_applied() const { return snapshot ? snapshot->n_commands : 0; };
 
     void OnSize(wxSizeEvent& event);
     void OnPaint(wxPaintEvent& event);
 
+    // 盤面を変えたときはRefresh()の代わりにこれを呼ぶ
+    void update_board();
+    void set_snapshot(std::shared_ptr<const BoardSnapshot> s);
+
     void OnKeyDown(wxKeyEvent& event);
 
     void OnMove(wxMouseEvent& event);
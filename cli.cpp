@@ -0,0 +1,101 @@
+#include <cstring>
+#include <iostream>
+#include "goq.h"
+#include "prof.h"
+#include "trace.h"
+
+// wxWidgetsなしで使うコマンドラインツール
+//
+//   goq-cli info FILE...  ファイルごとの問題数と盤の大きさを表示
+//   goq-cli cat FILE...   読み込んだ問題をgoqの形式で標準出力に書き出す
+//
+// FILE に - を指定すると標準入力から読み込む
+
+static void usage()
+{
+    std::cerr << "usage: goq-cli info|cat FILE..." << std::endl;
+}
+
+static bool load(G& g, const char* file)
+{
+    if (strcmp(file, "-") == 0) {
+        return g.load(Gmode::ANSWER, std::cin);
+    }
+
+    return g.load(Gmode::ANSWER, file);
+}
+
+static bool info(G& g, const char* file)
+{
+    if (!load(g, file)) {
+        return false;
+    }
+
+    std::list<Game*> games = g.get_games();
+
+    std::cout << file << ": " << games.size() << " games" << std::endl;
+
+    int i = 1;
+    for (auto game : games) {
+        int size = 0;
+
+        for (auto p : game->get_root()->properties) {
+            if (p->pid() == PID::SZ) {
+                p->int_val(&size);
+                break;
+            }
+        }
+
+        std::cout << "  " << i << ": SZ=" << size << std::endl;
+        i++;
+    }
+
+    return true;
+}
+
+static bool cat(G& g, const char* file)
+{
+    if (!load(g, file)) {
+        return false;
+    }
+
+    for (auto game : g.get_games()) {
+        game->write_sgf(std::cout);
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    prof_init();
+    trace_init();
+
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+
+    bool (*cmd)(G&, const char*) = nullptr;
+
+    if (strcmp(argv[1], "info") == 0) {
+        cmd = info;
+    } else if (strcmp(argv[1], "cat") == 0) {
+        cmd = cat;
+    } else {
+        usage();
+        return 2;
+    }
+
+    int ret = 0;
+
+    for (int i = 2; i < argc; i++) {
+        G g;
+
+        if (!cmd(g, argv[i])) {
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,483 @@
+#include <sys/stat.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "comment_index.h"
+#include "node.h"
+#include "replay.h"
+#include "prof.h"
+
+// UTF-8を1文字読む。壊れていれば1バイト進めて-1を返す
+static int next_char(const std::string& s, size_t& i)
+{
+    unsigned char c = s[i];
+    int n = 0;
+    int cp = 0;
+
+    if (c < 0x80) {
+        i++;
+        return c;
+    } else if ((c & 0xe0) == 0xc0) {
+        n = 1;
+        cp = c & 0x1f;
+    } else if ((c & 0xf0) == 0xe0) {
+        n = 2;
+        cp = c & 0x0f;
+    } else if ((c & 0xf8) == 0xf0) {
+        n = 3;
+        cp = c & 0x07;
+    } else {
+        i++;
+        return -1;
+    }
+
+    if (i + n >= s.size()) {
+        i++;
+        return -1;
+    }
+
+    for (int k = 1; k <= n; k++) {
+        unsigned char cc = s[i + k];
+        if ((cc & 0xc0) != 0x80) {
+            i++;
+            return -1;
+        }
+        cp = (cp << 6) | (cc & 0x3f);
+    }
+
+    i += n + 1;
+
+    return cp;
+}
+
+static void append_utf8(std::string& s, int cp)
+{
+    if (cp < 0x80) {
+        s += (char) cp;
+    } else if (cp < 0x800) {
+        s += (char) (0xc0 | (cp >> 6));
+        s += (char) (0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        s += (char) (0xe0 | (cp >> 12));
+        s += (char) (0x80 | ((cp >> 6) & 0x3f));
+        s += (char) (0x80 | (cp & 0x3f));
+    } else {
+        s += (char) (0xf0 | (cp >> 18));
+        s += (char) (0x80 | ((cp >> 12) & 0x3f));
+        s += (char) (0x80 | ((cp >> 6) & 0x3f));
+        s += (char) (0x80 | (cp & 0x3f));
+    }
+}
+
+// かな・漢字・ハングル。空白で区切らないのでbigramにする
+static bool is_cjk(int cp)
+{
+    return (cp >= 0x3040 && cp <= 0x30ff)      // ひらがな・カタカナ
+        || (cp >= 0x31f0 && cp <= 0x31ff)
+        || (cp >= 0x3400 && cp <= 0x4dbf)      // 漢字
+        || (cp >= 0x4e00 && cp <= 0x9fff)
+        || (cp >= 0xf900 && cp <= 0xfaff)
+        || (cp >= 0xac00 && cp <= 0xd7af)      // ハングル
+        || (cp >= 0xff66 && cp <= 0xff9f)      // 半角カタカナ
+        || (cp >= 0x20000 && cp <= 0x2ffff);
+}
+
+// 語の一部にならない文字
+static bool is_separator(int cp)
+{
+    if (cp < 0) {
+        return true;
+    }
+
+    if (cp < 0x80) {
+        return !isalnum(cp);
+    }
+
+    return (cp >= 0x80 && cp <= 0xbf)          // Latin-1の記号
+        || (cp >= 0x2000 && cp <= 0x2bff)      // 句読点・矢印・図形など
+        || (cp >= 0x3000 && cp <= 0x303f)      // 全角の句読点・括弧
+        || (cp >= 0xff00 && cp <= 0xff65)
+        || (cp >= 0xffe0 && cp <= 0xffef);
+}
+
+static void add_cjk_run(const std::vector<int>& run, std::vector<std::string>& tokens, bool for_query)
+{
+    if (!for_query || run.size() == 1) {
+        for (int cp : run) {
+            std::string s;
+            append_utf8(s, cp);
+            tokens.push_back(s);
+        }
+    }
+
+    for (size_t i = 0; i + 1 < run.size(); i++) {
+        std::string s;
+        append_utf8(s, run[i]);
+        append_utf8(s, run[i + 1]);
+        tokens.push_back(s);
+    }
+}
+
+void tokenize_text(const std::string& text, std::vector<std::string>& tokens, bool for_query)
+{
+    std::string word;
+    std::vector<int> run;
+
+    size_t i = 0;
+    for (;;) {
+        // 最後に区切りを1つ読んだことにして、残りを出す
+        bool end = (i >= text.size());
+        int cp = end ? -1 : next_char(text, i);
+
+        // 全角の英数字・記号は半角にする
+        if (cp >= 0xff01 && cp <= 0xff5e) {
+            cp -= 0xfee0;
+        }
+
+        if (!is_cjk(cp) && !run.empty()) {
+            add_cjk_run(run, tokens, for_query);
+            run.clear();
+        }
+
+        if ((is_cjk(cp) || is_separator(cp)) && !word.empty()) {
+            tokens.push_back(word);
+            word.clear();
+        }
+
+        if (is_cjk(cp)) {
+            run.push_back(cp);
+        } else if (!is_separator(cp)) {
+            append_utf8(word, (cp < 0x80) ? tolower(cp) : cp);
+        }
+
+        if (end) {
+            break;
+        }
+    }
+}
+
+bool CommentIndexBuilder::load(const std::string& index)
+{
+    CommentIndex old;
+
+    if (!old.open(index)) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < old.n_files(); i++) {
+        File& f = m_old[old.file_name(i)];
+        f.mtime = old.file_mtime(i);
+        f.size = old.file_size(i);
+    }
+
+    for (uint64_t i = 0; i < old.n_docs(); i++) {
+        CommentHit hit = old.doc(i);
+        Doc d;
+        d.game = hit.game;
+        d.path.assign(hit.path.begin(), hit.path.end());
+        d.text = hit.text;
+        m_old[hit.file].docs.push_back(d);
+    }
+
+    return true;
+}
+
+bool CommentIndexBuilder::add_file(const std::string& file)
+{
+    struct stat st;
+
+    if (stat(file.c_str(), &st) != 0) {
+        std::cerr << "Error: couldn't open file: " << file << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    int64_t mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+    // 変わっていなければ前の索引から引き継ぐ
+    auto itr = m_old.find(file);
+    if (itr != m_old.end() && itr->second.mtime == mtime && itr->second.size == (uint64_t) st.st_size) {
+        m_files[file] = std::move(itr->second);
+        m_old.erase(itr);
+        m_n_reused++;
+        return true;
+    }
+
+    std::vector<std::shared_ptr<Node>> trees;
+
+    if (!load_trees(file, trees)) {
+        return false;
+    }
+
+    File& f = m_files[file];
+    f = File();
+    f.mtime = mtime;
+    f.size = st.st_size;
+
+    for (size_t i = 0; i < trees.size(); i++) {
+        add_tree(file, i, trees[i]);
+    }
+
+    m_n_parsed++;
+
+    return true;
+}
+
+void CommentIndexBuilder::add_tree(const std::string& file, uint32_t game, std::shared_ptr<Node> root)
+{
+    std::vector<uint16_t> path;
+
+    add_node(m_files[file], game, root, path);
+}
+
+void CommentIndexBuilder::add_node(File& file, uint32_t game, std::shared_ptr<Node> node, std::vector<uint16_t>& path)
+{
+    for (auto& p : node->properties) {
+        if (p->pid() == PID::C && p->val() != "") {
+            file.docs.push_back({game, path, p->val()});
+        }
+    }
+
+    uint16_t i = 0;
+    for (auto& child : node->children) {
+        path.push_back(i++);
+        add_node(file, game, child, path);
+        path.pop_back();
+    }
+}
+
+bool CommentIndexBuilder::write(const std::string& out)
+{
+    PROF_SCOPE("comment_index.write");
+
+    std::vector<CommentFile> files;
+    std::vector<CommentDoc> docs;
+    std::vector<uint16_t> paths;
+    std::string strs;
+    std::map<std::string, std::vector<uint32_t>> terms;
+
+    for (auto& kv : m_files) {
+        CommentFile f = {strs.size(), (uint32_t) kv.first.size(), 0, kv.second.mtime, kv.second.size};
+        strs += kv.first;
+
+        for (auto& d : kv.second.docs) {
+            uint32_t id = docs.size();
+            CommentDoc doc = {(uint32_t) files.size(), d.game, paths.size(), (uint32_t) d.path.size(),
+                (uint32_t) d.text.size(), strs.size()};
+            docs.push_back(doc);
+            paths.insert(paths.end(), d.path.begin(), d.path.end());
+            strs += d.text;
+
+            std::vector<std::string> tokens;
+            tokenize_text(d.text, tokens);
+
+            for (auto& t : tokens) {
+                std::vector<uint32_t>& v = terms[t];
+                if (v.empty() || v.back() != id) {
+                    v.push_back(id);
+                }
+            }
+        }
+
+        files.push_back(f);
+    }
+
+    // mapなのでバイト列の順に並ぶ
+    std::vector<CommentTerm> term_table;
+    std::vector<uint32_t> postings;
+    for (auto& kv : terms) {
+        CommentTerm t = {strs.size(), (uint32_t) kv.first.size(), (uint32_t) kv.second.size(), postings.size()};
+        strs += kv.first;
+        postings.insert(postings.end(), kv.second.begin(), kv.second.end());
+        term_table.push_back(t);
+    }
+
+    CommentHeader hd;
+    memcpy(hd.magic, "GOQC", 4);
+    hd.version = COMMENT_INDEX_VERSION;
+    hd.n_files = files.size();
+    hd.n_docs = docs.size();
+    hd.n_terms = term_table.size();
+    hd.n_postings = postings.size();
+    hd.n_paths = paths.size();
+    hd.files_off = sizeof(hd);
+    hd.docs_off = hd.files_off + files.size() * sizeof(CommentFile);
+    hd.terms_off = hd.docs_off + docs.size() * sizeof(CommentDoc);
+    hd.postings_off = hd.terms_off + term_table.size() * sizeof(CommentTerm);
+    hd.paths_off = hd.postings_off + postings.size() * sizeof(uint32_t);
+    hd.strs_off = hd.paths_off + paths.size() * sizeof(uint16_t);
+    hd.strs_len = strs.size();
+
+    std::string tmp = out + ".tmp";
+    std::ofstream ofs(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    ofs.write((const char*) &hd, sizeof(hd));
+    ofs.write((const char*) files.data(), files.size() * sizeof(CommentFile));
+    ofs.write((const char*) docs.data(), docs.size() * sizeof(CommentDoc));
+    ofs.write((const char*) term_table.data(), term_table.size() * sizeof(CommentTerm));
+    ofs.write((const char*) postings.data(), postings.size() * sizeof(uint32_t));
+    ofs.write((const char*) paths.data(), paths.size() * sizeof(uint16_t));
+    ofs.write(strs.data(), strs.size());
+    ofs.close();
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    if (rename(tmp.c_str(), out.c_str()) != 0) {
+        std::cerr << "Error: couldn't rename file: " << tmp << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void CommentIndex::close()
+{
+    m_file.close();
+    m_header = nullptr;
+    m_files = nullptr;
+    m_docs = nullptr;
+    m_terms = nullptr;
+    m_postings = nullptr;
+    m_paths = nullptr;
+    m_strs = nullptr;
+}
+
+bool CommentIndex::open(const std::string& file)
+{
+    close();
+
+    if (!m_file.open(file)) {
+        return false;
+    }
+
+    const char* base = m_file.data();
+    size_t len = m_file.size();
+    const CommentHeader* h = (const CommentHeader*) base;
+
+    if (len < sizeof(CommentHeader) || memcmp(h->magic, "GOQC", 4) != 0 || h->version != COMMENT_INDEX_VERSION
+            || h->files_off + h->n_files * sizeof(CommentFile) > len
+            || h->docs_off + h->n_docs * sizeof(CommentDoc) > len
+            || h->terms_off + h->n_terms * sizeof(CommentTerm) > len
+            || h->postings_off + h->n_postings * sizeof(uint32_t) > len
+            || h->paths_off + h->n_paths * sizeof(uint16_t) > len
+            || h->strs_off + h->strs_len > len) {
+        std::cerr << "Error: broken comment index: " << file << std::endl;
+        close();
+        return false;
+    }
+
+    m_header = h;
+    m_files = (const CommentFile*) (base + h->files_off);
+    m_docs = (const CommentDoc*) (base + h->docs_off);
+    m_terms = (const CommentTerm*) (base + h->terms_off);
+    m_postings = (const uint32_t*) (base + h->postings_off);
+    m_paths = (const uint16_t*) (base + h->paths_off);
+    m_strs = base + h->strs_off;
+
+    return true;
+}
+
+std::string CommentIndex::str(uint64_t off, uint32_t len) const
+{
+    if (off + len > m_header->strs_len) {
+        return "";
+    }
+
+    return std::string(m_strs + off, len);
+}
+
+std::string CommentIndex::file_name(uint64_t i) const
+{
+    return str(m_files[i].name_off, m_files[i].name_len);
+}
+
+CommentHit CommentIndex::doc(uint64_t i) const
+{
+    const CommentDoc& d = m_docs[i];
+    CommentHit hit;
+
+    hit.file = (d.file < m_header->n_files) ? file_name(d.file) : "";
+    hit.game = d.game;
+    hit.text = str(d.text_off, d.text_len);
+
+    if (d.path_off + d.path_len <= m_header->n_paths) {
+        hit.path.assign(m_paths + d.path_off, m_paths + d.path_off + d.path_len);
+    }
+
+    return hit;
+}
+
+const CommentTerm* CommentIndex::find(const std::string& term) const
+{
+    const CommentTerm* end = m_terms + m_header->n_terms;
+
+    const CommentTerm* t = std::lower_bound(m_terms, end, term, [this](const CommentTerm& a, const std::string& b) {
+        return str(a.str_off, a.str_len) < b;
+    });
+
+    if (t == end || str(t->str_off, t->str_len) != term || t->first + t->n > m_header->n_postings) {
+        return nullptr;
+    }
+
+    return t;
+}
+
+size_t CommentIndex::search(const std::string& query, std::vector<CommentHit>& hits, size_t limit) const
+{
+    PROF_SCOPE("comment_index.search");
+
+    if (!m_header) {
+        return 0;
+    }
+
+    std::vector<std::string> tokens;
+    tokenize_text(query, tokens, true);
+
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+
+    if (tokens.empty()) {
+        return 0;
+    }
+
+    std::vector<const CommentTerm*> terms;
+    for (auto& t : tokens) {
+        const CommentTerm* term = find(t);
+        if (!term) {
+            return 0;
+        }
+        terms.push_back(term);
+    }
+
+    // 短い順に積をとる
+    std::sort(terms.begin(), terms.end(), [](const CommentTerm* a, const CommentTerm* b) {
+        return a->n < b->n;
+    });
+
+    std::vector<uint32_t> result(m_postings + terms[0]->first, m_postings + terms[0]->first + terms[0]->n);
+
+    for (size_t i = 1; i < terms.size() && !result.empty(); i++) {
+        const uint32_t* p = m_postings + terms[i]->first;
+        std::vector<uint32_t> next;
+        std::set_intersection(result.begin(), result.end(), p, p + terms[i]->n, std::back_inserter(next));
+        result.swap(next);
+    }
+
+    for (size_t i = 0; i < result.size() && i < limit; i++) {
+        if (result[i] < m_header->n_docs) {
+            hits.push_back(doc(result[i]));
+        }
+    }
+
+    return result.size();
+}
@@ -0,0 +1,157 @@
+#ifndef COMMENT_INDEX_H
+#define COMMENT_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+
+class Node;
+
+// コメント（C[]）の全文索引。語から、その語を含むコメントのある（ファイル, 何番目の棋譜, ノードの位置）を引く。
+// ノードの位置は、棋譜のrootから何番目の子をたどるか（0から）の列。
+//
+// 語の切り方（UTF-8）:
+//   英数字   続いている間を1語にする。小文字にそろえる。全角の英数字は半角にする
+//   かな・漢字・ハングル  1文字ずつと、隣り合う2文字ずつ（bigram）。
+//            引くときは2文字以上続けばbigramだけを使う
+//   記号・空白  区切り
+//
+// ファイルの形式（リトルエンディアン）:
+//   CommentHeader
+//   CommentFile n_files個
+//   CommentDoc n_docs個（ファイルの順）
+//   CommentTerm n_terms個（語のバイト列の順）
+//   u32 n_postings個（語ごとにCommentDocの添字の順）
+//   u16 n_paths個（ノードの位置）
+//   文字列（ファイル名、コメント、語）
+//
+// コメントそのものも持つので、作り直すときに変わっていないファイルは読み直さない
+
+#define COMMENT_INDEX_VERSION (1)
+
+struct CommentHeader
+{
+    char magic[4];  // "GOQC"
+    uint32_t version;
+    uint64_t n_files;
+    uint64_t n_docs;
+    uint64_t n_terms;
+    uint64_t n_postings;
+    uint64_t n_paths;
+    uint64_t files_off;
+    uint64_t docs_off;
+    uint64_t terms_off;
+    uint64_t postings_off;
+    uint64_t paths_off;
+    uint64_t strs_off;
+    uint64_t strs_len;
+};
+
+struct CommentFile
+{
+    uint64_t name_off;  // 文字列の位置
+    uint32_t name_len;
+    uint32_t reserved;
+    int64_t mtime;  // ナノ秒
+    uint64_t size;
+};
+
+struct CommentDoc
+{
+    uint32_t file;
+    uint32_t game;
+    uint64_t path_off;  // u16の添字
+    uint32_t path_len;
+    uint32_t text_len;
+    uint64_t text_off;
+};
+
+struct CommentTerm
+{
+    uint64_t str_off;
+    uint32_t str_len;
+    uint32_t n;
+    uint64_t first;  // u32 postingsの添字
+};
+
+struct CommentHit
+{
+    std::string file;
+    int game;
+    std::vector<int> path;
+    std::string text;
+};
+
+// textを語に切ってtokensに足す。for_queryなら引くとき用に切る
+void tokenize_text(const std::string& text, std::vector<std::string>& tokens, bool for_query = false);
+
+class CommentIndexBuilder
+{
+    struct Doc
+    {
+        uint32_t game;
+        std::vector<uint16_t> path;
+        std::string text;
+    };
+
+    struct File
+    {
+        int64_t mtime = 0;
+        uint64_t size = 0;
+        std::vector<Doc> docs;
+    };
+
+    std::map<std::string, File> m_files;
+    std::map<std::string, File> m_old;  // load()で読んだ前の索引
+    size_t m_n_parsed = 0;
+    size_t m_n_reused = 0;
+
+    void add_node(File& file, uint32_t game, std::shared_ptr<Node> node, std::vector<uint16_t>& path);
+public:
+    // 前に作った索引を読む。add_file()で大きさと更新時刻が同じファイルはそこから引き継ぐ
+    bool load(const std::string& index);
+
+    bool add_file(const std::string& file);
+    void add_tree(const std::string& file, uint32_t game, std::shared_ptr<Node> root);
+
+    size_t n_parsed() const { return m_n_parsed; };
+    size_t n_reused() const { return m_n_reused; };
+
+    bool write(const std::string& out);
+};
+
+class CommentIndex
+{
+    MappedFile m_file;
+    const CommentHeader* m_header = nullptr;
+    const CommentFile* m_files = nullptr;
+    const CommentDoc* m_docs = nullptr;
+    const CommentTerm* m_terms = nullptr;
+    const uint32_t* m_postings = nullptr;
+    const uint16_t* m_paths = nullptr;
+    const char* m_strs = nullptr;
+
+    std::string str(uint64_t off, uint32_t len) const;
+    const CommentTerm* find(const std::string& term) const;
+public:
+    bool open(const std::string& file);
+    void close();
+
+    uint64_t n_files() const { return m_header ? m_header->n_files : 0; };
+    uint64_t n_docs() const { return m_header ? m_header->n_docs : 0; };
+    uint64_t n_terms() const { return m_header ? m_header->n_terms : 0; };
+
+    std::string file_name(uint64_t i) const;
+    int64_t file_mtime(uint64_t i) const { return m_files[i].mtime; };
+    uint64_t file_size(uint64_t i) const { return m_files[i].size; };
+    CommentHit doc(uint64_t i) const;
+
+    // queryの語をすべて含むコメントを探す。見つかった数を返し、hitsにはlimit個まで入れる
+    size_t search(const std::string& query, std::vector<CommentHit>& hits, size_t limit = SIZE_MAX) const;
+};
+
+#endif
@@ -0,0 +1,286 @@
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include "goq.h"
+#include "prof.h"
+#include "trace.h"
+#include "zobrist.h"
+
+// 回転・鏡映・黒白の入れ替えで同じになる問題を探す
+//
+//   goq-dedup [-j スレッド数] [-r] [-o 出力ファイル] FILE...
+//
+// 何も指定しなければ重複を表示するだけ。
+// -r で2つ目以降の重複をファイルから取り除く（goqの形式で書き直す）。
+// -o で重複を除いた問題をまとめて1つのファイルに書き出す。
+// 置き石のない棋譜（空の盤から打つもの）は初期配置では区別できないので、重複とみなさず残す
+
+struct Entry
+{
+    uint64_t hash;
+    int file;
+    int game;  // ファイル内で何番目の問題か（0から）
+
+    bool operator<(const Entry& e) const {
+        if (hash != e.hash) {
+            return hash < e.hash;
+        }
+        if (file != e.file) {
+            return file < e.file;
+        }
+        return game < e.game;
+    };
+};
+
+struct FileResult
+{
+    bool ok = false;
+    std::vector<uint64_t> hashes;
+    std::vector<bool> has_setup;  // falseならhashesは使わない
+    std::vector<std::string> sgfs;  // -r, -o のときだけ
+};
+
+static void usage()
+{
+    std::cerr << "usage: goq-dedup [-j threads] [-r] [-o out] FILE..." << std::endl;
+}
+
+static void scan(const std::string& file, bool keep_sgf, FileResult& r)
+{
+    G g;
+
+    if (!g.load(Gmode::ANSWER, file)) {
+        return;
+    }
+
+    for (auto game : g.get_games()) {
+        uint64_t hash = 0;
+        bool ok = canonical_setup_hash(game->get_root(), hash);
+        r.hashes.push_back(hash);
+        r.has_setup.push_back(ok);
+
+        if (keep_sgf) {
+            std::ostringstream os;
+            game->write_sgf(os);
+            r.sgfs.push_back(os.str());
+        }
+    }
+
+    r.ok = true;
+}
+
+// 一時ファイルに書いてから置き換える
+static bool write_games(const std::string& file, const std::vector<std::string>& sgfs)
+{
+    std::string tmp = file + ".tmp";
+
+    {
+        std::ofstream ofs(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!ofs) {
+            std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+            return false;
+        }
+
+        for (auto& s : sgfs) {
+            ofs << s;
+        }
+
+        if (!ofs.flush()) {
+            std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+            return false;
+        }
+    }
+
+    if (rename(tmp.c_str(), file.c_str()) != 0) {
+        std::cerr << "Error: couldn't rename file: " << tmp << std::endl;
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    prof_init();
+    trace_init();
+
+    int n_threads = std::thread::hardware_concurrency();
+    bool do_remove = false;
+    std::string out = "";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:ro:")) != -1) {
+        switch (opt) {
+        case 'j':
+            n_threads = atoi(optarg);
+            break;
+        case 'r':
+            do_remove = true;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    std::vector<std::string> files(argv + optind, argv + argc);
+    std::vector<FileResult> results(files.size());
+    bool keep_sgf = do_remove || out != "";
+
+    if (n_threads < 1) {
+        n_threads = 1;
+    }
+    if (n_threads > (int) files.size()) {
+        n_threads = files.size();
+    }
+
+    // ファイル単位で各スレッドに配る。Gはスレッドごとに作る
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < n_threads; i++) {
+        threads.emplace_back([&]() {
+            for (size_t k = next++; k < files.size(); k = next++) {
+                scan(files[k], keep_sgf, results[k]);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::vector<Entry> entries;
+    int n_no_setup = 0;
+    int ret = 0;
+
+    for (int i = 0; i < (int) files.size(); i++) {
+        if (!results[i].ok) {
+            ret = 1;
+            continue;
+        }
+
+        for (int j = 0; j < (int) results[i].hashes.size(); j++) {
+            if (!results[i].has_setup[j]) {
+                n_no_setup++;
+                continue;
+            }
+
+            entries.push_back({results[i].hashes[j], i, j});
+        }
+    }
+
+    // 同じハッシュの中ではファイル・問題の順になるので、先頭を残す
+    std::sort(entries.begin(), entries.end());
+
+    std::vector<std::vector<bool>> dup(files.size());
+    for (int i = 0; i < (int) files.size(); i++) {
+        dup[i].resize(results[i].hashes.size(), false);
+    }
+
+    int n_groups = 0;
+    int n_dups = 0;
+
+    for (size_t i = 0; i < entries.size(); ) {
+        size_t j = i + 1;
+        while (j < entries.size() && entries[j].hash == entries[i].hash) {
+            j++;
+        }
+
+        if (j - i > 1) {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) entries[i].hash);
+            std::cout << buf << ":";
+
+            for (size_t k = i; k < j; k++) {
+                std::cout << " " << files[entries[k].file] << "#" << entries[k].game + 1;
+
+                if (k > i) {
+                    dup[entries[k].file][entries[k].game] = true;
+                    n_dups++;
+                }
+            }
+
+            std::cout << std::endl;
+            n_groups++;
+        }
+
+        i = j;
+    }
+
+    std::cerr << entries.size() << " games, " << n_groups << " duplicate groups, "
+        << n_dups << " duplicates" << std::endl;
+
+    if (n_no_setup > 0) {
+        std::cerr << n_no_setup << " games without setup stones (not compared, kept)" << std::endl;
+    }
+
+    if (out != "") {
+        std::vector<std::string> unique;
+
+        for (int i = 0; i < (int) files.size(); i++) {
+            for (int j = 0; j < (int) results[i].sgfs.size(); j++) {
+                if (!dup[i][j]) {
+                    unique.push_back(results[i].sgfs[j]);
+                }
+            }
+        }
+
+        if (!write_games(out, unique)) {
+            ret = 1;
+        }
+    }
+
+    if (do_remove) {
+        for (int i = 0; i < (int) files.size(); i++) {
+            std::vector<std::string> kept;
+
+            for (int j = 0; j < (int) results[i].sgfs.size(); j++) {
+                if (!dup[i][j]) {
+                    kept.push_back(results[i].sgfs[j]);
+                }
+            }
+
+            if (kept.size() == results[i].sgfs.size()) {
+                continue;
+            }
+
+            // 全部が重複なら空のファイルは読めないので消す
+            if (kept.empty()) {
+                if (unlink(files[i].c_str()) != 0) {
+                    std::cerr << "Error: couldn't remove file: " << files[i] << std::endl;
+                    ret = 1;
+                } else {
+                    std::cerr << "removed: " << files[i] << std::endl;
+                }
+                continue;
+            }
+
+            if (!write_games(files[i], kept)) {
+                ret = 1;
+            } else {
+                std::cerr << "rewrote: " << files[i] << " (" << results[i].sgfs.size() - kept.size()
+                    << " removed)" << std::endl;
+            }
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,164 @@
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "file_watcher.h"
+#include "prof.h"
+#include "replay.h"
+#include "trace.h"
+
+FileWatcher::FileWatcher(ReloadFn fn)
+    : m_fn(fn)
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+    stop();
+}
+
+bool FileWatcher::start()
+{
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (m_fd == -1) {
+        std::cerr << "Error: couldn't watch files: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (pipe(m_pipe) != 0) {
+        std::cerr << "Error: couldn't watch files: " << strerror(errno) << std::endl;
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_thread = std::thread(&FileWatcher::run, this);
+
+    return true;
+}
+
+void FileWatcher::stop()
+{
+    if (m_fd == -1) {
+        return;
+    }
+
+    char c = 0;
+    if (write(m_pipe[1], &c, 1) != 1) {
+        std::cerr << "Error: couldn't stop watching files: " << strerror(errno) << std::endl;
+    }
+
+    m_thread.join();
+
+    close(m_pipe[0]);
+    close(m_pipe[1]);
+    close(m_fd);
+    m_fd = -1;
+}
+
+bool FileWatcher::add(const std::string& file)
+{
+    if (m_fd == -1 || file == "-") {
+        return false;
+    }
+
+    size_t slash = file.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "." : file.substr(0, slash);
+    if (dir == "") {
+        dir = "/";
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_wds.count(dir) == 0) {
+        int wd = inotify_add_watch(m_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+
+        if (wd == -1) {
+            std::cerr << "Error: couldn't watch directory: " << dir << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        m_dirs[wd] = dir;
+        m_wds[dir] = wd;
+    }
+
+    m_files[dir + "/" + file.substr(slash == std::string::npos ? 0 : slash + 1)] = file;
+
+    return true;
+}
+
+// 溜まっているイベントをすべて読み、見張っているファイルの名前をchangedに足す
+void FileWatcher::read_events(std::set<std::string>& changed)
+{
+    alignas(struct inotify_event) char buf[4096];
+
+    for (;;) {
+        ssize_t n = read(m_fd, buf, sizeof(buf));
+
+        if (n <= 0) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (char* p = buf; p < buf + n; ) {
+            struct inotify_event* ev = (struct inotify_event*) p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            auto itr = m_dirs.find(ev->wd);
+            if (itr == m_dirs.end() || ev->len == 0) {
+                continue;
+            }
+
+            auto f = m_files.find(itr->second + "/" + ev->name);
+            if (f != m_files.end()) {
+                changed.insert(f->second);
+            }
+        }
+    }
+}
+
+void FileWatcher::run()
+{
+    std::set<std::string> changed;
+
+    for (;;) {
+        struct pollfd fds[2] = {{m_fd, POLLIN, 0}, {m_pipe[0], POLLIN, 0}};
+
+        // 変わったファイルがあれば、しばらく何も来なくなるまで待つ
+        int ret = poll(fds, 2, changed.empty() ? -1 : RELOAD_DELAY_MS);
+
+        if (ret == -1 && errno != EINTR) {
+            std::cerr << "Error: couldn't watch files: " << strerror(errno) << std::endl;
+            return;
+        }
+
+        if (fds[1].revents) {
+            return;
+        }
+
+        if (ret > 0 && fds[0].revents) {
+            read_events(changed);
+            continue;
+        }
+
+        if (ret == 0) {
+            for (auto& file : changed) {
+                PROF_SCOPE("watcher.reload");
+                TRACE_SCOPE("watcher.reload");
+
+                std::vector<std::shared_ptr<Node>> trees;
+
+                if (load_trees(file, trees)) {
+                    m_fn(file, trees);
+                }
+            }
+
+            changed.clear();
+        }
+    }
+}
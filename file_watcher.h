@@ -0,0 +1,50 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Node;
+
+// 読み込んだファイルをinotifyで見張り、書き換えられたら別のスレッドで読み直す。
+// エディタは別のファイルに書いてからrenameすることが多いので、ファイルではなく
+// そのディレクトリを見て、ファイル名で絞る。
+// 続けて書かれたときに何度も読まないよう、最後の変更からRELOAD_DELAY_MS待ってから読む
+
+#define RELOAD_DELAY_MS (200)
+
+// 見張っているスレッドから呼ぶ。読めなかったファイル（書きかけなど）では呼ばない
+typedef std::function<void(const std::string& file, std::vector<std::shared_ptr<Node>>& trees)> ReloadFn;
+
+class FileWatcher
+{
+    ReloadFn m_fn;
+    int m_fd = -1;
+    int m_pipe[2] = {-1, -1};  // 止めるときに書く
+    std::thread m_thread;
+
+    std::mutex m_mutex;
+    std::map<int, std::string> m_dirs;  // watch descriptor → ディレクトリ
+    std::map<std::string, int> m_wds;
+    std::map<std::string, std::string> m_files;  // ディレクトリ/名前 → add()に渡した名前
+
+    void run();
+    void read_events(std::set<std::string>& changed);
+public:
+    FileWatcher(ReloadFn fn);
+    ~FileWatcher();
+
+    bool start();
+    void stop();
+
+    // 同じファイルを何度足してもよい
+    bool add(const std::string& file);
+};
+
+#endif
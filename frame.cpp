@@ -1,13 +1,16 @@
-#include <wx/treectrl.h>
+#include <wx/dataview.h>
 #include <wx/imaglist.h>
-#include <fstream>
+#include <chrono>
 #include "frame.h"
 #include "board_window.h"
 #include "node.h"
 #include "g.h"
+#include "tree_model.h"
+#include "prof.h"
+#include "trace.h"
 
-wxTreeCtrl* tree_ctrl;
-wxTreeItemId root_id = nullptr;
+wxDataViewCtrl* tree_view;
+TreeModel* tree_model;
 
 wxImageList* image_list;
 
@@ -16,7 +19,7 @@ wxStaticText* s_comment_ctrl;
 wxTextCtrl* d_text_ctrl;
 
 MyFrame::MyFrame(G& g, std::string wrong)
-    : wxFrame(nullptr, wxID_ANY, "goq"), g(g), wrong(wrong)
+    : wxFrame(nullptr, wxID_ANY, "goq"), g(g), wrong(wrong), snapshot_pending(false)
 {
     wxMenu *file = new wxMenu;
 
@@ -41,26 +44,45 @@ MyFrame::MyFrame(G& g, std::string wrong)
     Bind(wxEVT_MENU, &MyFrame::OnSave, this, ID_SAVE);
     Bind(wxEVT_MENU, &MyFrame::OnExit, this, wxID_EXIT);
 
+    // 盤の描き直しは、溜まっていれば最新のスナップショットで1回だけ
+    model.reset(new ModelThread(g, [this]() {
+        if (!snapshot_pending.exchange(true)) {
+            CallAfter([this]() {
+                snapshot_pending = false;
+                board_window->set_snapshot(model->snapshot());
+            });
+        }
+    }));
+
     CreateStatusBar();
     create_controls();
+
+    // 書き込みは別スレッドでする
+    if (wrong != "") {
+        wrong_log.reset(new WrongLog(wrong));
+    }
 }
 
 void MyFrame::create_controls()
 {
-    BoardWindow* win = new BoardWindow(this, g);
-
-    tree_ctrl = new wxTreeCtrl(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxTR_LINES_AT_ROOT | wxTR_HAS_BUTTONS);
-    root_id = tree_ctrl->AddRoot("Root");
-    tree_ctrl->SetIndent(30);
+    BoardWindow* win = new BoardWindow(this);
+    board_window = win;
 
     image_list = new wxImageList(16, 16);
-    tree_ctrl->SetImageList(image_list);
     for (int i = 0; i <= 8; i++) {
         wxImage img = wxImage("res/" + std::to_string(i) + ".bmp");
         img.SetMaskColour(255, 255, 255);
         image_list->Add(wxBitmap(img));
     }
 
+    // 見えている行だけモデルから読み込む
+    tree_view = new wxDataViewCtrl(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxDV_NO_HEADER | wxDV_SINGLE);
+    tree_model = new TreeModel(image_list, g, model->lock());
+    tree_view->AssociateModel(tree_model);
+    tree_model->DecRef();
+    tree_view->AppendIconTextColumn("", 0);
+    tree_view->SetIndent(30);
+
     pos_ctrl = new wxStaticText(this, wxID_ANY, "");
 
     s_comment_ctrl = new wxStaticText(this, wxID_ANY, "");
@@ -81,7 +103,7 @@ void MyFrame::create_controls()
     lv_sizer->Add(d_text_ctrl, 1, wxALL | wxEXPAND, 5);
 
     rv_sizer->Add(pos_ctrl, 0, wxALL, 5);
-    rv_sizer->Add(tree_ctrl, 1, wxALL | wxEXPAND, 5);
+    rv_sizer->Add(tree_view, 1, wxALL | wxEXPAND, 5);
 
     h_sizer->Add(lv_sizer, 1, wxALL | wxEXPAND, 5);
     h_sizer->Add(rv_sizer, 1, wxALL | wxEXPAND, 5);
@@ -95,6 +117,27 @@ void MyFrame::create_controls()
     on_pos(g.get_pos());
 }
 
+MyFrame::~MyFrame()
+{
+    // 読み終わるとモデルを起こすので、先に止める
+    if (prefetcher) {
+        prefetcher->stop();
+    }
+}
+
+void MyFrame::start_model()
+{
+    model->set_opening_trie(opening_trie.get());
+
+    // 手が空いたら次の問題を用意しておき、次へ進むときは並べ替えるだけにする
+    prefetcher.reset(new Prefetcher([this]() { model->wake(); }));
+    g.set_prefetcher(prefetcher.get());
+    model->set_idle([](G& g) { g.prefetch(PREFETCH_GAMES); });
+    prefetcher->start();
+
+    model->start();
+}
+
 std::string MyFrame::get_text()
 {
     wxString text = d_text_ctrl->GetValue();
@@ -123,90 +166,37 @@ void MyFrame::OnNew(wxCommandEvent& event)
         size = 19;
     }
 
-    g.new_game(size);
-
-    Refresh();
+    post([size](G& g) { g.new_game(size); });
 }
 
-void create_tree_sub(Game& g, wxTreeItemId parent_id, std::shared_ptr<Node> node)
+// モデルのスレッドから呼ばれる。木はUIのスレッドで、モデルを止めてから読む
+void MyFrame::on_tree(Game& game, TreeEvent ev, std::shared_ptr<Node> node)
 {
-    wxTreeItemId id = tree_ctrl->AppendItem(parent_id, wxString::FromUTF8(node->to_string(g)));
-
-    Route route = g.get_route();
-
-    int cell = CELL_SPACE;
-    if (node->has(PID::B)) {
-        cell = CELL_BLACK;
-    } else if (node->has(PID::W)) {
-        cell = CELL_WHITE;
-    }
-
-    cell = g.flip(cell);
-
-    bool is_cur = (route.current() == node);
-    bool in_route = route.exists(node);
-    int image_no = 0;
-
-    if (cell == CELL_SPACE) {
-        if (is_cur) {
-            image_no = 1;
-        } else if (in_route) {
-            image_no = 2;
-        } else {
-            image_no = 0;
-        }
-    } else if (cell == CELL_BLACK) {
-        if (is_cur) {
-            image_no = 4;
-        } else if (in_route) {
-            image_no = 5;
-        } else {
-            image_no = 3;
-        }
-    } else {
-        if (is_cur) {
-            image_no = 7;
-        } else if (in_route) {
-            image_no = 8;
-        } else {
-            image_no = 6;
-        }
-    }
-
-    if (in_route) {
-        tree_ctrl->EnsureVisible(id);
-    }
-
-    tree_ctrl->SetItemImage(id, image_no);
-
-    if (node->children.empty()) {
-        return;
+    uint64_t serial = game.get_serial();
+
+    // 届くまでに木は変わるので、足された子と子の数はここで取っておく
+    std::shared_ptr<Node> child;
+    int n_children = 0;
+    if (ev == TreeEvent::ADDED && node && !node->children.empty()) {
+        child = node->children.back();
+        n_children = node->children.size();
     }
 
-    if (node->children.size() >= 2) {
-        int i = 0;
-        for (auto n : node->children) {
-            std::string s = "---- ";
-            s += 'A' + i;
-            s += " ----";
-            tree_ctrl->AppendItem(id, s);
+    CallAfter([this, serial, ev, node, child, n_children]() {
+        PROF_SCOPE("frame.on_tree");
+        TRACE_SCOPE("frame.on_tree");
 
-            create_tree_sub(g, id, n);
+        std::lock_guard<std::recursive_mutex> lock(model->lock());
 
-            i++;
+        // 棋譜が切り替わる前のイベントは捨てる。RESETがあとから来る
+        if (g.current().get_serial() != serial) {
+            return;
         }
 
-        return;
-    }
-
-    create_tree_sub(g, parent_id, *node->children.begin());
-}
-
-void MyFrame::on_tree(Game& g)
-{
-    tree_ctrl->DeleteChildren(root_id);
+        tree_model->on_tree(g.current(), ev, node, child, n_children);
 
-    create_tree_sub(g, root_id, g.get_root());
+        tree_view->EnsureVisible(tree_model->current_item());
+    });
 }
 
 void MyFrame::OnOpen(wxCommandEvent& event)
@@ -242,25 +232,220 @@ void MyFrame::SaveFileAs(wxCommandEvent& WXUNUSED(event))
     SaveDialog->Destroy();
 }
 
+bool MyFrame::open_pos_index(const std::string& file)
+{
+    std::unique_ptr<PosIndex> index(new PosIndex());
+
+    if (!index->open(file)) {
+        return false;
+    }
+
+    pos_index = std::move(index);
+
+    return true;
+}
+
+bool MyFrame::open_opening_trie(const std::string& file)
+{
+    std::unique_ptr<OpeningTrie> trie(new OpeningTrie());
+
+    if (!trie->open(file)) {
+        return false;
+    }
+
+    opening_trie = std::move(trie);
+
+    return true;
+}
+
+bool MyFrame::open_comment_index(const std::string& file)
+{
+    std::unique_ptr<CommentIndex> index(new CommentIndex());
+
+    if (!index->open(file)) {
+        return false;
+    }
+
+    comment_index = std::move(index);
+
+    return true;
+}
+
+#define MAX_POS_HITS (20)
+
+void MyFrame::find_position()
+{
+    TRACE_SCOPE("frame.find_position");
+
+    if (!pos_index) {
+        on_info("position: no index (--index FILE)");
+        return;
+    }
+
+    // 今の盤面はモデルのスレッドで引く
+    post([this](G& g) {
+        std::vector<PosHit> hits;
+
+        auto start = std::chrono::steady_clock::now();
+        size_t n = pos_index->lookup(g.board, hits, MAX_POS_HITS);
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+        std::string s;
+        for (auto& hit : hits) {
+            s += hit.file + " #" + std::to_string(hit.game + 1) + " " + std::to_string(hit.move) + "\n";
+        }
+        if (n > hits.size()) {
+            s += "...\n";
+        }
+
+        on_comment(s);
+
+        char buf[64];
+        snprintf(buf, sizeof(buf), "position: %zu hits (%.2f ms)", n, ms);
+        on_info(buf);
+    });
+}
+
+#define MAX_COMMENT_HITS (200)
+
+void MyFrame::search_comments()
+{
+    TRACE_SCOPE("frame.search_comments");
+
+    if (!comment_index) {
+        on_info("comments: no index (--comments FILE)");
+        return;
+    }
+
+    wxString query = wxGetTextFromUser("Words in comments", "Search comments", last_query, this);
+    if (query.IsEmpty()) {
+        return;
+    }
+    last_query = query;
+
+    std::vector<CommentHit> hits;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t n = comment_index->search(std::string(query.utf8_str()), hits, MAX_COMMENT_HITS);
+    auto end = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "comments: %zu hits (%.2f ms)", n, ms);
+    on_info(buf);
+
+    if (hits.empty()) {
+        return;
+    }
+
+    wxArrayString choices;
+    for (auto& hit : hits) {
+        std::string file = hit.file.substr(hit.file.rfind('/') + 1);
+        std::string text = hit.text.substr(0, hit.text.find('\n'));
+        if (text.size() > 60) {
+            text = text.substr(0, 60) + "...";
+        }
+
+        choices.Add(wxString::FromUTF8(file + " #" + std::to_string(hit.game + 1) + ": " + text));
+    }
+
+    int i = wxGetSingleChoiceIndex(buf, "Search comments", choices, this);
+    if (i < 0) {
+        return;
+    }
+
+    open_comment_hit(hits[i]);
+}
+
+void MyFrame::open_comment_hit(const CommentHit& hit)
+{
+    TRACE_SCOPE("frame.open_comment_hit");
+
+    post([this, hit](G& g) {
+        // 読み込んでいないファイルなら足す。今の棋譜は編集中かもしれないので消さない
+        if (g.find_game(hit.file, hit.game) == -1) {
+            if (!g.load(Gmode::ANSWER, hit.file, true)) {
+                on_info("comments: couldn't open " + hit.file);
+                return;
+            }
+            watch_file(hit.file);
+        }
+
+        if (!g.jump(hit.file, hit.game, hit.path)) {
+            on_info("comments: not found the node in " + hit.file);
+        }
+    });
+}
+
+bool MyFrame::start_watching()
+{
+    std::unique_ptr<FileWatcher> watcher(new FileWatcher(
+        [this](const std::string& file, std::vector<std::shared_ptr<Node>>& trees) {
+            // 見張りのスレッドから呼ばれる。モデルへ送れるのはUIのスレッドだけ
+            CallAfter([this, file, trees]() { reload_file(file, trees); });
+        }));
+
+    if (!watcher->start()) {
+        return false;
+    }
+
+    file_watcher = std::move(watcher);
+
+    return true;
+}
+
+void MyFrame::watch_file(const std::string& file)
+{
+    if (file_watcher) {
+        file_watcher->add(file);
+    }
+}
+
+void MyFrame::reload_file(const std::string& file, const std::vector<std::shared_ptr<Node>>& trees)
+{
+    TRACE_SCOPE("frame.reload_file");
+
+    post([this, file, trees](G& g) {
+        if (g.reload(file, trees) > 0) {
+            on_info("reloaded: " + file);
+        }
+    });
+}
+
+// on_comment()、on_pos()、on_info()はモデルのスレッドからも呼ばれるので、UIのスレッドで表示する
 void MyFrame::on_comment(std::string comment)
 {
-    s_comment_ctrl->SetLabel(wxString::FromUTF8(comment));
+    CallAfter([this, comment]() {
+        TRACE_SCOPE("frame.on_comment");
+
+        s_comment_ctrl->SetLabel(wxString::FromUTF8(comment));
+    });
 }
 
 void MyFrame::on_pos(std::string pos)
 {
-    pos_ctrl->SetLabel(pos);
+    CallAfter([this, pos]() {
+        TRACE_SCOPE("frame.on_pos");
+
+        pos_ctrl->SetLabel(pos);
+    });
 }
 
-void MyFrame::on_wrong(std::string sgf)
+void MyFrame::on_wrong(size_t problem, std::string sgf)
 {
-    if (wrong != "") {
-        std::ofstream ofs(wrong, std::ios::app);
-        ofs << sgf << std::endl;
+    TRACE_SCOPE("frame.on_wrong");
+
+    if (wrong_log) {
+        wrong_log->push(problem, sgf);
     }
 }
 
 void MyFrame::on_info(std::string info)
 {
-    SetStatusText(wxString::FromUTF8(info));
+    CallAfter([this, info]() {
+        TRACE_SCOPE("frame.on_info");
+
+        SetStatusText(wxString::FromUTF8(info));
+    });
 }
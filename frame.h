@@ -7,6 +7,15 @@
 #endif
 
 #include "g.h"
+#include "wrong_log.h"
+#include "pos_index.h"
+#include "opening_trie.h"
+#include "comment_index.h"
+#include "file_watcher.h"
+#include "model_thread.h"
+#include "prefetcher.h"
+
+class BoardWindow;
 
 enum
 {
@@ -22,16 +31,57 @@ class MyFrame : public wxFrame, public GEventListener
 {
     G& g;
     std::string wrong;
+    std::unique_ptr<WrongLog> wrong_log;
+    BoardWindow* board_window = nullptr;
+    std::unique_ptr<PosIndex> pos_index;
+    std::unique_ptr<OpeningTrie> opening_trie;
+    std::unique_ptr<CommentIndex> comment_index;
+    wxString last_query;
+
+    // 次の問題のファイルを先に読む。モデルが使うので、モデルよりあとに消す
+    std::unique_ptr<Prefetcher> prefetcher;
+
+    // Gに触るのはこのスレッドだけ。盤はスナップショットで受け取って描く
+    std::unique_ptr<ModelThread> model;
+    std::atomic<bool> snapshot_pending;
+
+    // モデルより先に止める
+    std::unique_ptr<FileWatcher> file_watcher;
+
+    void reload_file(const std::string& file, const std::vector<std::shared_ptr<Node>>& trees);
 public:
     MyFrame(G& g, std::string wrong);
+    ~MyFrame();
 
     std::string get_text();
+    BoardWindow* get_board_window() { return board_window; };
+
+    // 読み込みなどが済んだら呼ぶ。それからはGへの操作はpost()で送る
+    void start_model();
+    void post(ModelCommand cmd) { model->post(cmd); };
+    uint64_t n_posted() { return model->n_posted(); };
+
+    // 局面の索引。find_position()で今の盤面が現れた棋譜を表示する
+    bool open_pos_index(const std::string& file);
+    void find_position();
+
+    // 定石・布石の木。盤に次の手の頻度を描く
+    bool open_opening_trie(const std::string& file);
+
+    // コメントの全文索引。search_comments()で探して、選んだノードへ移る
+    bool open_comment_index(const std::string& file);
+    void search_comments();
+    void open_comment_hit(const CommentHit& hit);
+
+    // 読み込んだファイルを見張り、外で書き換えられたら読み直して差し替える
+    bool start_watching();
+    void watch_file(const std::string& file);
 
     virtual void on_comment(std::string comment);
     virtual void on_pos(std::string pos);
-    virtual void on_wrong(std::string sgf);
+    virtual void on_wrong(size_t problem, std::string sgf);
     virtual void on_info(std::string info);
-    virtual void on_tree(Game& g);
+    virtual void on_tree(Game& g, TreeEvent ev, std::shared_ptr<Node> node);
 private:
     void create_controls();
 
@@ -1,10 +1,18 @@
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
 #include <random>
 #include <sstream>
 #include "g.h"
 #include "gio.h"
 #include "command.h"
+#include "prefetcher.h"
+#include "prof.h"
+#include "replay.h"
+#include "trace.h"
 
 Route::Route(std::shared_ptr<Node> root)
 {
@@ -158,6 +166,9 @@ bool Route::redo(G& g)
 
 void Route::redo_history(G& g)
 {
+    PROF_SCOPE("route.redo_history");
+    PROF_COUNT("route.redo_nodes", m_idx + 1);
+
     for (int i = 0; i <= m_idx; i++) {
         std::shared_ptr<Node> node = m_route[i];
         node->redo(g);
@@ -183,8 +194,11 @@ std::ostream& operator<<(std::ostream& os, const Route& obj)
 
 #define DEFAULT_BOARD_SIZE (13)
 
+// 別々のGを別々のスレッドで使うこともあるのでatomicにする
+static std::atomic<uint64_t> game_serial(0);
+
 Game::Game(G& g, Gmode mode, std::shared_ptr<Node> root, int size)
-    : g(g), mode(mode), root(root), route(root), size(size)
+    : g(g), mode(mode), root(root), route(root), size(size), m_serial(++game_serial)
 {
 }
 
@@ -244,6 +258,8 @@ void Game::set_wrong_mark()
 
 void Game::setup()
 {
+    PROF_SCOPE("game.setup");
+
     if (mode == Gmode::SOLVE) {
         set_correct_path();
         set_wrong_mark();
@@ -297,6 +313,50 @@ std::string Game::get_sgf()
 }
 
 
+// 問題の初期配置（rootのプロパティ）から求めたハッシュ。同じ問題かどうかの判定に使う
+size_t Game::problem_hash()
+{
+    std::string s;
+
+    for (auto& p : root->properties) {
+        s += p->to_sgf();
+    }
+
+    return std::hash<std::string>()(s);
+}
+
+// 木全体ではなく、rootから間違えた手までの一本道だけをSGFにする
+std::string Game::get_wrong_sgf(Property& wrong)
+{
+    std::string s = "(";
+    bool has_wrong = false;
+
+    const std::vector<std::shared_ptr<Node>>& nodes = route.get_nodes();
+    for (int i = 0; i <= route.get_idx(); i++) {
+        s += ";";
+
+        for (auto& p : nodes[i]->properties) {
+            s += p->to_sgf();
+
+            if (p.get() == &wrong) {
+                has_wrong = true;
+            }
+        }
+    }
+
+    // 間違えた手のノードがまだrouteに入っていないとき
+    if (!has_wrong) {
+        Point pt = wrong.point();
+        s += (my_stone == CELL_WHITE) ? ";W[" : ";B[";
+        s += SGFPoint::point_to_val(pt.x, pt.y);
+        s += "]";
+    }
+
+    s += ")";
+
+    return s;
+}
+
 bool Game::set_my_stone()
 {
     my_stone = CELL_SPACE;
@@ -392,10 +452,15 @@ bool Game::do_put_stone(int cell, int x, int y, bool is_move, bool is_wrong)
         set_auto_increment(g.board.get_kifu().size() - 1);
     }
 
-    remove_no_use_history();
+    std::shared_ptr<Node> parent = route.current();
+    bool removed = remove_no_use_history();
     route.append(node);
 
-    g.dispatch_tree_event();
+    if (removed) {
+        g.dispatch_tree_event(TreeEvent::REMOVED, parent);
+    } else {
+        g.dispatch_tree_event(TreeEvent::ADDED, parent);
+    }
     g.dispatch_info_event();
 
     return true;
@@ -423,7 +488,7 @@ bool Game::place_stone(int cell, int x, int y)
 
     g.board.set_cell(cell, x, y);
 
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::CHANGED, cur);
 
     return true;
 }
@@ -464,7 +529,8 @@ bool Game::do_make_solve_move(int cell, int x, int y)
         return do_put_stone(cell, x, y, true, true);
     }
 
-    remove_no_use_history();
+    std::shared_ptr<Node> parent = cur;
+    bool removed = remove_no_use_history();
     next->exec(g);
     route.select(next);
 
@@ -486,24 +552,32 @@ bool Game::do_make_solve_move(int cell, int x, int y)
         }
     }
 
-    g.dispatch_tree_event();
+    if (removed) {
+        g.dispatch_tree_event(TreeEvent::REMOVED, parent);
+    } else {
+        g.dispatch_tree_event(TreeEvent::MOVED);
+    }
     g.dispatch_info_event();
 
     return true;
 }
 
-void Game::remove_no_use_history()
+// 子を削除したらtrueを返す
+bool Game::remove_no_use_history()
 {
     std::shared_ptr<Node> cur = route.current();
+    bool removed = false;
 
     // routeから辿れるnodeの中でいらないものを削除
     if (mode == Gmode::CREATE || mode == Gmode::SOLVE) {
         std::shared_ptr<Node> next = route.next();
-        cur->remove_child(next);
+        removed = cur->remove_child(next);
     }
 
     // routeからいらないものを削除
     route.remove_nodes_after_cur();
+
+    return removed;
 }
 
 bool Game::put_stone(int cell, int x, int y)
@@ -543,7 +617,7 @@ bool Game::put_stone(int cell, int x, int y)
                 if (p->pid() == pid && p->point() == pt) {
                     route.select(n);
                     n->exec(g);
-                    g.dispatch_tree_event();
+                    g.dispatch_tree_event(TreeEvent::MOVED);
                     g.dispatch_info_event();
 
                     if (mode == Gmode::KIFU) {
@@ -582,7 +656,7 @@ bool Game::do_set_markup(std::string id, int x, int y, std::string label)
     std::shared_ptr<Node> cur = route.current();
     cur->merge_property(id, x, y, label);
 
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::CHANGED, cur);
 
     return true;
 }
@@ -629,7 +703,7 @@ bool Game::set_label(std::string s, int x, int y)
 
     result = do_set_markup(ID_LB, x, y, s);
 
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::CHANGED, route.current());
 
     return result;
 }
@@ -647,7 +721,7 @@ void Game::add_comment(std::string s)
 
     cur->properties.push_back(create_property(ID_C, s));
 
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::CHANGED, cur);
 
 }
 
@@ -655,10 +729,10 @@ void Game::remove_comment()
 {
     std::shared_ptr<Node> cur = route.current();
     cur->remove_property(PID::C);
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::CHANGED, cur);
 }
 
-void Game::save_node(std::ofstream& ofs, std::shared_ptr<Node> node, int depth)
+void Game::save_node(std::ostream& ofs, std::shared_ptr<Node> node, int depth)
 {
     if (depth == 0) {
         ofs << *node << std::endl;
@@ -688,6 +762,14 @@ void Game::save_node(std::ofstream& ofs, std::shared_ptr<Node> node, int depth)
     }
 }
 
+// ファイルに保存するときと同じ形式でSGFを書き出す
+void Game::write_sgf(std::ostream& os)
+{
+    os << "(";
+    save_node(os, root, 0);
+    os << ")" << std::endl;
+}
+
 std::string Game::get_filename()
 {
     time_t t = time(nullptr);
@@ -719,15 +801,14 @@ bool Game::save()
     std::string filename = get_filename();
     std::ofstream ofs(filename);
 
-    (*root->children.begin())->properties.sort(comp);
+    std::shared_ptr<Node> first = *root->children.begin();
+    first->properties.sort(comp);
 
-    ofs << "(";
-    save_node(ofs, root, 0);
-    ofs << ")" << std::endl;
+    write_sgf(ofs);
 
     std::cout << filename << std::endl;
 
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::CHANGED, first);
 
     return true;
 }
@@ -764,7 +845,7 @@ bool Game::undo()
         }
     }
 
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::MOVED);
     g.dispatch_info_event();
 
     return true;
@@ -782,7 +863,7 @@ bool Game::redo_kifu()
 
     next->exec(g);
     route.select(next);
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::MOVED);
     g.dispatch_info_event();
 
     return true;
@@ -827,7 +908,7 @@ bool Game::redo()
         }
     }
 
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::MOVED);
     g.dispatch_info_event();
 
     return true;
@@ -849,6 +930,8 @@ bool Game::change_to_answer_mode()
     route.set_min_undo();
     mode = Gmode::ANSWER;
 
+    g.dispatch_tree_event(TreeEvent::REMOVED, cur);
+
     return true;
 }
 
@@ -896,10 +979,67 @@ void Game::move_to_answer()
         }
     }
 
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::MOVED);
     g.dispatch_info_event();
 }
 
+bool Game::jump(const std::vector<int>& path)
+{
+    while (route.can_undo()) {
+        route.undo(g);
+    }
+
+    // undoできないところ（問題の最初の局面）までは今の手順と同じでないといけない。
+    // pathがそれより短ければ最初の局面にする
+    const std::vector<std::shared_ptr<Node>>& nodes = route.get_nodes();
+    int min_idx = route.get_idx();
+    std::shared_ptr<Node> node = root;
+    bool found = true;
+
+    for (int i = 0; i < (int) path.size(); i++) {
+        if (path[i] < 0 || path[i] >= (int) node->children.size()) {
+            found = false;
+            break;
+        }
+
+        auto itr = node->children.begin();
+        std::advance(itr, path[i]);
+        node = *itr;
+
+        if (i < min_idx) {
+            if (nodes[i + 1] != node) {
+                found = false;
+                break;
+            }
+        } else if (route.next() == node) {
+            route.redo(g);
+        } else {
+            node->exec(g);
+            route.select(node);
+        }
+    }
+
+    g.dispatch_tree_event(TreeEvent::MOVED);
+    g.dispatch_info_event();
+    g.dispatch_comment_event();
+
+    return found;
+}
+
+std::vector<int> Game::get_path()
+{
+    std::vector<int> path;
+    const std::vector<std::shared_ptr<Node>>& nodes = route.get_nodes();
+
+    for (int i = 1; i <= route.get_idx(); i++) {
+        auto& children = nodes[i - 1]->children;
+        auto itr = std::find(children.begin(), children.end(), nodes[i]);
+        path.push_back(std::distance(children.begin(), itr));
+    }
+
+    return path;
+}
+
 std::list<Label> Game::get_numbers()
 {
     std::list<Label> labels;
@@ -954,7 +1094,7 @@ bool Game::toggle_correct()
             cur->remove_property(PID::N);
             (*itr)->undo(g);
             itr = cur->properties.erase(itr);
-            g.dispatch_tree_event();
+            g.dispatch_tree_event(TreeEvent::CHANGED, cur);
             return true;
         }
 
@@ -969,7 +1109,7 @@ bool Game::toggle_correct()
     auto p = create_property(ID_CORRECT, pt.x, pt.y);
     p->exec(g);
     cur->properties.push_back(p);
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::CHANGED, cur);
     return true;
 }
 
@@ -984,6 +1124,9 @@ bool Game::delete_node()
         return false;
     }
 
+    // 子が変わるノード
+    std::shared_ptr<Node> parent = cur;
+
     if (!cur->has(PID::B) && !cur->has(PID::W)) {
         if (cur->children.empty()) {
             return false;
@@ -992,7 +1135,7 @@ bool Game::delete_node()
         cur->children.clear();
     } else {
         route.visit_parent();
-        std::shared_ptr<Node> parent = route.current();
+        parent = route.current();
 
         bool result = parent->remove_child(cur);
         if (result == false) {
@@ -1004,7 +1147,7 @@ bool Game::delete_node()
 
     route.remove_nodes_after_cur();
 
-    g.dispatch_tree_event();
+    g.dispatch_tree_event(TreeEvent::REMOVED, parent);
     g.dispatch_info_event();
 
     if (mode == Gmode::KIFU && is_auto_increment() && incre_start == (int)g.board.get_kifu().size()) {
@@ -1198,12 +1341,31 @@ bool G::delete_game()
 
 Game& G::current()
 {
+    while (!games[games_i]->is_loaded()) {
+        fill_lazy(games_i);
+    }
+
     return *games[games_i];
 }
 
 std::list<Game*> G::get_games()
 {
     std::list<Game*> lst;
+    bool is_filled = false;
+
+    for (size_t i = 0; i < games.size(); ) {
+        if (games[i]->is_loaded()) {
+            i++;
+        } else {
+            fill_lazy(i);
+            is_filled = true;
+        }
+    }
+
+    // setup()で盤を使ったので、今の棋譜の局面に戻す
+    if (is_filled) {
+        current().get_route().redo_history(*this);
+    }
 
     for (auto& g : games) {
         lst.push_back(g.get());
@@ -1221,6 +1383,20 @@ bool G::load(Gmode mode, const std::string& filename, bool is_append)
         return false;
     }
 
+    return load_stream(mode, ifs, is_append, filename);
+}
+
+// ファイル以外（標準入力や文字列）から読み込む
+bool G::load(Gmode mode, std::istream& is, bool is_append)
+{
+    return load_stream(mode, is, is_append, "-");
+}
+
+bool G::load_stream(Gmode mode, std::istream& is, bool is_append, const std::string& name)
+{
+    PROF_SCOPE("g.load");
+    TRACE_SCOPE("g.load");
+
     std::vector<std::shared_ptr<Node>> bk_games;
     for (auto n : root->children) {
         bk_games.push_back(n);
@@ -1236,11 +1412,11 @@ bool G::load(Gmode mode, const std::string& filename, bool is_append)
     do {
         num++;
 
-        Token t = get_token(ifs);
+        Token t = get_token(is);
 
         if (t != Token::L_PAREN) {
             if (num == 0) {
-                std::cerr << "Error: not found '('. file = " << filename << std::endl;
+                std::cerr << "Error: not found '('. file = " << name << std::endl;
                 root->children.clear();
                 for (auto n : bk_games) {
                     root->children.push_back(n);
@@ -1249,7 +1425,7 @@ bool G::load(Gmode mode, const std::string& filename, bool is_append)
             }
             break;
         }
-    } while (load_node(route, ifs));
+    } while (load_node(route, is));
 
     auto itr = root->children.begin();
 
@@ -1261,23 +1437,10 @@ bool G::load(Gmode mode, const std::string& filename, bool is_append)
         games.clear();
     }
 
-    for (; itr != root->children.end(); itr++) {
-        auto n = *itr;
+    int file_game = 0;
 
-        int size = 13;
-        for (auto p : n->properties) {
-            if (p->pid() == PID::SZ) {
-                p->int_val(&size);
-                break;
-            }
-        }
-
-        std::unique_ptr<Game> game(new Game(*this, mode, n, size));
-        if (mode == Gmode::SOLVE) {
-            game->set_rand_trans();
-            game->set_auto_increment(0);
-        }
-        games.push_back(std::move(game));
+    for (; itr != root->children.end(); itr++, file_game++) {
+        games.push_back(make_game(mode, *itr, name, file_game));
         games_i = games.size() - 1;
         current().setup();
     }
@@ -1297,6 +1460,187 @@ bool G::load(Gmode mode, const std::string& filename, bool is_append)
     return true;
 }
 
+std::unique_ptr<Game> G::make_game(Gmode mode, std::shared_ptr<Node> node, const std::string& file, int file_game)
+{
+    int size = 13;
+    for (auto p : node->properties) {
+        if (p->pid() == PID::SZ) {
+            p->int_val(&size);
+            break;
+        }
+    }
+
+    std::unique_ptr<Game> game(new Game(*this, mode, node, size));
+    game->file = file;
+    game->file_game = file_game;
+    if (mode == Gmode::SOLVE) {
+        game->set_rand_trans();
+        game->set_auto_increment(0);
+    }
+
+    return game;
+}
+
+bool G::load_lazy(Gmode mode, const std::vector<std::pair<std::string, int>>& queue, bool is_append)
+{
+    PROF_SCOPE("g.load_lazy");
+
+    if (queue.empty()) {
+        return false;
+    }
+
+    if (!is_append) {
+        root->children.clear();
+        games.clear();
+    }
+
+    // rootのない仮のGame。fill_lazy()で置き換える
+    for (auto& q : queue) {
+        std::unique_ptr<Game> game(new Game(*this, mode, nullptr, 0));
+        game->file = q.first;
+        game->file_game = q.second;
+        games.push_back(std::move(game));
+    }
+
+    games_i = 0;
+    current().get_route().redo_history(*this);
+
+    dispatch_pos_event();
+    dispatch_tree_event();
+
+    return true;
+}
+
+// games[i]のファイルを読み、同じファイルのまだ読んでいない棋譜をまとめて作る。
+// 読めなかった棋譜は除く（最後の1つなら空の棋譜にする）
+void G::fill_lazy(size_t i)
+{
+    PROF_SCOPE("g.fill_lazy");
+    TRACE_SCOPE("g.fill_lazy");
+
+    std::vector<std::shared_ptr<Node>> trees;
+
+    if (!m_prefetcher || !m_prefetcher->take(games[i]->file, trees)) {
+        load_trees(games[i]->file, trees);
+    }
+
+    fill_lazy(i, trees);
+}
+
+void G::fill_lazy(size_t i, const std::vector<std::shared_ptr<Node>>& trees)
+{
+    std::string file = games[i]->file;
+
+    int bk_games_i = games_i;
+
+    for (size_t j = 0; j < games.size(); ) {
+        Game& lazy = *games[j];
+
+        if (lazy.is_loaded() || lazy.file != file) {
+            j++;
+            continue;
+        }
+
+        if (lazy.file_game < 0 || lazy.file_game >= (int) trees.size()) {
+            std::cerr << "Error: not found game: " << file << ": " << lazy.file_game + 1 << std::endl;
+
+            if (games.size() == 1) {
+                games.clear();
+                new_game(DEFAULT_BOARD_SIZE);
+                return;
+            }
+
+            games.erase(games.begin() + j);
+            if (bk_games_i > (int) j || bk_games_i == (int) games.size()) {
+                bk_games_i--;
+            }
+            continue;
+        }
+
+        auto n = trees[lazy.file_game];
+        root->children.push_back(n);
+
+        games[j] = make_game(lazy.get_mode(), n, file, lazy.file_game);
+        games_i = j;
+
+        // 今の棋譜でないものをsetup()している間は、表示を変えないように知らせない
+        m_is_quiet = (int) j != bk_games_i;
+        current().setup();
+        m_is_quiet = false;
+
+        j++;
+    }
+
+    games_i = bk_games_i;
+}
+
+int G::reload(const std::string& file, const std::vector<std::shared_ptr<Node>>& trees)
+{
+    PROF_SCOPE("g.reload");
+    TRACE_SCOPE("g.reload");
+
+    int n = 0;
+    bool is_current = false;
+
+    for (size_t j = 0; j < games.size(); j++) {
+        Game& old = *games[j];
+
+        // 読み込む前のものは、読むときに新しい中身になる
+        if (old.file != file || !old.is_loaded()) {
+            continue;
+        }
+        if (old.get_mode() != Gmode::SOLVE && old.get_mode() != Gmode::KIFU) {
+            continue;
+        }
+        if (old.file_game >= (int) trees.size()) {
+            continue;
+        }
+
+        auto itr = std::find(root->children.begin(), root->children.end(), old.get_root());
+
+        if ((int) j != games_i) {
+            if (itr != root->children.end()) {
+                root->children.erase(itr);
+            }
+
+            std::unique_ptr<Game> lazy(new Game(*this, old.get_mode(), nullptr, 0));
+            lazy->file = file;
+            lazy->file_game = old.file_game;
+            games[j] = std::move(lazy);
+            n++;
+            continue;
+        }
+
+        auto node = trees[old.file_game];
+        if (itr != root->children.end()) {
+            *itr = node;
+        } else {
+            root->children.push_back(node);
+        }
+
+        std::vector<int> path = old.get_path();
+        std::unique_ptr<Game> game = make_game(old.get_mode(), node, file, old.file_game);
+
+        // 解いている途中で盤の向きが変わらないように
+        game->mirror_n = old.mirror_n;
+        game->rotate_n = old.rotate_n;
+        game->flip_n = old.flip_n;
+        game->is_wrong = old.is_wrong;
+
+        games[j] = std::move(game);
+        current().setup();
+        current().jump(path);
+        is_current = true;
+        n++;
+    }
+
+    if (is_current) {
+        update_game();
+    }
+
+    return n;
+}
+
 void G::shuffle()
 {
     std::random_device rd;
@@ -1315,6 +1659,12 @@ std::string G::get_pos()
 
 void G::dispatch_pos_event()
 {
+    TRACE_SCOPE("g.dispatch_pos_event");
+
+    if (m_is_quiet) {
+        return;
+    }
+
     std::string s = get_pos();
 
     for (auto lsn : m_listeners) {
@@ -1346,6 +1696,12 @@ std::string G::get_info()
 
 void G::dispatch_info_event()
 {
+    TRACE_SCOPE("g.dispatch_info_event");
+
+    if (m_is_quiet) {
+        return;
+    }
+
     std::string s = get_info();
 
     for (auto lsn : m_listeners) {
@@ -1353,9 +1709,11 @@ void G::dispatch_info_event()
     }
 }
 
-void G::dispatch_tree_event()
+void G::dispatch_tree_event(TreeEvent ev, std::shared_ptr<Node> node)
 {
-    if (games.empty()) {
+    TRACE_SCOPE("g.dispatch_tree_event");
+
+    if (games.empty() || m_is_quiet) {
         return;
     }
 
@@ -1366,12 +1724,18 @@ void G::dispatch_tree_event()
     }
 
     for (auto lsn : m_listeners) {
-        lsn->on_tree(current());
+        lsn->on_tree(game, ev, node);
     }
 }
 
 void G::dispatch_comment_event()
 {
+    TRACE_SCOPE("g.dispatch_comment_event");
+
+    if (m_is_quiet) {
+        return;
+    }
+
     std::string s = get_comment();
 
     for (auto lsn : m_listeners) {
@@ -1405,6 +1769,114 @@ bool G::next_game()
     return true;
 }
 
+void G::prefetch(int n)
+{
+    if (!m_prefetcher) {
+        return;
+    }
+
+    PROF_SCOPE("g.prefetch");
+
+    size_t n_games = games.size();
+    bool is_filled = false;
+
+    for (int k = 1; k <= n && games_i + k < (int) games.size(); ) {
+        size_t i = games_i + k;
+
+        if (games[i]->is_loaded()) {
+            k++;
+            continue;
+        }
+
+        std::vector<std::shared_ptr<Node>> trees;
+
+        if (!m_prefetcher->take(games[i]->file, trees)) {
+            m_prefetcher->request(games[i]->file);
+            k++;
+            continue;
+        }
+
+        // 読めなかった棋譜は除かれて詰まるので、同じkをもう一度見る
+        fill_lazy(i, trees);
+        is_filled = true;
+    }
+
+    if (!is_filled) {
+        return;
+    }
+
+    // setup()で盤を使ったので、今の棋譜の局面に戻す
+    current().get_route().redo_history(*this);
+
+    if (games.size() != n_games) {
+        dispatch_pos_event();
+    }
+}
+
+static std::string base_name(const std::string& file)
+{
+    size_t slash = file.rfind('/');
+    return (slash == std::string::npos) ? file : file.substr(slash + 1);
+}
+
+// 辿れなければそのまま返す
+static std::string canonical_path(const std::string& file)
+{
+    char buf[PATH_MAX];
+
+    if (realpath(file.c_str(), buf) == nullptr) {
+        return file;
+    }
+
+    return buf;
+}
+
+int G::find_game(const std::string& file, int game)
+{
+    for (size_t i = 0; i < games.size(); i++) {
+        if (games[i]->file == file && games[i]->file_game == game) {
+            return i;
+        }
+    }
+
+    // 同じファイルを別の書き方（相対パスなど）で開いているかもしれない。
+    // realpath()は重いので、ファイル名が同じものだけ比べる
+    std::string base = base_name(file);
+    std::string path;
+
+    for (size_t i = 0; i < games.size(); i++) {
+        if (games[i]->file_game != game || base_name(games[i]->file) != base) {
+            continue;
+        }
+
+        if (path == "") {
+            path = canonical_path(file);
+        }
+
+        if (canonical_path(games[i]->file) == path) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+bool G::jump(const std::string& file, int game, const std::vector<int>& path)
+{
+    int i = find_game(file, game);
+
+    if (i == -1) {
+        return false;
+    }
+
+    if (i != games_i) {
+        games_i = i;
+        update_game();
+    }
+
+    return current().jump(path);
+}
+
 // ゲームを切り替えたときに呼ぶ。
 void G::update_game()
 {
@@ -1439,8 +1911,10 @@ void G::on_exec(Property& prop)
     if (prop.pid() == PID::WRONG && !game.is_wrong) {
         game.is_wrong = true;
 
+        TRACE_SCOPE("g.dispatch_wrong_event");
+
         for (auto lsn : m_listeners) {
-            lsn->on_wrong(game.get_sgf());
+            lsn->on_wrong(game.problem_hash(), game.get_wrong_sgf(prop));
         }
     }
 }
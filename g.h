@@ -1,14 +1,17 @@
 #ifndef G_H
 #define G_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #include "board.h"
 #include "node.h"
 
 class Node;
 class Property;
+class Prefetcher;
 
 enum class Gmode {
     CREATE,
@@ -29,6 +32,15 @@ struct Label
 
 using ListenerPtr = void (*)(std::string);
 
+// 木の変更の種類。リスナーはこれを見て差分だけ反映する
+enum class TreeEvent {
+    RESET,    // 木全体が変わった（ゲームの切り替え等）
+    ADDED,    // nodeの最後に子が追加された
+    REMOVED,  // nodeの子が削除された（または並びが変わった）
+    CHANGED,  // nodeのプロパティが変わった
+    MOVED,    // 現在位置やrouteが変わった
+};
+
 class G;
 
 // 辿った木を記録。履歴の管理に使用
@@ -46,6 +58,8 @@ public:
     void visit_min_undo();
     bool has_min_undo_children();
     bool exists(std::shared_ptr<Node> node);
+    const std::vector<std::shared_ptr<Node>>& get_nodes() const { return m_route; };
+    int get_idx() const { return m_idx; };
     void set_min_undo();
     void clear_min_undo();
     int remove_nodes_after_cur();
@@ -68,6 +82,7 @@ class Game
     std::shared_ptr<Node> root;
     Route route;
     int size;
+    uint64_t m_serial;
     std::string m_comment = "";
 
     int my_stone = 0;
@@ -79,12 +94,12 @@ class Game
     bool do_set_markup(std::string id, int x, int y, std::string label="");
     std::shared_ptr<Node> search_next_node(int cell, int x, int y);
 
-    void remove_no_use_history();
+    bool remove_no_use_history();
     bool set_my_stone();
     void set_correct_path();
     void set_wrong_mark();
 
-    void save_node(std::ofstream& ofs, std::shared_ptr<Node> node, int depth);
+    void save_node(std::ostream& ofs, std::shared_ptr<Node> node, int depth);
     std::string get_filename();
 public:
     Game(G& g, Gmode mode, std::shared_ptr<Node> root, int size);
@@ -92,12 +107,19 @@ public:
     void setup();
 
     Gmode get_mode() { return mode; };
+    // Gameごとに違う番号。消したGameのアドレスは使い回されるので、同じGameかはこれで比べる
+    uint64_t get_serial() const { return m_serial; };
     std::shared_ptr<Node> get_root() { return root; };
+    // G::load_lazy()で並べただけで、まだ読み込んでいなければfalse
+    bool is_loaded() { return root != nullptr; };
     Route& get_route() { return route; };
     int get_my_stone() { return my_stone; };
     std::string get_sgf();
+    std::string get_wrong_sgf(Property& wrong);
+    size_t problem_hash();
+    void write_sgf(std::ostream& os);
     std::string comment() { return m_comment; };
-    std::string set_comment(std::string s) { m_comment = s; return m_comment; };
+    std::string set_comment(std::string s) { std::swap(m_comment, s); return s; };
 
     void print_nodes();
     void print_route();
@@ -145,6 +167,15 @@ public:
 
     std::string player_black = "";
     std::string player_white = "";
+
+    // 読み込んだファイルと、ファイル内で何番目の棋譜か（0から）
+    std::string file = "";
+    int file_game = -1;
+
+    // 棋譜のrootからpathの順に子をたどったノードへ移る
+    bool jump(const std::vector<int>& path);
+    // 今のノードまでのpath。jump()の逆
+    std::vector<int> get_path();
 };
 
 class GEventListener
@@ -152,9 +183,9 @@ class GEventListener
 public:
     virtual void on_comment(std::string comment) = 0;
     virtual void on_pos(std::string pos) = 0;
-    virtual void on_wrong(std::string sgf) = 0;
+    virtual void on_wrong(size_t problem, std::string sgf) = 0;
     virtual void on_info(std::string info) = 0;
-    virtual void on_tree(Game& g) = 0;
+    virtual void on_tree(Game& g, TreeEvent ev, std::shared_ptr<Node> node) = 0;
 };
 
 class G
@@ -165,14 +196,22 @@ class G
     int games_i;
 
     std::vector<GEventListener*> m_listeners;
+    Prefetcher* m_prefetcher = nullptr;
+    bool m_is_quiet = false;  // trueの間はdispatch_*()で知らせない
     void dispatch_pos_event();
     void update_game();
+    bool load_stream(Gmode mode, std::istream& is, bool is_append, const std::string& name);
+    std::unique_ptr<Game> make_game(Gmode mode, std::shared_ptr<Node> node, const std::string& file, int file_game);
+    void fill_lazy(size_t i);
+    void fill_lazy(size_t i, const std::vector<std::shared_ptr<Node>>& trees);
 public:
     Board board;
 
     G();
 
     Game& current();
+    // G::load_lazy()で並べただけの棋譜も、すべて読み込んでsetup()する。
+    // ディレクトリ全体を読むことになるので、表示のためには使わない
     std::list<Game*> get_games();
 
     std::shared_ptr<Node> get_root() { return root; };
@@ -181,17 +220,38 @@ public:
     bool delete_game();
 
     bool load(Gmode mode, const std::string& filename, bool is_append=false);
+    bool load(Gmode mode, std::istream& is, bool is_append=false);
+    // queueの（ファイル名, 何番目か）の棋譜を、読み込まずにその順で並べる。
+    // 棋譜はcurrent()になったときにファイルごとまとめて読む
+    bool load_lazy(Gmode mode, const std::vector<std::pair<std::string, int>>& queue, bool is_append=false);
 
     bool prev_game();
     bool next_game();
 
+    // 読み込む前の棋譜を開くときは、先に読んであればそれを使う
+    void set_prefetcher(Prefetcher* prefetcher) { m_prefetcher = prefetcher; };
+    // 今の棋譜のあとn個の、読み込む前の棋譜を用意する。
+    // 先に読み終わっていればsetup()まで済ませておき、まだなら読むように頼む
+    void prefetch(int n);
+
+    // fileのgame番目の棋譜がgamesの何番目か。読み込んでいなければ-1。
+    // 名前が違っても、realpath()で同じファイルなら同じとみなす
+    int find_game(const std::string& file, int game);
+    // fileのgame番目の棋譜の、pathのノードへ移る。その棋譜を読み込んでいなければfalse
+    bool jump(const std::string& file, int game, const std::vector<int>& path);
+
+    // fileを読み直した木に差し替える。差し替えた棋譜の数を返す。
+    // 解く・棋譜を見るモードの棋譜だけで、ほかは手元で編集しているかもしれないので触らない。
+    // 今の棋譜は同じpathがまだあればそこへ戻り、ほかの棋譜は読み込む前に戻す
+    int reload(const std::string& file, const std::vector<std::shared_ptr<Node>>& trees);
+
     void shuffle();
 
     std::string get_comment() { return current().comment(); };
     std::string set_comment(std::string comment);
     void add_listener(GEventListener* listener);
     void dispatch_info_event();
-    void dispatch_tree_event();
+    void dispatch_tree_event(TreeEvent ev=TreeEvent::RESET, std::shared_ptr<Node> node=nullptr);
     void dispatch_comment_event();
     std::string get_info();
     std::string get_pos();
@@ -3,7 +3,7 @@
 #include "g.h"
 #include "node.h"
 
-static void skip_spaces(std::ifstream& ifs)
+static void skip_spaces(std::istream& ifs)
 {
     char ch;
 
@@ -19,9 +19,10 @@ static void skip_spaces(std::ifstream& ifs)
 
 #define MAX_TOKEN_LEN (1023)
 
-static char token[MAX_TOKEN_LEN+1];
+// goq-dedup等で複数のスレッドから読み込むのでスレッドごとに持つ
+static thread_local char token[MAX_TOKEN_LEN+1];
 
-Token get_token(std::ifstream& ifs)
+Token get_token(std::istream& ifs)
 {
     skip_spaces(ifs);
 
@@ -70,7 +71,7 @@ Token get_token(std::ifstream& ifs)
     return Token::END;
 }
 
-static Token get_prop_value(std::ifstream& ifs)
+static Token get_prop_value(std::istream& ifs)
 {
     int i = 0;
     char ch;
@@ -123,7 +124,7 @@ static Token get_prop_value(std::ifstream& ifs)
     return Token::END;
 }
 
-Property* load_property(std::ifstream& ifs)
+Property* load_property(std::istream& ifs)
 {
     std::string id = std::string(token);
 
@@ -167,7 +168,7 @@ Property* load_property(std::ifstream& ifs)
 }
 
 // カッコ内のノードを読み込む
-bool load_node(Route& route, std::ifstream& ifs)
+bool load_node(Route& route, std::istream& ifs)
 {
     Token t = get_token(ifs);
 
@@ -1,7 +1,7 @@
 #ifndef GIO_H
 #define GIO_H
 
-#include <fstream>
+#include <istream>
 
 class Route;
 
@@ -15,7 +15,7 @@ enum class Token {
     END,
 };
 
-Token get_token(std::ifstream& ifs);
-bool load_node(Route& route, std::ifstream& ifs);
+Token get_token(std::istream& ifs);
+bool load_node(Route& route, std::istream& ifs);
 
 #endif
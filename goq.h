@@ -0,0 +1,17 @@
+#ifndef GOQ_H
+#define GOQ_H
+
+// wxWidgetsに依存しない部分（libgoq-core）の公開ヘッダ。
+// CLIやベンチマーク等のツールはこれだけをincludeする
+
+#define GOQ_CORE_VERSION_MAJOR 0
+#define GOQ_CORE_VERSION_MINOR 1
+
+#include "board.h"
+#include "node.h"
+#include "command.h"
+#include "gio.h"
+#include "g.h"
+#include "zobrist.h"
+
+#endif
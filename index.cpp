@@ -0,0 +1,677 @@
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include "goq.h"
+#include "comment_index.h"
+#include "manifest.h"
+#include "opening_trie.h"
+#include "pos_index.h"
+#include "problem_table.h"
+#include "replay.h"
+#include "prof.h"
+#include "trace.h"
+
+// 局面の索引を作る・引く
+//
+//   goq-index build [-c] [-j スレッド数] [-m MB] [-T 一時ディレクトリ] [-b ビット数] -o INDEX FILE...
+//                                            索引を作る。-c で対称変換と黒白の入れ替えを同一視する。
+//                                            -m を超える分は一時ファイルに書き出して最後に併合する
+//                                            -b で1局面あたりのBloomフィルタのビット数（既定10、0で作らない）
+//   goq-index query INDEX SGF [手数]         SGFの最初の棋譜の本手順を手数まで進めた局面を引く
+//   goq-index stats INDEX                    索引の大きさとBloomフィルタの偽陽性率
+//   goq-index trie [-d 手数] -o TRIE FILE...  定石・布石の木を作る。各棋譜の最初の手数（既定40）だけ
+//   goq-index hints TRIE SGF [手数]           その局面で次に打たれた手
+//   goq-index comments -o INDEX FILE...       コメントの全文索引を作る。INDEXがあれば、
+//                                            変わっていないファイルは読み直さない
+//   goq-index search INDEX 語...              語をすべて含むコメントを探す
+//   goq-index problems -o TABLE FILE...       問題の属性の表を作る。TABLEがあれば、
+//                                            変わっていないファイルは計算し直さない
+//   goq-index select [-f 条件] [-s 列] TABLE  条件に合う問題を列の順に出す。-s -列 で大きい順
+//   goq-index scan [-j スレッド数] [-o MANIFEST] DIR
+//                                            DIRの下のSGFの目録を作って一覧を出す。
+//                                            MANIFESTの既定は DIR/.goq-manifest
+
+static void usage()
+{
+    std::cerr << "usage: goq-index build [-c] [-j threads] [-m MB] [-T tmpdir] [-b bits] -o INDEX FILE..." << std::endl;
+    std::cerr << "       goq-index query INDEX SGF [move]" << std::endl;
+    std::cerr << "       goq-index stats INDEX" << std::endl;
+    std::cerr << "       goq-index trie [-d depth] -o TRIE FILE..." << std::endl;
+    std::cerr << "       goq-index hints TRIE SGF [move]" << std::endl;
+    std::cerr << "       goq-index comments -o INDEX FILE..." << std::endl;
+    std::cerr << "       goq-index search INDEX WORD..." << std::endl;
+    std::cerr << "       goq-index problems -o TABLE FILE..." << std::endl;
+    std::cerr << "       goq-index select [-f filter] [-s [-]column] TABLE" << std::endl;
+    std::cerr << "       goq-index scan [-j threads] [-o MANIFEST] DIR" << std::endl;
+}
+
+static int build(int argc, char* argv[])
+{
+    bool canonical = false;
+    std::string out = "";
+    int n_threads = std::thread::hardware_concurrency();
+    size_t mem_mb = 0;
+    std::string tmp_dir = "";
+    int bloom_bits = DEFAULT_BLOOM_BITS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "co:j:m:T:b:")) != -1) {
+        switch (opt) {
+        case 'c':
+            canonical = true;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        case 'j':
+            n_threads = atoi(optarg);
+            break;
+        case 'm':
+            mem_mb = atoi(optarg);
+            break;
+        case 'T':
+            tmp_dir = optarg;
+            break;
+        case 'b':
+            bloom_bits = atoi(optarg);
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (out == "" || optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    std::vector<std::string> files(argv + optind, argv + argc);
+
+    if (n_threads < 1) {
+        n_threads = 1;
+    }
+    if (n_threads > (int) files.size()) {
+        n_threads = files.size();
+    }
+
+    // メモリの上限をスレッドで分ける
+    size_t max_entries = SIZE_MAX;
+    if (mem_mb > 0) {
+        max_entries = mem_mb * 1024 * 1024 / sizeof(PosEntry) / n_threads;
+    }
+
+    // 一時ファイルは既定では出力と同じディレクトリに作る
+    std::string prefix = out;
+    if (tmp_dir != "") {
+        prefix = tmp_dir + "/" + out.substr(out.rfind('/') + 1);
+    }
+    prefix += "." + std::to_string(getpid());
+
+    std::vector<std::unique_ptr<PosIndexBuilder>> builders;
+    for (int i = 0; i < n_threads; i++) {
+        builders.emplace_back(new PosIndexBuilder(canonical, max_entries, prefix + "." + std::to_string(i)));
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> n_done(0);
+    std::atomic<uint64_t> n_games(0);
+    std::atomic<uint64_t> n_positions(0);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (int i = 0; i < n_threads; i++) {
+        PosIndexBuilder* builder = builders[i].get();
+
+        threads.emplace_back([&, builder]() {
+            for (size_t k = next++; k < files.size(); k = next++) {
+                size_t games = builder->n_games();
+                uint64_t positions = builder->n_entries();
+
+                if (!builder->add_file(files[k])) {
+                    failed = true;
+                }
+
+                n_games += builder->n_games() - games;
+                n_positions += builder->n_entries() - positions;
+                n_done++;
+            }
+        });
+    }
+
+    // 1秒ごとに進み具合を表示する
+    auto last = start;
+    while (n_done < files.size()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last < std::chrono::seconds(1)) {
+            continue;
+        }
+        last = now;
+
+        double sec = std::chrono::duration<double>(now - start).count();
+        std::cerr << "\r" << n_done << "/" << files.size() << " files, " << n_games << " games, "
+            << n_positions << " positions (" << (uint64_t) (n_positions / sec) << " positions/s)" << std::flush;
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    PosIndexBuilder& builder = *builders[0];
+    builder.set_bloom_bits(bloom_bits);
+    for (int i = 1; i < n_threads; i++) {
+        if (!builder.merge(*builders[i])) {
+            return 1;
+        }
+    }
+
+    size_t n_runs = builder.n_runs();
+
+    if (!builder.write(out)) {
+        return 1;
+    }
+
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "\r" << files.size() << " files, " << builder.n_games() << " games, "
+        << builder.n_entries() << " positions, " << n_runs << " runs ("
+        << sec << " s, " << (uint64_t) (builder.n_entries() / sec) << " positions/s)" << std::endl;
+
+    return failed ? 1 : 0;
+}
+
+// SGFの最初の棋譜を手数（-1なら最後）まで進めた局面
+static bool load_board(const char* file, int move, Board& board)
+{
+    std::vector<std::shared_ptr<Node>> trees;
+
+    if (!load_trees(file, trees) || trees.empty()) {
+        return false;
+    }
+
+    board.init(tree_size(trees[0]));
+
+    replay_main_line(trees[0], [move, &board](const Board& b, const Move& next, int n) {
+        (void) next;
+        board = b;
+        return n != move;
+    });
+
+    return true;
+}
+
+static int query(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+
+    PosIndex index;
+
+    if (!index.open(argv[1])) {
+        return 1;
+    }
+
+    Board board(MAX_BOARD_SIZE);
+
+    if (!load_board(argv[2], (argc >= 4) ? atoi(argv[3]) : -1, board)) {
+        return 1;
+    }
+
+    std::vector<PosHit> hits;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t n = index.lookup(board, hits);
+    auto end = std::chrono::steady_clock::now();
+
+    for (auto& hit : hits) {
+        std::cout << hit.file << "#" << hit.game + 1 << " move " << hit.move << std::endl;
+    }
+
+    std::cerr << n << " hits ("
+        << std::chrono::duration<double, std::milli>(end - start).count() << " ms)" << std::endl;
+
+    return 0;
+}
+
+// 索引の大きさと、Bloomフィルタの効き目
+static int stats(int argc, char* argv[])
+{
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+
+    PosIndex index;
+
+    if (!index.open(argv[1])) {
+        return 1;
+    }
+
+    const BloomFilter& bloom = index.bloom();
+
+    std::cout << "entries: " << index.n_entries() << std::endl;
+    std::cout << "positions: " << index.n_hashes() << std::endl;
+
+    if (bloom.empty()) {
+        std::cout << "bloom: none" << std::endl;
+        return 0;
+    }
+
+    double bits_per_key = index.n_hashes() ? (double) bloom.size_bytes() * 8 / index.n_hashes() : 0;
+    std::cout << "bloom: " << bloom.size_bytes() << " bytes (" << bits_per_key << " bits/position)" << std::endl;
+    std::cout << "bloom expected fpr: " << bloom.expected_fpr(index.n_hashes()) * 100 << "%" << std::endl;
+
+    // 索引に無いはずの乱数のキーで、偽陽性率と引く時間を測る
+    const int n = 1000000;
+    std::mt19937_64 rng(1);
+    std::vector<uint64_t> keys(n);
+    for (auto& k : keys) {
+        k = rng();
+    }
+
+    int positive = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto k : keys) {
+        if (index.may_contain(k)) {
+            positive++;
+        }
+    }
+    auto mid = std::chrono::steady_clock::now();
+
+    std::vector<PosHit> hits;
+    size_t found = 0;
+    for (auto k : keys) {
+        found += index.lookup(k, hits, 0);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout << "bloom measured fpr: " << 100.0 * positive / n << "%" << std::endl;
+    std::cout << "bloom check: " << std::chrono::duration<double, std::nano>(mid - start).count() / n
+        << " ns/key" << std::endl;
+    std::cout << "lookup miss: " << std::chrono::duration<double, std::nano>(end - mid).count() / n
+        << " ns/key (" << found << " found)" << std::endl;
+
+    return 0;
+}
+
+static int trie(int argc, char* argv[])
+{
+    int depth = DEFAULT_TRIE_DEPTH;
+    std::string out = "";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:o:")) != -1) {
+        switch (opt) {
+        case 'd':
+            depth = atoi(optarg);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (out == "" || optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    OpeningTrieBuilder builder(depth);
+    int ret = 0;
+
+    for (int i = optind; i < argc; i++) {
+        if (!builder.add_file(argv[i])) {
+            ret = 1;
+        }
+    }
+
+    if (!builder.write(out)) {
+        return 1;
+    }
+
+    std::cerr << builder.n_nodes() << " positions" << std::endl;
+
+    return ret;
+}
+
+static int hints(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+
+    OpeningTrie trie;
+
+    if (!trie.open(argv[1])) {
+        return 1;
+    }
+
+    Board board(MAX_BOARD_SIZE);
+
+    if (!load_board(argv[2], (argc >= 4) ? atoi(argv[3]) : -1, board)) {
+        return 1;
+    }
+
+    std::vector<TrieHint> hints;
+
+    auto start = std::chrono::steady_clock::now();
+    int total = trie.lookup(board, hints);
+    auto end = std::chrono::steady_clock::now();
+
+    for (auto& h : hints) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%c (%d,%d) %6d %5.1f%%",
+                h.move.cell == CELL_BLACK ? 'B' : 'W', h.move.x, h.move.y, h.count, h.ratio * 100);
+        std::cout << buf << std::endl;
+    }
+
+    std::cerr << total << " games ("
+        << std::chrono::duration<double, std::milli>(end - start).count() << " ms)" << std::endl;
+
+    return 0;
+}
+
+static int comments(int argc, char* argv[])
+{
+    std::string out = "";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        switch (opt) {
+        case 'o':
+            out = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (out == "" || optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    CommentIndexBuilder builder;
+
+    if (access(out.c_str(), F_OK) == 0) {
+        builder.load(out);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int ret = 0;
+
+    for (int i = optind; i < argc; i++) {
+        if (!builder.add_file(argv[i])) {
+            ret = 1;
+        }
+    }
+
+    if (!builder.write(out)) {
+        return 1;
+    }
+
+    std::cerr << builder.n_parsed() << " files parsed, " << builder.n_reused() << " files unchanged ("
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+        << " ms)" << std::endl;
+
+    return ret;
+}
+
+static int search(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+
+    CommentIndex index;
+
+    if (!index.open(argv[1])) {
+        return 1;
+    }
+
+    std::string query = argv[2];
+    for (int i = 3; i < argc; i++) {
+        query += " ";
+        query += argv[i];
+    }
+
+    std::vector<CommentHit> hits;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t n = index.search(query, hits);
+    auto end = std::chrono::steady_clock::now();
+
+    for (auto& hit : hits) {
+        std::cout << hit.file << "#" << hit.game + 1 << " ";
+        for (size_t i = 0; i < hit.path.size(); i++) {
+            std::cout << (i ? "." : "") << hit.path[i];
+        }
+        std::cout << "\t" << hit.text.substr(0, hit.text.find('\n')) << std::endl;
+    }
+
+    std::cerr << n << " hits ("
+        << std::chrono::duration<double, std::milli>(end - start).count() << " ms)" << std::endl;
+
+    return 0;
+}
+
+static int problems(int argc, char* argv[])
+{
+    std::string out = "";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        switch (opt) {
+        case 'o':
+            out = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (out == "" || optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    ProblemTable table;
+
+    if (access(out.c_str(), F_OK) == 0) {
+        table.load(out);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    bool ok = table.update(std::vector<std::string>(argv + optind, argv + argc));
+
+    if (!table.save(out)) {
+        return 1;
+    }
+
+    std::cerr << table.n_rows() << " problems, " << table.n_parsed() << " files parsed, "
+        << table.n_reused() << " files unchanged ("
+        << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+        << " ms)" << std::endl;
+
+    return ok ? 0 : 1;
+}
+
+static int select(int argc, char* argv[])
+{
+    ProblemFilter filter;
+    std::string key = "";
+    bool desc = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:s:")) != -1) {
+        switch (opt) {
+        case 'f':
+            if (!filter.parse(optarg)) {
+                std::cerr << "Error: bad filter: " << optarg << std::endl;
+                return 2;
+            }
+            break;
+        case 's':
+            key = optarg;
+            if (key != "" && key[0] == '-') {
+                desc = true;
+                key = key.substr(1);
+            }
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    ProblemTable table;
+
+    if (!table.load(argv[optind])) {
+        return 1;
+    }
+
+    std::vector<uint32_t> rows;
+
+    auto start = std::chrono::steady_clock::now();
+    if (!table.query(filter, key, desc, rows)) {
+        std::cerr << "Error: unknown column: " << key << std::endl;
+        return 2;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    static const char* regions[] = {"-", "corner", "side", "center", "whole"};
+
+    for (auto r : rows) {
+        std::cout << table.file_name(table.file[r]) << "#" << table.game[r] + 1
+            << "\t" << (int) table.size[r]
+            << "\t" << (table.to_play[r] == CELL_BLACK ? "B" : table.to_play[r] == CELL_WHITE ? "W" : "-")
+            << "\t" << table.stones[r]
+            << "\t" << regions[table.region[r] <= PROBLEM_WHOLE ? table.region[r] : 0]
+            << "\t" << table.depth[r]
+            << "\t" << table.correct[r]
+            << "\t" << table.difficulty[r] << std::endl;
+    }
+
+    std::cerr << rows.size() << " / " << table.n_rows() << " problems ("
+        << std::chrono::duration<double, std::milli>(end - start).count() << " ms)" << std::endl;
+
+    return 0;
+}
+
+static int scan(int argc, char* argv[])
+{
+    int n_threads = 0;
+    std::string out = "";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:o:")) != -1) {
+        switch (opt) {
+        case 'j':
+            n_threads = atoi(optarg);
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    std::string dir = argv[optind];
+    if (out == "") {
+        out = dir + "/" + MANIFEST_NAME;
+    }
+
+    Manifest manifest;
+
+    if (access(out.c_str(), F_OK) == 0) {
+        manifest.load(out);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    bool ok = manifest.update(dir, n_threads);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!manifest.save(out)) {
+        return 1;
+    }
+
+    for (auto& e : manifest.entries()) {
+        std::cout << e.path << "\t" << e.n_games << "\t" << e.board_size << "\t" << e.black << "\t"
+            << e.white << "\t" << e.result << "\t" << e.date << "\t" << e.name << std::endl;
+    }
+
+    std::cerr << manifest.entries().size() << " files, " << manifest.n_games() << " games, "
+        << manifest.n_parsed() << " parsed, " << manifest.n_hashed() << " touched, "
+        << manifest.n_reused() << " unchanged (" << ms << " ms)" << std::endl;
+
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    prof_init();
+    trace_init();
+
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+
+    if (strcmp(argv[1], "build") == 0) {
+        return build(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "query") == 0) {
+        return query(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "stats") == 0) {
+        return stats(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "trie") == 0) {
+        return trie(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "hints") == 0) {
+        return hints(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "comments") == 0) {
+        return comments(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "search") == 0) {
+        return search(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "problems") == 0) {
+        return problems(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "select") == 0) {
+        return select(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "scan") == 0) {
+        return scan(argc - 1, argv + 1);
+    }
+
+    usage();
+    return 2;
+}
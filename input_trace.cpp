@@ -0,0 +1,301 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include "input_trace.h"
+#include "board_window.h"
+#include "stats.h"
+
+#define TRACE_HEADER "# goq input trace 1"
+
+bool InputRecorder::open(const std::string& filename, int width)
+{
+    m_ofs.open(filename);
+
+    if (!m_ofs) {
+        std::cerr << "Error: couldn't open file: " << filename << std::endl;
+        return false;
+    }
+
+    m_ofs << TRACE_HEADER << " " << width << std::endl;
+    m_start = std::chrono::steady_clock::now();
+
+    return true;
+}
+
+void InputRecorder::record(InputEvent ev)
+{
+    ev.t_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - m_start).count();
+
+    m_ofs << ev.t_us << " ";
+
+    switch (ev.type) {
+    case InputType::KEY:
+        m_ofs << "K " << ev.key << " " << ev.mods;
+        break;
+    case InputType::LEFT:
+        m_ofs << "L " << ev.x << " " << ev.y << " " << ev.mods;
+        break;
+    case InputType::RIGHT:
+        m_ofs << "R " << ev.x << " " << ev.y << " " << ev.mods;
+        break;
+    case InputType::MOVE:
+        m_ofs << "M " << ev.x << " " << ev.y;
+        break;
+    case InputType::LEAVE:
+        m_ofs << "X";
+        break;
+    case InputType::WHEEL:
+        m_ofs << "W " << ev.wheel;
+        break;
+    }
+
+    // 落ちても途中まで残るように毎回書き出す
+    m_ofs << std::endl;
+}
+
+bool load_input_trace(const std::string& filename, std::vector<InputEvent>& events, int& width)
+{
+    std::ifstream ifs(filename);
+
+    if (!ifs) {
+        std::cerr << "Error: couldn't open file: " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+
+    if (!std::getline(ifs, line) || line.compare(0, strlen(TRACE_HEADER), TRACE_HEADER) != 0) {
+        std::cerr << "Error: not an input trace. file = " << filename << std::endl;
+        return false;
+    }
+
+    width = atoi(line.c_str() + strlen(TRACE_HEADER));
+
+    int n_line = 1;
+    while (std::getline(ifs, line)) {
+        n_line++;
+
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream iss(line);
+        InputEvent ev;
+        char type = 0;
+
+        iss >> ev.t_us >> type;
+
+        switch (type) {
+        case 'K':
+            ev.type = InputType::KEY;
+            iss >> ev.key >> ev.mods;
+            break;
+        case 'L':
+            ev.type = InputType::LEFT;
+            iss >> ev.x >> ev.y >> ev.mods;
+            break;
+        case 'R':
+            ev.type = InputType::RIGHT;
+            iss >> ev.x >> ev.y >> ev.mods;
+            break;
+        case 'M':
+            ev.type = InputType::MOVE;
+            iss >> ev.x >> ev.y;
+            break;
+        case 'X':
+            ev.type = InputType::LEAVE;
+            break;
+        case 'W':
+            ev.type = InputType::WHEEL;
+            iss >> ev.wheel;
+            break;
+        default:
+            iss.setstate(std::ios::failbit);
+            break;
+        }
+
+        if (!iss) {
+            std::cerr << "Error: broken input trace. file = " << filename << ", line = " << n_line << std::endl;
+            return false;
+        }
+
+        events.push_back(ev);
+    }
+
+    return true;
+}
+
+InputReplay::InputReplay(BoardWindow* win, const std::vector<InputEvent>& events, int width, bool realtime)
+    : m_win(win), m_events(events), m_width(width), m_realtime(realtime), m_timer(this)
+{
+    Bind(wxEVT_TIMER, &InputReplay::OnTimer, this);
+}
+
+void InputReplay::start()
+{
+    m_i = 0;
+    m_waiting = false;
+    m_win->set_replay(this);
+    m_handle_us.clear();
+    m_paint_us.clear();
+    m_start = std::chrono::steady_clock::now();
+
+    schedule();
+}
+
+// 次の入力をイベントループに戻ってから渡す。その間に溜まったイベントも処理される
+void InputReplay::schedule()
+{
+    if (m_i >= m_events.size()) {
+        report();
+        return;
+    }
+
+    int delay = 0;
+
+    if (m_realtime) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - m_start).count();
+        delay = m_events[m_i].t_us / 1000 - elapsed;
+        if (delay < 0) {
+            delay = 0;
+        }
+    }
+
+    m_timer.StartOnce(delay);
+}
+
+void InputReplay::OnTimer(wxTimerEvent& e)
+{
+    (void) e;
+
+    play(m_events[m_i]);
+
+    // モデルへ送ったときは、on_snapshot()で描いてから次へ進む
+    if (!m_waiting) {
+        m_i++;
+        schedule();
+    }
+}
+
+void InputReplay::on_snapshot()
+{
+    if (!m_waiting || m_win->n_applied() < m_wait_for) {
+        return;
+    }
+
+    m_waiting = false;
+
+    paint(m_t0, std::chrono::steady_clock::now());
+
+    m_i++;
+    schedule();
+}
+
+void InputReplay::play(const InputEvent& ev)
+{
+    using clock = std::chrono::steady_clock;
+
+    // 記録したときと盤の大きさが違うときは座標を合わせる
+    int width = m_win->get_width();
+    int x = ev.x;
+    int y = ev.y;
+    if (m_width > 0 && width != m_width) {
+        x = ev.x * width / m_width;
+        y = ev.y * width / m_width;
+    }
+
+    uint64_t n_posted = m_win->n_posted();
+    auto t0 = clock::now();
+
+    if (ev.type == InputType::KEY) {
+        wxKeyEvent ke(wxEVT_KEY_DOWN);
+        ke.m_keyCode = ev.key;
+        ke.SetShiftDown(ev.mods & INPUT_SHIFT);
+        ke.SetControlDown(ev.mods & INPUT_CTRL);
+        m_win->OnKeyDown(ke);
+    } else {
+        wxEventType type = wxEVT_MOTION;
+        if (ev.type == InputType::LEFT) {
+            type = wxEVT_LEFT_DOWN;
+        } else if (ev.type == InputType::RIGHT) {
+            type = wxEVT_RIGHT_DOWN;
+        } else if (ev.type == InputType::LEAVE) {
+            type = wxEVT_LEAVE_WINDOW;
+        } else if (ev.type == InputType::WHEEL) {
+            type = wxEVT_MOUSEWHEEL;
+        }
+
+        wxMouseEvent me(type);
+        me.m_x = x;
+        me.m_y = y;
+        me.m_wheelRotation = ev.wheel;
+        me.SetShiftDown(ev.mods & INPUT_SHIFT);
+        me.SetControlDown(ev.mods & INPUT_CTRL);
+
+        switch (ev.type) {
+        case InputType::LEFT:
+        case InputType::RIGHT:
+            m_win->OnClick(me);
+            break;
+        case InputType::MOVE:
+            m_win->OnMove(me);
+            break;
+        case InputType::LEAVE:
+            m_win->OnLeave(me);
+            break;
+        case InputType::WHEEL:
+            m_win->OnWheel(me);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // モデルのスレッドが実行し、スナップショットがUIに届くまで待つ
+    if (m_win->n_posted() != n_posted) {
+        m_waiting = true;
+        m_wait_for = m_win->n_posted();
+        m_t0 = t0;
+        return;
+    }
+
+    paint(t0, clock::now());
+}
+
+// t0に入力を渡し、t1に盤面が変わった
+void InputReplay::paint(std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1)
+{
+    // 無効になった範囲をすぐに描かせる
+    m_win->Update();
+
+    auto t2 = std::chrono::steady_clock::now();
+
+    m_handle_us.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+    m_paint_us.push_back(std::chrono::duration<double, std::micro>(t2 - t1).count());
+}
+
+void InputReplay::report()
+{
+    Stats handle = summarize(m_handle_us);
+    Stats paint = summarize(m_paint_us);
+    double total = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - m_start).count();
+
+    char buf[256];
+    std::cerr << "replay: " << m_events.size() << " events, " << total << " ms" << std::endl;
+    snprintf(buf, sizeof(buf), "  handle(us) p50=%.1f p90=%.1f p99=%.1f max=%.1f",
+            handle.p50, handle.p90, handle.p99, handle.max);
+    std::cerr << buf << std::endl;
+    snprintf(buf, sizeof(buf), "  paint(us)  p50=%.1f p90=%.1f p99=%.1f max=%.1f",
+            paint.p50, paint.p90, paint.p99, paint.max);
+    std::cerr << buf << std::endl;
+
+    m_win->set_replay(nullptr);
+
+    // 計測用なので、終わったら閉じる
+    m_win->GetParent()->Close(true);
+}
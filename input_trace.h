@@ -0,0 +1,89 @@
+#ifndef INPUT_TRACE_H
+#define INPUT_TRACE_H
+
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class BoardWindow;
+
+// 盤面への入力（キー、クリック、マウスの移動、ホイール）の記録と再生。
+// 再生では同じハンドラに入力を渡し、処理と描画にかかった時間を測る
+
+enum class InputType {
+    KEY,    // キー
+    LEFT,   // 左クリック
+    RIGHT,  // 右クリック
+    MOVE,   // マウスの移動
+    LEAVE,  // マウスが盤面から出た
+    WHEEL,  // ホイール
+};
+
+#define INPUT_SHIFT (1)
+#define INPUT_CTRL (2)
+
+struct InputEvent
+{
+    uint64_t t_us = 0;  // 記録を始めてからの時間
+    InputType type = InputType::KEY;
+    int key = 0;
+    int mods = 0;
+    int x = 0, y = 0;
+    int wheel = 0;
+};
+
+class InputRecorder
+{
+    std::ofstream m_ofs;
+    std::chrono::steady_clock::time_point m_start;
+public:
+    bool open(const std::string& filename, int width);
+    bool is_open() { return m_ofs.is_open(); };
+    void record(InputEvent ev);
+};
+
+bool load_input_trace(const std::string& filename, std::vector<InputEvent>& events, int& width);
+
+// 記録した入力を順に盤面へ渡す。realtimeなら記録したときの間隔を空ける。
+// 最後まで渡したら、かかった時間を標準エラー出力に書いてウィンドウを閉じる。
+// モデルへ送る入力では、その操作を反映したスナップショットが届くまでをhandle、
+// それを描くまでをpaintとして測り、描いてから次の入力を渡す
+class InputReplay : public wxEvtHandler
+{
+    BoardWindow* m_win;
+    std::vector<InputEvent> m_events;
+    int m_width;
+    bool m_realtime;
+    size_t m_i = 0;
+    wxTimer m_timer;
+    std::chrono::steady_clock::time_point m_start;
+
+    // モデルへ送った入力の、スナップショットを待っている
+    bool m_waiting = false;
+    uint64_t m_wait_for = 0;  // このn_commandsまで待つ
+    std::chrono::steady_clock::time_point m_t0;  // 入力を渡した時間
+
+    std::vector<double> m_handle_us;
+    std::vector<double> m_paint_us;
+
+    void OnTimer(wxTimerEvent& event);
+    void play(const InputEvent& ev);
+    void schedule();
+    void paint(std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1);
+    void report();
+public:
+    InputReplay(BoardWindow* win, const std::vector<InputEvent>& events, int width, bool realtime);
+
+    void start();
+    // BoardWindowが新しいスナップショットを受け取ったときに呼ぶ
+    void on_snapshot();
+};
+
+#endif
@@ -0,0 +1,546 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include "journal.h"
+#include "gio.h"
+#include "node.h"
+
+#define JOURNAL_MAGIC "GOQJ"
+#define JOURNAL_VERSION (1)
+#define SNAPSHOT_MAGIC "GOQS"
+
+// これだけ記録したらスナップショットにまとめる
+#define COMPACT_RECORDS (1000)
+
+// 数値はホストのバイト順で書く
+template <typename T>
+static void put(std::string& buf, T v)
+{
+    buf.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+template <typename T>
+static bool get(const std::string& buf, size_t& pos, T& v)
+{
+    if (pos + sizeof(v) > buf.size()) {
+        return false;
+    }
+
+    memcpy(&v, buf.data() + pos, sizeof(v));
+    pos += sizeof(v);
+
+    return true;
+}
+
+static uint32_t crc32(const std::string& s)
+{
+    static uint32_t table[256];
+    static bool has_table = false;
+
+    if (!has_table) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        has_table = true;
+    }
+
+    uint32_t crc = 0xffffffff;
+    for (unsigned char ch : s) {
+        crc = table[(crc ^ ch) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+static bool write_all(int fd, const std::string& buf)
+{
+    const char* p = buf.data();
+    size_t left = buf.size();
+
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        p += n;
+        left -= n;
+    }
+
+    return true;
+}
+
+static std::string props_sgf(std::shared_ptr<Node> node)
+{
+    std::string s = ";";
+
+    for (auto& p : node->properties) {
+        s += p->to_sgf();
+    }
+
+    return s;
+}
+
+// 読み込んだノードはすべて保護されるので、保護されているかどうかを
+// 行きがけ順に '1' '0' で並べて別に持っておく
+static void get_flags(std::shared_ptr<Node> node, std::string& flags)
+{
+    flags += node->is_protected() ? '1' : '0';
+
+    for (auto child : node->children) {
+        get_flags(child, flags);
+    }
+}
+
+static void set_flags(std::shared_ptr<Node> node, const std::string& flags, size_t& i)
+{
+    if (i < flags.size()) {
+        node->set_protected(flags[i] == '1');
+    }
+    i++;
+
+    for (auto child : node->children) {
+        set_flags(child, flags, i);
+    }
+}
+
+// 保護のフラグとノードをつなげた文字列
+static std::string node_data(std::shared_ptr<Node> node, const std::string& sgf)
+{
+    std::string flags;
+    get_flags(node, flags);
+
+    return flags + sgf;
+}
+
+// "10;B[aa](;W[bb])" のような文字列からノードを作る
+static std::shared_ptr<Node> parse_node(const std::string& data)
+{
+    size_t n = data.find(';');
+    if (n == std::string::npos) {
+        return nullptr;
+    }
+
+    std::string flags = data.substr(0, n);
+    std::istringstream is("(" + data.substr(n) + ")");
+    std::shared_ptr<Node> tmp(new Node(true));
+    Route route(tmp);
+
+    if (get_token(is) != Token::L_PAREN || !load_node(route, is) || tmp->children.empty()) {
+        return nullptr;
+    }
+
+    size_t i = 0;
+    set_flags(tmp->children.front(), flags, i);
+
+    return tmp->children.front();
+}
+
+Journal::Journal(G& g, const std::string& filename)
+    : g(g), m_filename(filename)
+{
+}
+
+Journal::~Journal()
+{
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+bool Journal::read_snapshot(std::vector<Tree>& trees)
+{
+    std::ifstream ifs(m_filename + ".snap", std::ios::in | std::ios::binary);
+
+    if (!ifs) {
+        return false;
+    }
+
+    std::string magic;
+    int version = 0;
+    ifs >> magic >> version >> m_gen;
+
+    if (magic != SNAPSHOT_MAGIC || version != JOURNAL_VERSION) {
+        std::cerr << "Error: broken snapshot: " << m_filename << ".snap" << std::endl;
+        return false;
+    }
+
+    int mode;
+    size_t len;
+    while (ifs >> mode >> len) {
+        ifs.get();  // 改行
+
+        std::string sgf(len, '\0');
+        if (!ifs.read(&sgf[0], len)) {
+            std::cerr << "Error: broken snapshot: " << m_filename << ".snap" << std::endl;
+            return false;
+        }
+
+        std::shared_ptr<Node> root = parse_node(sgf);
+        if (!root) {
+            return false;
+        }
+
+        trees.push_back({static_cast<Gmode>(mode), root});
+    }
+
+    return true;
+}
+
+// 正しく読めたレコードの数を返す
+int Journal::apply_records(std::vector<Tree>& trees)
+{
+    std::ifstream ifs(m_filename, std::ios::in | std::ios::binary);
+
+    if (!ifs) {
+        return 0;
+    }
+
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    std::string buf = oss.str();
+
+    size_t pos = 0;
+    uint32_t version;
+    uint64_t gen;
+
+    if (buf.compare(0, 4, JOURNAL_MAGIC) != 0) {
+        return 0;
+    }
+    pos += 4;
+
+    if (!get(buf, pos, version) || !get(buf, pos, gen) || version != JOURNAL_VERSION) {
+        return 0;
+    }
+
+    // スナップショットを作った後の記録でなければ、もう反映されている
+    if (gen != m_gen) {
+        return 0;
+    }
+
+    int n = 0;
+
+    while (pos < buf.size()) {
+        uint32_t len, crc;
+
+        if (!get(buf, pos, len) || !get(buf, pos, crc) || pos + len > buf.size()) {
+            break;
+        }
+
+        std::string body = buf.substr(pos, len);
+        pos += len;
+
+        if (crc32(body) != crc) {
+            break;
+        }
+
+        size_t bp = 0;
+        uint8_t type, mode;
+        uint16_t game_i, depth;
+
+        if (!get(body, bp, type) || !get(body, bp, mode) || !get(body, bp, game_i) ||
+                !get(body, bp, depth) || game_i >= trees.size()) {
+            break;
+        }
+
+        std::shared_ptr<Node> node = trees[game_i].root;
+        bool ok = true;
+
+        for (int i = 0; i < depth && ok; i++) {
+            uint16_t idx;
+            ok = get(body, bp, idx) && idx < node->children.size();
+
+            if (ok) {
+                auto itr = node->children.begin();
+                std::advance(itr, idx);
+                node = *itr;
+            }
+        }
+
+        std::shared_ptr<Node> data = ok ? parse_node(body.substr(bp)) : nullptr;
+
+        if (!data) {
+            break;
+        }
+
+        switch (static_cast<Rec>(type)) {
+        case Rec::ADD_CHILD:
+            node->children.push_back(data);
+            break;
+        case Rec::SET_PROPS:
+            node->properties = data->properties;
+            break;
+        case Rec::SET_TREE:
+            node->properties = data->properties;
+            node->children = data->children;
+            break;
+        default:
+            ok = false;
+            break;
+        }
+
+        if (!ok) {
+            break;
+        }
+
+        trees[game_i].mode = static_cast<Gmode>(mode);
+        n++;
+    }
+
+    if (pos < buf.size()) {
+        std::cerr << "journal: ignored a broken tail at " << pos << " bytes" << std::endl;
+    }
+
+    return n;
+}
+
+// スナップショットと記録から前回の状態に戻す。戻すものがなければfalse
+bool Journal::recover()
+{
+    std::vector<Tree> trees;
+
+    if (!read_snapshot(trees)) {
+        return false;
+    }
+
+    int n = apply_records(trees);
+
+    if (trees.empty()) {
+        return false;
+    }
+
+    for (int i = 0; i < (int) trees.size(); i++) {
+        std::istringstream is("(" + trees[i].root->to_sgf() + ")");
+        g.load(trees[i].mode, is, i != 0);
+    }
+
+    // 保護されているかどうかを元に戻す
+    auto tree = trees.begin();
+    for (auto game : g.get_games()) {
+        std::string flags;
+        get_flags(tree->root, flags);
+
+        size_t i = 0;
+        set_flags(game->get_root(), flags, i);
+        tree++;
+    }
+
+    std::cerr << "journal: recovered " << trees.size() << " games, " << n << " records" << std::endl;
+
+    return true;
+}
+
+// 全ゲームをスナップショットに書き、記録を空にする。
+// スナップショットを置き換えてから記録の世代を上げるので、その間に落ちても
+// 古い記録は世代が合わずに捨てられる
+bool Journal::compact()
+{
+    uint64_t gen = m_gen + 1;
+
+    std::string snap = SNAPSHOT_MAGIC " " + std::to_string(JOURNAL_VERSION) + " " + std::to_string(gen) + "\n";
+
+    for (auto game : g.get_games()) {
+        std::string sgf = node_data(game->get_root(), game->get_root()->to_sgf());
+        snap += std::to_string(static_cast<int>(game->get_mode())) + " " + std::to_string(sgf.size()) + "\n";
+        snap += sgf + "\n";
+    }
+
+    std::string tmp = m_filename + ".snap.tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1 || !write_all(fd, snap) || fsync(fd) != 0) {
+        std::cerr << "Error: couldn't write file: " << tmp << ": " << strerror(errno) << std::endl;
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+    close(fd);
+
+    if (rename(tmp.c_str(), (m_filename + ".snap").c_str()) != 0) {
+        std::cerr << "Error: couldn't rename file: " << tmp << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+
+    m_fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+
+    std::string header = JOURNAL_MAGIC;
+    put<uint32_t>(header, JOURNAL_VERSION);
+    put<uint64_t>(header, gen);
+
+    if (m_fd == -1 || !write_all(m_fd, header) || fsync(m_fd) != 0) {
+        std::cerr << "Error: couldn't write file: " << m_filename << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    m_gen = gen;
+    m_n_records = 0;
+
+    return true;
+}
+
+// gameのrootからnodeまでの、子の番号の列を求める
+bool Journal::get_path(Game& game, std::shared_ptr<Node> node, std::vector<uint16_t>& path)
+{
+    // ほとんどはroute上のノードなので、routeを辿る
+    const std::vector<std::shared_ptr<Node>>& nodes = game.get_route().get_nodes();
+
+    for (int k = 0; k < (int) nodes.size(); k++) {
+        if (nodes[k] != node) {
+            continue;
+        }
+
+        path.clear();
+
+        for (int i = 0; i < k; i++) {
+            auto& children = nodes[i]->children;
+            int idx = 0;
+            auto itr = children.begin();
+
+            for (; itr != children.end(); itr++, idx++) {
+                if (*itr == nodes[i + 1]) {
+                    break;
+                }
+            }
+
+            if (itr == children.end()) {
+                break;
+            }
+
+            path.push_back(idx);
+        }
+
+        if ((int) path.size() == k) {
+            return true;
+        }
+
+        break;
+    }
+
+    // route上になければ木全体から探す
+    std::function<bool(std::shared_ptr<Node>)> dfs = [&](std::shared_ptr<Node> n) {
+        if (n == node) {
+            return true;
+        }
+
+        uint16_t idx = 0;
+        for (auto child : n->children) {
+            path.push_back(idx);
+            if (dfs(child)) {
+                return true;
+            }
+            path.pop_back();
+            idx++;
+        }
+
+        return false;
+    };
+
+    path.clear();
+
+    return dfs(game.get_root());
+}
+
+bool Journal::write_record(Rec type, Game& game, std::shared_ptr<Node> node, const std::string& data)
+{
+    if (m_fd == -1) {
+        return false;
+    }
+
+    uint16_t game_i = 0;
+    for (auto gm : g.get_games()) {
+        if (gm == &game) {
+            break;
+        }
+        game_i++;
+    }
+
+    std::vector<uint16_t> path;
+    if (!get_path(game, node, path)) {
+        return false;
+    }
+
+    std::string body;
+    put<uint8_t>(body, static_cast<uint8_t>(type));
+    put<uint8_t>(body, static_cast<uint8_t>(game.get_mode()));
+    put<uint16_t>(body, game_i);
+    put<uint16_t>(body, path.size());
+    for (uint16_t idx : path) {
+        put<uint16_t>(body, idx);
+    }
+    body += data;
+
+    std::string rec;
+    put<uint32_t>(rec, body.size());
+    put<uint32_t>(rec, crc32(body));
+    rec += body;
+
+    // 1レコードを1回のwriteで書き、すぐにディスクへ送る
+    if (!write_all(m_fd, rec) || fdatasync(m_fd) != 0) {
+        std::cerr << "Error: couldn't write file: " << m_filename << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    m_n_records++;
+
+    if (m_n_records >= COMPACT_RECORDS) {
+        compact();
+    }
+
+    return true;
+}
+
+void Journal::on_tree(Game& game, TreeEvent ev, std::shared_ptr<Node> node)
+{
+    Gmode mode = game.get_mode();
+
+    if (mode != Gmode::CREATE && mode != Gmode::ANSWER) {
+        return;
+    }
+
+    switch (ev) {
+    case TreeEvent::RESET:
+        // ゲームの追加や削除。番号がずれるのでまとめ直す
+        compact();
+        break;
+
+    case TreeEvent::ADDED:
+        if (node && !node->children.empty()) {
+            write_record(Rec::ADD_CHILD, game, node, node_data(node->children.back(), props_sgf(node->children.back())));
+        }
+        break;
+
+    case TreeEvent::REMOVED:
+        if (node) {
+            write_record(Rec::SET_TREE, game, node, node_data(node, node->to_sgf()));
+        }
+        break;
+
+    case TreeEvent::CHANGED:
+        if (node) {
+            write_record(Rec::SET_PROPS, game, node, props_sgf(node));
+        }
+        break;
+
+    case TreeEvent::MOVED:
+        break;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "g.h"
+
+// 問題作成（CREATE/ANSWER）中の木の変更を、追記専用のファイルに記録する。
+// 落ちても、次に起動したときにスナップショットと記録から作業中の状態に戻せる。
+//
+//   FILE       ヘッダ + レコードの列
+//   FILE.snap  ある時点の全ゲームのSGF（コンパクションで作り直す）
+//
+// レコードは [長さ][CRC32][種類 モード ゲーム番号 ノードの位置 データ] で、
+// 途中で切れていたりCRCが合わなかったりしたら、そこから後は捨てる
+class Journal : public GEventListener
+{
+    enum class Rec : uint8_t {
+        ADD_CHILD = 1,  // ノードの最後に子を追加
+        SET_PROPS,      // ノードのプロパティを置き換え
+        SET_TREE,       // ノード以下を置き換え（子の削除等）
+    };
+
+    struct Tree
+    {
+        Gmode mode;
+        std::shared_ptr<Node> root;
+    };
+
+    G& g;
+    std::string m_filename;
+    int m_fd = -1;
+    uint64_t m_gen = 0;
+    int m_n_records = 0;
+
+    bool write_record(Rec type, Game& game, std::shared_ptr<Node> node, const std::string& data);
+    bool get_path(Game& game, std::shared_ptr<Node> node, std::vector<uint16_t>& path);
+    bool read_snapshot(std::vector<Tree>& trees);
+    int apply_records(std::vector<Tree>& trees);
+public:
+    Journal(G& g, const std::string& filename);
+    ~Journal();
+
+    bool recover();
+    bool compact();
+
+    virtual void on_comment(std::string comment) { (void) comment; };
+    virtual void on_pos(std::string pos) { (void) pos; };
+    virtual void on_wrong(size_t problem, std::string sgf) { (void) problem; (void) sgf; };
+    virtual void on_info(std::string info) { (void) info; };
+    virtual void on_tree(Game& game, TreeEvent ev, std::shared_ptr<Node> node);
+};
+
+#endif
@@ -0,0 +1,213 @@
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "goq.h"
+#include "kifu_store.h"
+#include "prof.h"
+#include "trace.h"
+
+// 棋譜をまとめて詰めたファイルを作る・読む
+//
+//   goq-kifu pack [-e] -o KIFU FILE...  SGFの本手順を詰める。-e で差分と指数ゴロム符号にする
+//   goq-kifu list KIFU                  棋譜ごとの対局者・結果・日付・手数
+//   goq-kifu sgf KIFU 番号              番号（1から）の棋譜をSGFで出す
+//   goq-kifu replay KIFU                すべての棋譜を盤に打ち直して速さを測る
+
+static void usage()
+{
+    std::cerr << "usage: goq-kifu pack [-e] -o KIFU FILE..." << std::endl;
+    std::cerr << "       goq-kifu list KIFU" << std::endl;
+    std::cerr << "       goq-kifu sgf KIFU N" << std::endl;
+    std::cerr << "       goq-kifu replay KIFU" << std::endl;
+}
+
+static int pack(int argc, char* argv[])
+{
+    uint32_t flags = 0;
+    std::string out = "";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "eo:")) != -1) {
+        switch (opt) {
+        case 'e':
+            flags |= KIFU_ENTROPY;
+            break;
+        case 'o':
+            out = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    if (out == "" || optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    KifuWriter writer;
+
+    if (!writer.open(out, flags)) {
+        return 1;
+    }
+
+    int ret = 0;
+
+    for (int i = optind; i < argc; i++) {
+        if (!writer.add_file(argv[i])) {
+            ret = 1;
+        }
+    }
+
+    uint64_t n_games = writer.n_games();
+    uint64_t n_moves = writer.n_moves();
+
+    if (!writer.close()) {
+        return 1;
+    }
+
+    KifuReader reader;
+    if (!reader.open(out)) {
+        return 1;
+    }
+
+    uint64_t bytes = 0;
+    for (uint64_t i = 0; i < reader.n_games(); i++) {
+        bytes += reader.game_bytes(i);
+    }
+
+    std::cerr << n_games << " games, " << n_moves << " moves, " << bytes << " bytes ("
+        << (n_moves ? (double) bytes * 8 / n_moves : 0) << " bits/move)" << std::endl;
+
+    return ret;
+}
+
+static int list(int argc, char* argv[])
+{
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+
+    KifuReader reader;
+
+    if (!reader.open(argv[1])) {
+        return 1;
+    }
+
+    for (uint64_t i = 0; i < reader.n_games(); i++) {
+        KifuInfo info;
+
+        if (!reader.read_info(i, info)) {
+            std::cerr << "Error: broken game: " << i + 1 << std::endl;
+            return 1;
+        }
+
+        int n = reader.replay(i, [](const Board&, const Move&, int) { return true; });
+
+        std::cout << i + 1 << "\t" << info.size << "\t" << info.black << "\t" << info.white << "\t"
+            << info.result << "\t" << info.date << "\t" << n << std::endl;
+    }
+
+    return 0;
+}
+
+static int sgf(int argc, char* argv[])
+{
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+
+    KifuReader reader;
+
+    if (!reader.open(argv[1])) {
+        return 1;
+    }
+
+    KifuGame game;
+
+    if (!reader.read(atoll(argv[2]) - 1, game)) {
+        std::cerr << "Error: not found game: " << argv[2] << std::endl;
+        return 1;
+    }
+
+    write_kifu_sgf(std::cout, game);
+
+    return 0;
+}
+
+static int replay(int argc, char* argv[])
+{
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+
+    KifuReader reader;
+
+    if (!reader.open(argv[1])) {
+        return 1;
+    }
+
+    uint64_t n_moves = 0;
+    uint64_t n_stones = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint64_t i = 0; i < reader.n_games(); i++) {
+        int n = reader.replay(i, [&n_stones](const Board& board, const Move& next, int) {
+            // 最後の局面の石を数えて、最適化で消されないようにする
+            if (next.cell == CELL_SPACE) {
+                int size = board.get_size();
+                for (int y = 1; y <= size; y++) {
+                    for (int x = 1; x <= size; x++) {
+                        n_stones += board.get_cell(x, y) != CELL_SPACE;
+                    }
+                }
+            }
+            return true;
+        });
+
+        if (n < 0) {
+            std::cerr << "Error: broken game: " << i + 1 << std::endl;
+            return 1;
+        }
+
+        n_moves += n;
+    }
+
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cerr << reader.n_games() << " games, " << n_moves << " moves, " << n_stones << " stones ("
+        << sec << " s, " << (uint64_t) (n_moves / sec) << " moves/s)" << std::endl;
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    prof_init();
+    trace_init();
+
+    if (argc < 2) {
+        usage();
+        return 2;
+    }
+
+    if (strcmp(argv[1], "pack") == 0) {
+        return pack(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "list") == 0) {
+        return list(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "sgf") == 0) {
+        return sgf(argc - 1, argv + 1);
+    } else if (strcmp(argv[1], "replay") == 0) {
+        return replay(argc - 1, argv + 1);
+    }
+
+    usage();
+    return 2;
+}
@@ -0,0 +1,583 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include "kifu_store.h"
+#include "node.h"
+#include "prof.h"
+
+#define KIFU_STRIDE (19)
+#define KIFU_GOLOMB_K (2)
+
+// 下位ビットから詰めて書く
+class BitWriter
+{
+    std::vector<uint8_t>& m_buf;
+    uint64_t m_acc = 0;
+    int m_n = 0;
+public:
+    BitWriter(std::vector<uint8_t>& buf) : m_buf(buf) {};
+
+    void put(uint32_t v, int n) {
+        m_acc |= (uint64_t) (v & ((1u << n) - 1)) << m_n;
+        m_n += n;
+
+        while (m_n >= 8) {
+            m_buf.push_back(m_acc & 0xff);
+            m_acc >>= 8;
+            m_n -= 8;
+        }
+    };
+
+    // 指数ゴロム符号（k次）
+    void put_golomb(uint32_t v) {
+        uint32_t w = v + (1u << KIFU_GOLOMB_K);
+        int n = 32 - __builtin_clz(w);
+
+        for (int i = KIFU_GOLOMB_K + 1; i < n; i++) {
+            put(0, 1);
+        }
+        put(1, 1);
+        put(w, n - 1);
+    };
+
+    void flush() {
+        if (m_n > 0) {
+            m_buf.push_back(m_acc & 0xff);
+        }
+        m_acc = 0;
+        m_n = 0;
+    };
+};
+
+class BitReader
+{
+    const uint8_t* m_p;
+    const uint8_t* m_end;
+    uint64_t m_acc = 0;
+    int m_n = 0;
+public:
+    bool ok = true;
+
+    BitReader(const uint8_t* p, const uint8_t* end) : m_p(p), m_end(end) {};
+
+    uint32_t get(int n) {
+        while (m_n < n) {
+            if (m_p >= m_end) {
+                ok = false;
+                return 0;
+            }
+            m_acc |= (uint64_t) *m_p++ << m_n;
+            m_n += 8;
+        }
+
+        uint32_t v = m_acc & ((1u << n) - 1);
+        m_acc >>= n;
+        m_n -= n;
+
+        return v;
+    };
+
+    uint32_t get_golomb() {
+        int q = 0;
+        while (get(1) == 0) {
+            if (!ok || ++q > 24) {
+                ok = false;
+                return 0;
+            }
+        }
+
+        int n = q + KIFU_GOLOMB_K;
+        uint32_t w = (1u << n) | get(n);
+
+        return w - (1u << KIFU_GOLOMB_K);
+    };
+};
+
+static inline uint32_t zigzag(int v)
+{
+    return (v >= 0) ? (v << 1) : ((-v << 1) - 1);
+}
+
+static inline int unzigzag(uint32_t v)
+{
+    return (v & 1) ? -(int) ((v + 1) >> 1) : (int) (v >> 1);
+}
+
+static inline bool is_pass(const Move& m)
+{
+    return m.x == 20 && m.y == 20;
+}
+
+static inline int other(int cell)
+{
+    return (cell == CELL_BLACK) ? CELL_WHITE : CELL_BLACK;
+}
+
+// 盤にある石を置き石にする
+static void add_setup(const Board& board, std::vector<Move>& setup)
+{
+    int size = board.get_size();
+
+    for (int y = 1; y <= size; y++) {
+        for (int x = 1; x <= size; x++) {
+            int cell = board.get_cell(x, y);
+
+            if (cell == CELL_BLACK || cell == CELL_WHITE) {
+                setup.push_back(Move(cell, x, y));
+            }
+        }
+    }
+}
+
+void kifu_from_tree(std::shared_ptr<Node> root, KifuGame& game)
+{
+    game = KifuGame();
+    game.info.size = tree_size(root);
+
+    for (auto& p : root->properties) {
+        const std::string& id = p->id();
+
+        if (id == "PB") {
+            game.info.black = p->val();
+        } else if (id == "PW") {
+            game.info.white = p->val();
+        } else if (id == "RE") {
+            game.info.result = p->val();
+        } else if (id == "DT") {
+            game.info.date = p->val();
+        }
+    }
+
+    int n_moves = replay_main_line(root, [&game](const Board& board, const Move& next, int n) {
+        if (n == 0) {
+            add_setup(board, game.setup);
+        }
+
+        if (next.cell != CELL_SPACE) {
+            game.moves.push_back(next);
+        }
+
+        return true;
+    });
+
+    // 打てなかった手は残さない
+    game.moves.resize(n_moves);
+}
+
+// パスは(20, 20)なので"tt"になる
+static std::string sgf_point(int x, int y)
+{
+    return std::string(1, 'a' + x - 1) + std::string(1, 'a' + y - 1);
+}
+
+void write_kifu_sgf(std::ostream& os, const KifuGame& game)
+{
+    os << "(;GM[1]FF[4]SZ[" << game.info.size << "]";
+
+    if (game.info.black != "") {
+        os << "PB[" << game.info.black << "]";
+    }
+    if (game.info.white != "") {
+        os << "PW[" << game.info.white << "]";
+    }
+    if (game.info.result != "") {
+        os << "RE[" << game.info.result << "]";
+    }
+    if (game.info.date != "") {
+        os << "DT[" << game.info.date << "]";
+    }
+
+    for (int cell : {CELL_BLACK, CELL_WHITE}) {
+        bool first = true;
+
+        for (auto& m : game.setup) {
+            if (m.cell != cell) {
+                continue;
+            }
+            if (first) {
+                os << (cell == CELL_BLACK ? "AB" : "AW");
+                first = false;
+            }
+            os << "[" << sgf_point(m.x, m.y) << "]";
+        }
+    }
+
+    for (auto& m : game.moves) {
+        os << "\n;" << (m.cell == CELL_BLACK ? "B" : "W") << "[" << sgf_point(m.x, m.y) << "]";
+    }
+
+    os << ")" << std::endl;
+}
+
+static void put_string(std::vector<uint8_t>& buf, const std::string& s)
+{
+    size_t n = std::min(s.size(), (size_t) 255);
+
+    buf.push_back(n);
+    buf.insert(buf.end(), s.begin(), s.begin() + n);
+}
+
+static bool get_string(const uint8_t** p, const uint8_t* end, std::string* s)
+{
+    if (*p >= end || *p + 1 + **p > end) {
+        return false;
+    }
+
+    size_t n = **p;
+    if (s) {
+        s->assign((const char*) *p + 1, n);
+    }
+    *p += 1 + n;
+
+    return true;
+}
+
+static void encode(const KifuGame& game, uint32_t flags, std::vector<uint8_t>& buf)
+{
+    const std::vector<Move>& moves = game.moves;
+    int first = moves.empty() ? CELL_BLACK : moves[0].cell;
+
+    buf.push_back(game.info.size);
+    buf.push_back((first == CELL_WHITE) ? KIFU_WHITE_FIRST : 0);
+    buf.push_back(game.setup.size() & 0xff);
+    buf.push_back((game.setup.size() >> 8) & 0xff);
+    for (int i = 0; i < 4; i++) {
+        buf.push_back((moves.size() >> (i * 8)) & 0xff);
+    }
+
+    put_string(buf, game.info.black);
+    put_string(buf, game.info.white);
+    put_string(buf, game.info.result);
+    put_string(buf, game.info.date);
+
+    BitWriter bw(buf);
+
+    for (auto& m : game.setup) {
+        bw.put(m.cell == CELL_WHITE, 1);
+        bw.put((m.y - 1) * KIFU_STRIDE + (m.x - 1), 9);
+    }
+
+    int turn = first;
+    int px = (game.info.size + 1) / 2;
+    int py = px;
+
+    for (auto& m : moves) {
+        bool escape = (m.cell != turn);
+
+        if (flags & KIFU_ENTROPY) {
+            if (escape) {
+                bw.put_golomb(1);
+            }
+
+            if (is_pass(m)) {
+                bw.put_golomb(0);
+            } else {
+                bw.put_golomb(2 + zigzag(m.x - px));
+                bw.put_golomb(zigzag(m.y - py));
+                px = m.x;
+                py = m.y;
+            }
+        } else {
+            if (escape) {
+                bw.put(KIFU_ESCAPE, 9);
+            }
+
+            bw.put(is_pass(m) ? KIFU_PASS : (m.y - 1) * KIFU_STRIDE + (m.x - 1), 9);
+        }
+
+        turn = other(m.cell);
+    }
+
+    bw.flush();
+}
+
+bool KifuWriter::open(const std::string& file, uint32_t flags)
+{
+    m_file = file;
+    m_flags = flags;
+    m_offsets.clear();
+    m_n_moves = 0;
+
+    std::string tmp = file + ".tmp";
+    m_ofs.open(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!m_ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    // 最後に書き直す
+    KifuHeader hd = {};
+    m_ofs.write((const char*) &hd, sizeof(hd));
+
+    return true;
+}
+
+bool KifuWriter::add(const KifuGame& game)
+{
+    if (game.info.size < 1 || game.info.size > MAX_BOARD_SIZE || game.setup.size() > 0xffff) {
+        return false;
+    }
+
+    std::vector<uint8_t> buf;
+    encode(game, m_flags, buf);
+
+    m_offsets.push_back(m_ofs.tellp());
+    m_ofs.write((const char*) buf.data(), buf.size());
+    m_n_moves += game.moves.size();
+
+    return true;
+}
+
+bool KifuWriter::add_file(const std::string& file)
+{
+    std::vector<std::shared_ptr<Node>> trees;
+
+    if (!load_trees(file, trees)) {
+        return false;
+    }
+
+    for (auto& t : trees) {
+        KifuGame game;
+        kifu_from_tree(t, game);
+        add(game);
+    }
+
+    return true;
+}
+
+bool KifuWriter::close()
+{
+    std::string tmp = m_file + ".tmp";
+
+    KifuHeader hd;
+    memcpy(hd.magic, "GOQK", 4);
+    hd.version = KIFU_STORE_VERSION;
+    hd.flags = m_flags;
+    hd.reserved = 0;
+    hd.n_games = m_offsets.size();
+
+    // mmapしてそのまま読めるように、位置表は8バイト境界から
+    while (m_ofs.tellp() % sizeof(uint64_t) != 0) {
+        m_ofs.put(0);
+    }
+    hd.index_off = m_ofs.tellp();
+
+    m_offsets.push_back(hd.index_off);
+    m_ofs.write((const char*) m_offsets.data(), m_offsets.size() * sizeof(uint64_t));
+    m_offsets.pop_back();
+
+    m_ofs.seekp(0);
+    m_ofs.write((const char*) &hd, sizeof(hd));
+    m_ofs.close();
+
+    if (!m_ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    if (rename(tmp.c_str(), m_file.c_str()) != 0) {
+        std::cerr << "Error: couldn't rename file: " << tmp << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void KifuReader::close()
+{
+    m_file.close();
+    m_flags = 0;
+    m_index = nullptr;
+    m_n_games = 0;
+}
+
+bool KifuReader::open(const std::string& file)
+{
+    close();
+
+    if (!m_file.open(file)) {
+        return false;
+    }
+
+    const char* base = m_file.data();
+    size_t len = m_file.size();
+    const KifuHeader* h = (const KifuHeader*) base;
+
+    if (len < sizeof(KifuHeader) || memcmp(h->magic, "GOQK", 4) != 0 || h->version != KIFU_STORE_VERSION
+            || h->index_off > len || (len - h->index_off) / sizeof(uint64_t) < h->n_games + 1
+            || h->index_off % sizeof(uint64_t) != 0) {
+        std::cerr << "Error: broken kifu file: " << file << std::endl;
+        close();
+        return false;
+    }
+
+    m_flags = h->flags;
+    m_index = (const uint64_t*) (base + h->index_off);
+    m_n_games = h->n_games;
+
+    return true;
+}
+
+bool KifuReader::record(uint64_t id, const uint8_t** p, const uint8_t** end) const
+{
+    if (id >= m_n_games) {
+        return false;
+    }
+
+    uint64_t begin = m_index[id];
+    uint64_t last = m_index[id + 1];
+
+    if (begin < sizeof(KifuHeader) || begin + 8 > last || last > m_file.size()) {
+        return false;
+    }
+
+    *p = (const uint8_t*) m_file.data() + begin;
+    *end = (const uint8_t*) m_file.data() + last;
+
+    return true;
+}
+
+uint64_t KifuReader::game_bytes(uint64_t id) const
+{
+    const uint8_t* p;
+    const uint8_t* end;
+
+    return record(id, &p, &end) ? end - p : 0;
+}
+
+bool KifuReader::read_info(uint64_t id, KifuInfo& info) const
+{
+    const uint8_t* p;
+    const uint8_t* end;
+
+    if (!record(id, &p, &end)) {
+        return false;
+    }
+
+    info.size = p[0];
+    p += 8;
+
+    return get_string(&p, end, &info.black) && get_string(&p, end, &info.white)
+        && get_string(&p, end, &info.result) && get_string(&p, end, &info.date);
+}
+
+bool KifuReader::read(uint64_t id, KifuGame& game) const
+{
+    game = KifuGame();
+
+    if (!read_info(id, game.info)) {
+        return false;
+    }
+
+    return replay(id, [&game](const Board& board, const Move& next, int n) {
+        if (n == 0) {
+            add_setup(board, game.setup);
+        }
+        if (next.cell != CELL_SPACE) {
+            game.moves.push_back(next);
+        }
+        return true;
+    }) >= 0;
+}
+
+int KifuReader::replay(uint64_t id, const ReplayFn& fn) const
+{
+    PROF_SCOPE("kifu_store.replay");
+
+    const uint8_t* p;
+    const uint8_t* end;
+
+    if (!record(id, &p, &end)) {
+        return -1;
+    }
+
+    int size = p[0];
+    int turn = (p[1] & KIFU_WHITE_FIRST) ? CELL_WHITE : CELL_BLACK;
+    int n_setup = p[2] | (p[3] << 8);
+    uint32_t n_moves = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t) p[7] << 24);
+    p += 8;
+
+    if (size < 1 || size > MAX_BOARD_SIZE) {
+        return -1;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (!get_string(&p, end, nullptr)) {
+            return -1;
+        }
+    }
+
+    Board board(size);
+    BitReader br(p, end);
+
+    for (int i = 0; i < n_setup; i++) {
+        int cell = br.get(1) ? CELL_WHITE : CELL_BLACK;
+        int v = br.get(9);
+        int x = v % KIFU_STRIDE + 1;
+        int y = v / KIFU_STRIDE + 1;
+
+        if (!br.ok || board.is_out(x, y)) {
+            return -1;
+        }
+
+        board.set_cell(cell, x, y);
+    }
+
+    bool entropy = (m_flags & KIFU_ENTROPY) != 0;
+    int px = (size + 1) / 2;
+    int py = px;
+    std::list<Move> hama;
+    uint32_t n = 0;
+
+    for (; n < n_moves; n++) {
+        Move move(turn, 20, 20);
+
+        if (entropy) {
+            uint32_t v = br.get_golomb();
+            if (v == 1) {
+                move.cell = other(turn);
+                v = br.get_golomb();
+            }
+
+            if (v >= 2) {
+                px += unzigzag(v - 2);
+                py += unzigzag(br.get_golomb());
+                move.x = px;
+                move.y = py;
+            }
+        } else {
+            uint32_t v = br.get(9);
+            if (v == KIFU_ESCAPE) {
+                move.cell = other(turn);
+                v = br.get(9);
+            }
+
+            if (v < KIFU_PASS) {
+                move.x = v % KIFU_STRIDE + 1;
+                move.y = v / KIFU_STRIDE + 1;
+            } else if (v != KIFU_PASS) {
+                return -1;
+            }
+        }
+
+        if (!br.ok || (!is_pass(move) && board.is_out(move.x, move.y))) {
+            return -1;
+        }
+
+        if (!fn(board, move, n)) {
+            return n;
+        }
+
+        hama.clear();
+        if (!board.make_move(move.cell, move.x, move.y, hama)) {
+            return n;
+        }
+
+        turn = other(move.cell);
+    }
+
+    fn(board, Move(), n);
+
+    return n;
+}
@@ -0,0 +1,127 @@
+#ifndef KIFU_STORE_H
+#define KIFU_STORE_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "board.h"
+#include "mapped_file.h"
+#include "replay.h"
+
+class Node;
+
+// 棋譜をまとめて詰めて持つファイル。SGFの本手順だけを持ち、分岐・コメントは捨てる。
+//
+// ファイルの形式（リトルエンディアン）:
+//   KifuHeader
+//   棋譜 n_games個
+//   （8バイト境界まで0で埋める）
+//   u64 n_games + 1個（各棋譜の先頭の位置。最後は位置表そのものの位置）
+//
+// 棋譜:
+//   u8 盤の大きさ, u8 KIFU_WHITE_FIRST など, u16 置き石の数, u32 手数
+//   PB, PW, RE, DT [u8 長さ][バイト列]（255バイトまで）
+//   ビット列（下位ビットから詰める）
+//     置き石: [1ビット 色][9ビット 位置] を置き石の数だけ
+//     手: 色は最初の手の色と手数から決まる（交互に打つ）。
+//         手番どおりでない手だけ、前にエスケープを付ける
+//
+// 手の符号は2通り:
+//   そのまま     9ビット。0-360 が (y-1)*19+(x-1)、KIFU_PASS、KIFU_ESCAPE
+//   KIFU_ENTROPY 前の手からの差 dx, dy を指数ゴロム符号にする。
+//                近くに打つことが多いので、1手あたり9ビットより短くなる
+//
+// 読むときはmmapして、棋譜の番号から位置表で直接そこを読む
+
+#define KIFU_STORE_VERSION (1)
+
+#define KIFU_PASS (361)
+#define KIFU_ESCAPE (362)  // 次の手は手番どおりでない
+
+enum {
+    KIFU_ENTROPY = 0x01,  // 手を差分と指数ゴロム符号で持つ
+};
+
+// 棋譜ごとのフラグ
+enum {
+    KIFU_WHITE_FIRST = 0x01,  // 最初の手が白
+};
+
+struct KifuHeader
+{
+    char magic[4];  // "GOQK"
+    uint32_t version;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t n_games;
+    uint64_t index_off;
+};
+
+struct KifuInfo
+{
+    int size = MAX_BOARD_SIZE;
+    std::string black;   // PB
+    std::string white;   // PW
+    std::string result;  // RE
+    std::string date;    // DT
+};
+
+struct KifuGame
+{
+    KifuInfo info;
+    std::vector<Move> setup;  // 最初の手の前に盤にある石
+    std::vector<Move> moves;  // パスは(20, 20)
+};
+
+// SGFの木の本手順をKifuGameにする。途中のAB/AW/AEは最初の手の前のものだけ置き石として残す
+void kifu_from_tree(std::shared_ptr<Node> root, KifuGame& game);
+// kifu_from_tree()の逆。分岐のないSGFを書く
+void write_kifu_sgf(std::ostream& os, const KifuGame& game);
+
+class KifuWriter
+{
+    std::string m_file;
+    std::ofstream m_ofs;
+    uint32_t m_flags = 0;
+    std::vector<uint64_t> m_offsets;
+    uint64_t m_n_moves = 0;
+public:
+    bool open(const std::string& file, uint32_t flags = 0);
+    // 索引を書いて閉じる。閉じるまで元のファイルは変えない
+    bool close();
+
+    bool add(const KifuGame& game);
+    bool add_file(const std::string& file);
+
+    uint64_t n_games() const { return m_offsets.size(); };
+    uint64_t n_moves() const { return m_n_moves; };
+};
+
+class KifuReader
+{
+    MappedFile m_file;
+    uint32_t m_flags = 0;
+    const uint64_t* m_index = nullptr;
+    uint64_t m_n_games = 0;
+
+    bool record(uint64_t id, const uint8_t** p, const uint8_t** end) const;
+public:
+    bool open(const std::string& file);
+    void close();
+
+    uint64_t n_games() const { return m_n_games; };
+    uint32_t flags() const { return m_flags; };
+    // 棋譜の大きさ（バイト）
+    uint64_t game_bytes(uint64_t id) const;
+
+    bool read_info(uint64_t id, KifuInfo& info) const;
+    bool read(uint64_t id, KifuGame& game) const;
+
+    // 手を1つずつ読みながら盤に打ち、replay_main_line()と同じようにfnを呼ぶ。
+    // KifuGameは作らない。打った手数を返し、壊れていれば-1
+    int replay(uint64_t id, const ReplayFn& fn) const;
+};
+
+#endif
@@ -1,3 +1,6 @@
+#include <unistd.h>
+#include <algorithm>
+#include <random>
 #include <wx/wxprec.h>
 #ifndef WX_PRECOMP
     #include <wx/wx.h>
@@ -6,14 +9,43 @@
 
 #include "g.h"
 #include "frame.h"
+#include "board_window.h"
+#include "input_trace.h"
+#include "journal.h"
+#include "manifest.h"
+#include "problem_table.h"
+#include "prof.h"
+#include "trace.h"
 
 class MyApp : public wxApp
 {
     MyFrame *frame;
 
     std::list<std::string> m_files;
+    std::list<std::string> m_dirs;
     std::string m_wrong;
     std::string m_kifu;
+    std::string m_journal;
+    std::string m_index;
+    std::string m_trie;
+    std::string m_comments;
+
+    // 問題の属性の表で絞り込み・並べ替えて解く
+    std::string m_meta;
+    std::string m_filter;
+    std::string m_sort;
+
+    // 入力の記録と再生
+    std::string m_record;
+    std::string m_replay;
+    bool m_realtime = false;
+
+    bool m_watch = true;
+    InputRecorder m_recorder;
+    std::unique_ptr<InputReplay> m_input_replay;
+
+    void scan_dirs(std::vector<std::pair<std::string, int>>& queue);
+    bool load_queue(G* g, const std::vector<std::pair<std::string, int>>& dir_queue);
 public:
     virtual bool OnInit();
     virtual void OnInitCmdLine(wxCmdLineParser& parser);
@@ -24,6 +56,9 @@ wxIMPLEMENT_APP(MyApp);
 
 bool MyApp::OnInit()
 {
+    prof_init();
+    trace_init();
+
     if (!wxApp::OnInit())
         return false;
 
@@ -33,10 +68,20 @@ bool MyApp::OnInit()
 
     frame = new MyFrame(*g, m_wrong);
 
+    std::vector<std::pair<std::string, int>> dir_queue;
+    scan_dirs(dir_queue);
+
     if (m_kifu != "") {
         g->load(Gmode::KIFU, m_kifu);
+    } else if (m_meta != "") {
+        load_queue(g, dir_queue);
     } else {
-        bool is_append = false;
+        // ディレクトリの棋譜は解く番になってから読む
+        std::random_device rd;
+        std::mt19937 generator(rd());
+        std::shuffle(dir_queue.begin(), dir_queue.end(), generator);
+
+        bool is_append = g->load_lazy(Gmode::SOLVE, dir_queue);
         for (auto f : m_files) {
             if (g->load(Gmode::SOLVE, f, is_append)) {
                 is_append = true;
@@ -44,21 +89,171 @@ bool MyApp::OnInit()
         }
     }
 
+    if (m_watch && frame->start_watching()) {
+        if (m_kifu != "") {
+            frame->watch_file(m_kifu);
+        }
+        for (auto& f : m_files) {
+            frame->watch_file(f);
+        }
+        for (auto& q : dir_queue) {
+            if (q.second == 0) {
+                frame->watch_file(q.first);
+            }
+        }
+    }
+
+    // 問題作成の記録。前回の続きから始める。
+    // ファイルを開いたときは、前回の記録を上書きしないように使わない
+    if (m_journal != "") {
+        if (m_kifu == "" && m_files.empty() && m_dirs.empty()) {
+            Journal* journal = new Journal(*g, m_journal);
+            journal->recover();
+
+            if (journal->compact()) {
+                g->add_listener(journal);
+            }
+        } else {
+            std::cerr << "journal: not used when opening files" << std::endl;
+        }
+    }
+
+    if (m_index != "") {
+        frame->open_pos_index(m_index);
+    }
+
+    if (m_trie != "") {
+        frame->open_opening_trie(m_trie);
+    }
+
+    if (m_comments != "") {
+        frame->open_comment_index(m_comments);
+    }
+
     if (g->current().get_mode() != Gmode::SOLVE) {
-        frame->on_tree(g->current());
+        frame->on_tree(g->current(), TreeEvent::RESET, nullptr);
     }
 
+    // ここからはGはモデルのスレッドが持つ
+    frame->start_model();
+
     frame->Show(true);
 
+    BoardWindow* win = frame->get_board_window();
+
+    if (m_record != "" && m_recorder.open(m_record, win->get_width())) {
+        win->set_recorder(&m_recorder);
+    }
+
+    if (m_replay != "") {
+        std::vector<InputEvent> events;
+        int width = 0;
+
+        if (load_input_trace(m_replay, events, width)) {
+            m_input_replay.reset(new InputReplay(win, events, width, m_realtime));
+            m_input_replay->start();
+        }
+    }
+
     return true;
 }
 
+// ディレクトリの下のSGFを目録で調べ、すべての棋譜を（ファイル名, 何番目か）で並べる。
+// 目録はディレクトリに置き、変わったファイルだけを読み直す
+void MyApp::scan_dirs(std::vector<std::pair<std::string, int>>& queue)
+{
+    for (auto& dir : m_dirs) {
+        std::string file = dir + "/" + MANIFEST_NAME;
+        Manifest manifest;
+
+        if (access(file.c_str(), F_OK) == 0) {
+            manifest.load(file);
+        }
+
+        manifest.update(dir);
+        manifest.save(file);
+
+        for (auto& e : manifest.entries()) {
+            for (uint32_t i = 0; i < e.n_games; i++) {
+                queue.push_back(std::make_pair(e.path, i));
+            }
+        }
+
+        std::cerr << dir << ": " << manifest.entries().size() << " files, " << manifest.n_games() << " games, "
+            << manifest.n_parsed() << " parsed" << std::endl;
+    }
+}
+
+// 表を今のファイルに合わせてから絞り込み、残った問題を解く順に並べる。
+// 並べ替えの指定がなければ順番はいつもどおりばらばらにする
+bool MyApp::load_queue(G* g, const std::vector<std::pair<std::string, int>>& dir_queue)
+{
+    ProblemTable table;
+    ProblemFilter filter;
+
+    if (!filter.parse(m_filter)) {
+        std::cerr << "Error: bad filter: " << m_filter << std::endl;
+        return false;
+    }
+
+    if (access(m_meta.c_str(), F_OK) == 0) {
+        table.load(m_meta);
+    }
+
+    std::vector<std::string> files(m_files.begin(), m_files.end());
+    for (auto& q : dir_queue) {
+        if (q.second == 0) {
+            files.push_back(q.first);
+        }
+    }
+
+    table.update(files);
+    table.save(m_meta);
+
+    std::string key = m_sort;
+    bool desc = (key != "" && key[0] == '-');
+    if (desc) {
+        key = key.substr(1);
+    }
+
+    std::vector<uint32_t> rows;
+    if (!table.query(filter, key, desc, rows)) {
+        std::cerr << "Error: unknown column: " << key << std::endl;
+        return false;
+    }
+
+    std::vector<std::pair<std::string, int>> queue = table.to_queue(rows);
+
+    if (key == "") {
+        std::random_device rd;
+        std::mt19937 generator(rd());
+        std::shuffle(queue.begin(), queue.end(), generator);
+    }
+
+    std::cerr << queue.size() << " / " << table.n_rows() << " problems" << std::endl;
+
+    return g->load_lazy(Gmode::SOLVE, queue);
+}
+
 void MyApp::OnInitCmdLine(wxCmdLineParser& parser)
 {
     parser.SetSwitchChars (wxT("-"));
-    parser.AddParam("sgf", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE);
+    parser.AddParam("sgf or directory", wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE);
     parser.AddOption("w", "wrong", "", wxCMD_LINE_VAL_STRING);
     parser.AddOption("k", "kifu", "", wxCMD_LINE_VAL_STRING);
+    parser.AddLongSwitch("prof", "print timing histograms at exit");
+    parser.AddLongOption("trace", "write a Chrome trace JSON at exit", wxCMD_LINE_VAL_STRING);
+    parser.AddOption("j", "journal", "journal file for crash recovery", wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption("index", "position index for the F key (goq-index build)", wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption("trie", "opening trie for next-move hints (goq-index trie)", wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption("comments", "comment index for the S key (goq-index comments)", wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption("meta", "problem table cache; select problems with --filter and --sort", wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption("filter", "e.g. size=9,play=B,stones<12,region=corner", wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption("sort", "size, stones, depth, correct or difficulty (-column for descending)", wxCMD_LINE_VAL_STRING);
+    parser.AddLongSwitch("no-watch", "don't reload files changed by other programs");
+    parser.AddLongOption("record", "record board input to a file", wxCMD_LINE_VAL_STRING);
+    parser.AddLongOption("replay", "replay recorded board input and report latency", wxCMD_LINE_VAL_STRING);
+    parser.AddLongSwitch("realtime", "replay with the recorded timing");
 }
 
 bool MyApp::OnCmdLineParsed(wxCmdLineParser& parser)
@@ -66,7 +261,15 @@ bool MyApp::OnCmdLineParsed(wxCmdLineParser& parser)
     for (int i = 0; i < (int) parser.GetParamCount(); i++)
     {
         wxString s = parser.GetParam(i);
-        m_files.push_back(std::string(s.mb_str()));
+        std::string file = std::string(s.mb_str());
+
+        struct stat st;
+
+        if (stat(file.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            m_dirs.push_back(file);
+        } else {
+            m_files.push_back(file);
+        }
     }
 
     wxString wx_wrong;
@@ -80,6 +283,64 @@ bool MyApp::OnCmdLineParsed(wxCmdLineParser& parser)
         }
     }
 
+    if (parser.Found("prof")) {
+        prof_enable();
+    }
+
+    wxString wx_trace;
+    if (parser.Found("trace", &wx_trace)) {
+        trace_enable(std::string(wx_trace.mb_str()));
+    }
+
+    wxString wx_journal;
+    if (parser.Found("j", &wx_journal)) {
+        m_journal = std::string(wx_journal.mb_str());
+    }
+
+    wxString wx_index;
+    if (parser.Found("index", &wx_index)) {
+        m_index = std::string(wx_index.mb_str());
+    }
+
+    wxString wx_trie;
+    if (parser.Found("trie", &wx_trie)) {
+        m_trie = std::string(wx_trie.mb_str());
+    }
+
+    wxString wx_comments;
+    if (parser.Found("comments", &wx_comments)) {
+        m_comments = std::string(wx_comments.mb_str());
+    }
+
+    wxString wx_meta;
+    if (parser.Found("meta", &wx_meta)) {
+        m_meta = std::string(wx_meta.mb_str());
+    }
+
+    wxString wx_filter;
+    if (parser.Found("filter", &wx_filter)) {
+        m_filter = std::string(wx_filter.mb_str());
+    }
+
+    wxString wx_sort;
+    if (parser.Found("sort", &wx_sort)) {
+        m_sort = std::string(wx_sort.mb_str());
+    }
+
+    wxString wx_record;
+    if (parser.Found("record", &wx_record)) {
+        m_record = std::string(wx_record.mb_str());
+    }
+
+    wxString wx_replay;
+    if (parser.Found("replay", &wx_replay)) {
+        m_replay = std::string(wx_replay.mb_str());
+    }
+
+    m_realtime = parser.Found("realtime");
+
+    m_watch = !parser.Found("no-watch");
+
     wxString wx_kifu;
     if (parser.Found("k", &wx_kifu)) {
         std::string kifu = std::string(wx_kifu.mb_str());
@@ -0,0 +1,379 @@
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include "manifest.h"
+#include "node.h"
+#include "prof.h"
+#include "replay.h"
+
+static bool is_sgf(const std::string& name)
+{
+    if (name.size() < 4) {
+        return false;
+    }
+
+    std::string ext = name.substr(name.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    return ext == ".sgf";
+}
+
+static bool list_dir(const std::string& dir, std::vector<std::string>& files)
+{
+    DIR* dp = opendir(dir.c_str());
+
+    if (dp == nullptr) {
+        std::cerr << "Error: couldn't open directory: " << dir << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    struct dirent* ent;
+
+    while ((ent = readdir(dp)) != nullptr) {
+        // . と .. と隠しファイル（目録も）は見ない
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        std::string path = dir + "/" + ent->d_name;
+        bool is_dir = (ent->d_type == DT_DIR);
+
+        // d_typeがわからないファイルシステムではstatする
+        if (ent->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_dir = (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+        }
+
+        if (is_dir) {
+            ok = list_dir(path, files) && ok;
+        } else if (is_sgf(ent->d_name)) {
+            files.push_back(path);
+        }
+    }
+
+    closedir(dp);
+
+    return ok;
+}
+
+bool list_sgf_files(const std::string& dir, std::vector<std::string>& files)
+{
+    PROF_SCOPE("manifest.list");
+
+    std::string d = dir;
+    while (d.size() > 1 && d.back() == '/') {
+        d.pop_back();
+    }
+
+    size_t first = files.size();
+    bool ok = list_dir(d, files);
+    std::sort(files.begin() + first, files.end());
+
+    return ok;
+}
+
+static uint64_t fnv1a(const std::string& s)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+static bool read_all(const std::string& file, std::string& s)
+{
+    std::ifstream ifs(file, std::ios::in | std::ios::binary);
+
+    if (!ifs) {
+        std::cerr << "Error: couldn't open file: " << file << std::endl;
+        return false;
+    }
+
+    std::ostringstream os;
+    os << ifs.rdbuf();
+    s = os.str();
+
+    return true;
+}
+
+// 中身を解析して棋譜の数と最初の棋譜の情報を入れる
+static void parse_entry(const std::string& text, ManifestEntry& e)
+{
+    std::istringstream is(text);
+    std::vector<std::shared_ptr<Node>> trees;
+
+    e.n_games = 0;
+
+    if (!load_trees(is, trees)) {
+        std::cerr << "Error: not found '('. file = " << e.path << std::endl;
+        return;
+    }
+
+    e.n_games = trees.size();
+    e.board_size = tree_size(trees[0]);
+
+    for (auto& p : trees[0]->properties) {
+        const std::string& id = p->id();
+
+        if (id == "PB") {
+            e.black = p->val();
+        } else if (id == "PW") {
+            e.white = p->val();
+        } else if (id == "RE") {
+            e.result = p->val();
+        } else if (id == "DT") {
+            e.date = p->val();
+        } else if (id == "GN") {
+            e.name = p->val();
+        }
+    }
+}
+
+// update()の1ファイル分。0: 引き継いだ、1: ハッシュが同じだった、2: 解析した、-1: 読めなかった
+static int scan_file(const std::string& path, const ManifestEntry* old, ManifestEntry& e)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0) {
+        std::cerr << "Error: couldn't open file: " << path << ": " << strerror(errno) << std::endl;
+        return -1;
+    }
+
+    int64_t mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+    if (old && old->mtime == mtime && old->size == (uint64_t) st.st_size) {
+        e = *old;
+        return 0;
+    }
+
+    std::string text;
+    if (!read_all(path, text)) {
+        return -1;
+    }
+
+    uint64_t hash = fnv1a(text);
+
+    // 触っただけなら中身は同じ
+    if (old && old->size == text.size() && old->hash == hash) {
+        e = *old;
+        e.mtime = mtime;
+        return 1;
+    }
+
+    e = ManifestEntry();
+    e.path = path;
+    e.mtime = mtime;
+    e.size = text.size();
+    e.hash = hash;
+    parse_entry(text, e);
+
+    return 2;
+}
+
+bool Manifest::update(const std::string& dir, int n_threads)
+{
+    PROF_SCOPE("manifest.update");
+
+    std::vector<std::string> files;
+    bool ok = list_sgf_files(dir, files);
+
+    std::map<std::string, const ManifestEntry*> old;
+    for (auto& e : m_entries) {
+        old[e.path] = &e;
+    }
+
+    if (n_threads <= 0) {
+        n_threads = std::thread::hardware_concurrency();
+    }
+    if (n_threads > (int) files.size()) {
+        n_threads = files.size();
+    }
+
+    std::vector<ManifestEntry> entries(files.size());
+    std::vector<int> results(files.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+
+    // ほとんどのファイルはstatだけで済むので、ファイル単位で配る
+    for (int i = 0; i < n_threads; i++) {
+        threads.emplace_back([&]() {
+            for (size_t k = next++; k < files.size(); k = next++) {
+                auto itr = old.find(files[k]);
+                results[k] = scan_file(files[k], itr != old.end() ? itr->second : nullptr, entries[k]);
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::vector<ManifestEntry> updated;
+    m_n_parsed = m_n_hashed = m_n_reused = 0;
+
+    for (size_t k = 0; k < files.size(); k++) {
+        switch (results[k]) {
+        case 0:
+            m_n_reused++;
+            break;
+        case 1:
+            m_n_hashed++;
+            break;
+        case 2:
+            m_n_parsed++;
+            break;
+        default:
+            ok = false;
+            continue;
+        }
+
+        updated.push_back(std::move(entries[k]));
+    }
+
+    std::swap(m_entries, updated);
+
+    return ok;
+}
+
+uint64_t Manifest::n_games() const
+{
+    uint64_t n = 0;
+
+    for (auto& e : m_entries) {
+        n += e.n_games;
+    }
+
+    return n;
+}
+
+static void write_str8(std::ostream& os, const std::string& s)
+{
+    uint8_t len = std::min(s.size(), (size_t) 255);
+
+    os.write((const char*) &len, sizeof(len));
+    os.write(s.data(), len);
+}
+
+static bool read_str8(std::istream& is, std::string& s)
+{
+    uint8_t len = 0;
+
+    is.read((char*) &len, sizeof(len));
+    s.resize(is ? len : 0);
+    is.read(&s[0], s.size());
+
+    return (bool) is;
+}
+
+bool Manifest::save(const std::string& file)
+{
+    std::string tmp = file + ".tmp";
+    std::ofstream ofs(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    uint32_t version = MANIFEST_VERSION;
+    uint64_t n = m_entries.size();
+
+    ofs.write("GOQF", 4);
+    ofs.write((const char*) &version, sizeof(version));
+    ofs.write((const char*) &n, sizeof(n));
+
+    for (auto& e : m_entries) {
+        uint32_t len = e.path.size();
+        uint8_t board_size = e.board_size;
+
+        ofs.write((const char*) &len, sizeof(len));
+        ofs.write(e.path.data(), len);
+        ofs.write((const char*) &e.mtime, sizeof(e.mtime));
+        ofs.write((const char*) &e.size, sizeof(e.size));
+        ofs.write((const char*) &e.hash, sizeof(e.hash));
+        ofs.write((const char*) &e.n_games, sizeof(e.n_games));
+        ofs.write((const char*) &board_size, sizeof(board_size));
+        write_str8(ofs, e.black);
+        write_str8(ofs, e.white);
+        write_str8(ofs, e.result);
+        write_str8(ofs, e.date);
+        write_str8(ofs, e.name);
+    }
+
+    ofs.close();
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    if (rename(tmp.c_str(), file.c_str()) != 0) {
+        std::cerr << "Error: couldn't rename file: " << tmp << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool Manifest::load(const std::string& file)
+{
+    std::ifstream ifs(file, std::ios::in | std::ios::binary);
+
+    if (!ifs) {
+        std::cerr << "Error: couldn't open file: " << file << std::endl;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint64_t n = 0;
+
+    ifs.read(magic, 4);
+    ifs.read((char*) &version, sizeof(version));
+    ifs.read((char*) &n, sizeof(n));
+
+    std::vector<ManifestEntry> entries;
+    bool ok = ifs && memcmp(magic, "GOQF", 4) == 0 && version == MANIFEST_VERSION;
+
+    for (uint64_t i = 0; ok && i < n; i++) {
+        ManifestEntry e;
+        uint32_t len = 0;
+        uint8_t board_size = 0;
+
+        ifs.read((char*) &len, sizeof(len));
+        e.path.resize(ifs ? len : 0);
+        ifs.read(&e.path[0], e.path.size());
+        ifs.read((char*) &e.mtime, sizeof(e.mtime));
+        ifs.read((char*) &e.size, sizeof(e.size));
+        ifs.read((char*) &e.hash, sizeof(e.hash));
+        ifs.read((char*) &e.n_games, sizeof(e.n_games));
+        ifs.read((char*) &board_size, sizeof(board_size));
+        e.board_size = board_size;
+
+        ok = ifs && read_str8(ifs, e.black) && read_str8(ifs, e.white) && read_str8(ifs, e.result)
+            && read_str8(ifs, e.date) && read_str8(ifs, e.name);
+        entries.push_back(std::move(e));
+    }
+
+    if (!ok) {
+        std::cerr << "Error: broken manifest: " << file << std::endl;
+        return false;
+    }
+
+    std::swap(m_entries, entries);
+
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ディレクトリの下のSGFファイルの目録。ファイルごとに大きさ・更新時刻・中身のハッシュ・
+// 棋譜の数と最初の棋譜の情報を持ち、ファイルに保存する。
+// 開き直すときは並列にstatするだけで、大きさか更新時刻が変わったファイルだけを読む。
+// 更新時刻だけが変わっても、中身のハッシュが同じなら解析し直さない
+//
+// ファイルの形式（リトルエンディアン）:
+//   "GOQF" u32 version u64 n_entries
+//   エントリ n_entries個
+//     [u32 長さ][パス][i64 更新時刻（ナノ秒）][u64 大きさ][u64 ハッシュ][u32 棋譜の数][u8 盤の大きさ]
+//     [u8 長さ][バイト列] をPB, PW, RE, DT, GNの順に
+
+#define MANIFEST_VERSION (1)
+
+// ディレクトリを開いたときに目録を置くファイル名
+#define MANIFEST_NAME ".goq-manifest"
+
+struct ManifestEntry
+{
+    std::string path;
+    int64_t mtime = 0;  // ナノ秒
+    uint64_t size = 0;
+    uint64_t hash = 0;  // 中身のFNV-1a
+    uint32_t n_games = 0;  // 読めなかったファイルは0
+
+    // 最初の棋譜の情報
+    int board_size = 0;
+    std::string black;   // PB
+    std::string white;   // PW
+    std::string result;  // RE
+    std::string date;    // DT
+    std::string name;    // GN
+};
+
+// dirの下（サブディレクトリも）の.sgfファイルを名前の順にfilesに入れる
+bool list_sgf_files(const std::string& dir, std::vector<std::string>& files);
+
+class Manifest
+{
+    std::vector<ManifestEntry> m_entries;
+    size_t m_n_parsed = 0;
+    size_t m_n_hashed = 0;  // 更新時刻だけが変わっていたもの
+    size_t m_n_reused = 0;
+public:
+    bool load(const std::string& file);
+    bool save(const std::string& file);
+
+    // dirの下のファイルに合わせる。前の目録（load()したもの）から変わっていないファイルは引き継ぐ。
+    // n_threadsが0ならCPUの数
+    bool update(const std::string& dir, int n_threads = 0);
+
+    const std::vector<ManifestEntry>& entries() const { return m_entries; };
+    uint64_t n_games() const;
+
+    size_t n_parsed() const { return m_n_parsed; };
+    size_t n_hashed() const { return m_n_hashed; };
+    size_t n_reused() const { return m_n_reused; };
+};
+
+#endif
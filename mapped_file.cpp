@@ -0,0 +1,63 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include "mapped_file.h"
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::close()
+{
+    if (m_map) {
+        munmap(m_map, m_len);
+        m_map = nullptr;
+    }
+
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    m_len = 0;
+}
+
+bool MappedFile::open(const std::string& file, bool random_access)
+{
+    close();
+
+    m_fd = ::open(file.c_str(), O_RDONLY);
+
+    if (m_fd == -1) {
+        std::cerr << "Error: couldn't open file: " << file << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || st.st_size == 0) {
+        std::cerr << "Error: empty file: " << file << std::endl;
+        close();
+        return false;
+    }
+
+    m_len = st.st_size;
+    m_map = mmap(nullptr, m_len, PROT_READ, MAP_SHARED, m_fd, 0);
+
+    if (m_map == MAP_FAILED) {
+        m_map = nullptr;
+        std::cerr << "Error: couldn't mmap file: " << file << ": " << strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    if (random_access) {
+        madvise(m_map, m_len, MADV_RANDOM);
+    }
+
+    return true;
+}
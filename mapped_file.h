@@ -0,0 +1,29 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// 読み込み専用でmmapしたファイル。索引を読むのに使う
+class MappedFile
+{
+    int m_fd = -1;
+    void* m_map = nullptr;
+    size_t m_len = 0;
+public:
+    MappedFile() {};
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // random_accessなら先読みしないようにカーネルに伝える
+    bool open(const std::string& file, bool random_access = true);
+    void close();
+
+    bool is_open() const { return m_map != nullptr; };
+    const char* data() const { return (const char*) m_map; };
+    size_t size() const { return m_len; };
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "model_thread.h"
+#include "g.h"
+#include "prof.h"
+#include "trace.h"
+
+ModelThread::ModelThread(G& g, PublishFn fn)
+    : m_g(g), m_publish(fn), m_queue(MODEL_QUEUE_SIZE)
+{
+}
+
+ModelThread::~ModelThread()
+{
+    stop();
+}
+
+void ModelThread::start()
+{
+    publish();
+
+    m_thread = std::thread(&ModelThread::run, this);
+}
+
+void ModelThread::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+
+    m_thread.join();
+}
+
+void ModelThread::post(ModelCommand cmd)
+{
+    PROF_COUNT("model.post", 1);
+
+    m_n_posted++;
+
+    // 一杯のときは空くまで待つ。操作を捨てるよりはよい
+    while (!m_queue.push(std::move(cmd))) {
+        std::this_thread::yield();
+    }
+
+    // 眠っているかもしれないので起こす。待つ側は同じロックの中で空かどうかを見る
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+    }
+    m_wake.notify_one();
+}
+
+void ModelThread::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_woken = true;
+    }
+    m_wake.notify_one();
+}
+
+std::shared_ptr<const BoardSnapshot> ModelThread::snapshot() const
+{
+    return std::atomic_load(&m_snapshot);
+}
+
+void ModelThread::publish()
+{
+    std::shared_ptr<BoardSnapshot> s(new BoardSnapshot());
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_model_mutex);
+        make_snapshot(m_g, m_trie, *s);
+    }
+    s->seq = ++m_seq;
+    s->n_commands = m_n_done;
+
+    std::atomic_store(&m_snapshot, std::shared_ptr<const BoardSnapshot>(s));
+
+    if (m_publish) {
+        m_publish();
+    }
+}
+
+void ModelThread::idle()
+{
+    if (!m_idle) {
+        return;
+    }
+
+    PROF_SCOPE("model.idle");
+    TRACE_SCOPE("model.idle");
+
+    std::lock_guard<std::recursive_mutex> lock(m_model_mutex);
+    m_idle(m_g);
+}
+
+void ModelThread::run()
+{
+    // start()で最初のスナップショットを作ったあと
+    idle();
+
+    for (;;) {
+        ModelCommand cmd;
+
+        if (!m_queue.pop(cmd)) {
+            std::unique_lock<std::mutex> lock(m_wake_mutex);
+            m_wake.wait(lock, [this]() { return m_stop || m_woken || !m_queue.empty(); });
+
+            if (m_stop) {
+                return;
+            }
+
+            if (m_woken) {
+                m_woken = false;
+                lock.unlock();
+                idle();
+            }
+            continue;
+        }
+
+        {
+            PROF_SCOPE("model.command");
+            TRACE_SCOPE("model.command");
+
+            std::lock_guard<std::recursive_mutex> lock(m_model_mutex);
+            cmd(m_g);
+            m_n_done++;
+        }
+
+        // 続けて操作が来ていれば、まとめて1回だけ作る
+        if (m_queue.empty()) {
+            publish();
+            idle();
+        }
+    }
+}
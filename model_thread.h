@@ -0,0 +1,79 @@
+#ifndef MODEL_THREAD_H
+#define MODEL_THREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "board_snapshot.h"
+#include "spsc_queue.h"
+
+class G;
+class OpeningTrie;
+
+#define MODEL_QUEUE_SIZE (1024)
+
+typedef std::function<void(G& g)> ModelCommand;
+
+// 新しいスナップショットができたときに、モデルのスレッドから呼ぶ
+typedef std::function<void()> PublishFn;
+
+// Gを持ち、UIから送られた操作を順に実行するスレッド。
+// 操作がなくなるたびに盤のスナップショットを作って差し替えるので、UIはGに触らずに描ける。
+// GEventListenerもこのスレッドから呼ばれる。
+// 変化の木の表示だけはノードをそのまま読むので、lock()の間に読む
+class ModelThread
+{
+    G& m_g;
+    const OpeningTrie* m_trie = nullptr;
+    PublishFn m_publish;
+
+    SpscQueue<ModelCommand> m_queue;
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    bool m_woken = false;  // wake()されたので、操作がなくてもm_idleを呼ぶ
+
+    ModelCommand m_idle;
+
+    std::recursive_mutex m_model_mutex;  // 操作を実行する間持つ
+
+    std::shared_ptr<const BoardSnapshot> m_snapshot;
+    uint64_t m_seq = 0;
+    uint64_t m_n_posted = 0;  // UIのスレッドだけが書く
+    uint64_t m_n_done = 0;  // モデルのスレッドだけが書く
+
+    std::thread m_thread;
+
+    void run();
+    void publish();
+    void idle();
+public:
+    ModelThread(G& g, PublishFn fn);
+    ~ModelThread();
+
+    // start()の前に呼ぶ
+    void set_opening_trie(const OpeningTrie* trie) { m_trie = trie; };
+    // 操作がなくなってスナップショットを作ったあとに呼ぶ。UIからは見えないことだけをする
+    void set_idle(ModelCommand fn) { m_idle = fn; };
+
+    // 最初のスナップショットを作ってからスレッドを始める。それからはUIはGに触らない
+    void start();
+    void stop();
+
+    // UIのスレッドからだけ呼ぶ
+    void post(ModelCommand cmd);
+    // 操作はないがm_idleを呼んでほしいとき。どのスレッドからでもよい
+    void wake();
+    // これまでにpost()した数。スナップショットのn_commandsがこれに追いつけば、すべて反映されている
+    uint64_t n_posted() const { return m_n_posted; };
+
+    // 最後に作ったスナップショット。どのスレッドからでもよい
+    std::shared_ptr<const BoardSnapshot> snapshot() const;
+
+    std::recursive_mutex& lock() { return m_model_mutex; };
+};
+
+#endif
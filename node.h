@@ -132,6 +132,7 @@ public:
     bool is_setup();
     bool is_skip();
     bool is_protected() { return m_is_protected; };
+    void set_protected(bool v) { m_is_protected = v; };
     bool is_correct_path() { return m_is_correct_path; };
     void set_correct_path(bool v) { m_is_correct_path = v; };
 };
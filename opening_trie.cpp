@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "opening_trie.h"
+#include "replay.h"
+#include "zobrist.h"
+#include "prof.h"
+
+static inline uint32_t move_key(int x, int y, int cell)
+{
+    return (y << 16) | (x << 8) | cell;
+}
+
+static inline int swap_color(int cell)
+{
+    return (cell == CELL_BLACK) ? CELL_WHITE : CELL_BLACK;
+}
+
+OpeningTrieBuilder::OpeningTrieBuilder(int max_depth)
+    : m_max_depth(max_depth)
+{
+}
+
+bool OpeningTrieBuilder::add_file(const std::string& file)
+{
+    std::vector<std::shared_ptr<Node>> trees;
+
+    if (!load_trees(file, trees)) {
+        return false;
+    }
+
+    for (auto& t : trees) {
+        add_tree(t);
+    }
+
+    return true;
+}
+
+void OpeningTrieBuilder::add_tree(std::shared_ptr<Node> root)
+{
+    int max_depth = m_max_depth;
+
+    BoardHasher hasher(true);
+
+    replay_main_line(root, [this, max_depth, &hasher](const Board& board, const Move& next, int n) {
+        if (n >= max_depth) {
+            return false;
+        }
+
+        if (next.cell == CELL_SPACE || (next.x == 20 && next.y == 20)) {
+            return true;
+        }
+
+        int sym;
+        uint64_t h = hasher.hash(board, &sym);
+
+        // 正規化した向きと色にする
+        Point pt = sym_transform(sym / 2, board.get_size(), Point(next.x, next.y));
+        int cell = (sym % 2) ? swap_color(next.cell) : next.cell;
+
+        m_nodes[h][move_key(pt.x, pt.y, cell)]++;
+
+        return true;
+    });
+}
+
+bool OpeningTrieBuilder::write(const std::string& out)
+{
+    std::vector<uint64_t> hashes;
+    hashes.reserve(m_nodes.size());
+    for (auto& kv : m_nodes) {
+        hashes.push_back(kv.first);
+    }
+    std::sort(hashes.begin(), hashes.end());
+
+    std::vector<TrieNode> nodes;
+    std::vector<TrieMove> moves;
+
+    for (auto h : hashes) {
+        const std::map<uint32_t, uint32_t>& next = m_nodes[h];
+        TrieNode node = {h, (uint32_t) moves.size(), (uint32_t) next.size(), 0, 0};
+
+        // mapなので(y, x, cell)の順に並ぶ
+        for (auto& kv : next) {
+            TrieMove m;
+            m.y = kv.first >> 16;
+            m.x = (kv.first >> 8) & 0xff;
+            m.cell = kv.first & 0xff;
+            m.reserved = 0;
+            m.count = kv.second;
+            moves.push_back(m);
+
+            node.total += kv.second;
+        }
+
+        nodes.push_back(node);
+    }
+
+    TrieHeader hd;
+    memcpy(hd.magic, "GOQT", 4);
+    hd.version = OPENING_TRIE_VERSION;
+    hd.max_depth = m_max_depth;
+    hd.reserved = 0;
+    hd.n_nodes = nodes.size();
+    hd.n_moves = moves.size();
+    hd.nodes_off = sizeof(hd);
+    hd.moves_off = hd.nodes_off + nodes.size() * sizeof(TrieNode);
+
+    std::string tmp = out + ".tmp";
+    std::ofstream ofs(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    ofs.write((const char*) &hd, sizeof(hd));
+    ofs.write((const char*) nodes.data(), nodes.size() * sizeof(TrieNode));
+    ofs.write((const char*) moves.data(), moves.size() * sizeof(TrieMove));
+    ofs.close();
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    if (rename(tmp.c_str(), out.c_str()) != 0) {
+        std::cerr << "Error: couldn't rename file: " << tmp << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void OpeningTrie::close()
+{
+    m_file.close();
+    m_nodes = nullptr;
+    m_n_nodes = 0;
+    m_moves = nullptr;
+    m_n_moves = 0;
+}
+
+bool OpeningTrie::open(const std::string& file)
+{
+    close();
+
+    if (!m_file.open(file)) {
+        return false;
+    }
+
+    const char* base = m_file.data();
+    size_t len = m_file.size();
+    const TrieHeader* h = (const TrieHeader*) base;
+
+    if (len < sizeof(TrieHeader) || memcmp(h->magic, "GOQT", 4) != 0 || h->version != OPENING_TRIE_VERSION
+            || h->nodes_off + h->n_nodes * sizeof(TrieNode) > len
+            || h->moves_off + h->n_moves * sizeof(TrieMove) > len) {
+        std::cerr << "Error: broken opening trie: " << file << std::endl;
+        close();
+        return false;
+    }
+
+    m_nodes = (const TrieNode*) (base + h->nodes_off);
+    m_n_nodes = h->n_nodes;
+    m_moves = (const TrieMove*) (base + h->moves_off);
+    m_n_moves = h->n_moves;
+
+    return true;
+}
+
+int OpeningTrie::lookup(const Board& board, std::vector<TrieHint>& hints) const
+{
+    PROF_SCOPE("opening_trie.lookup");
+
+    if (!m_nodes) {
+        return 0;
+    }
+
+    int sym;
+    uint64_t h = board_hash(board, true, &sym);
+
+    const TrieNode* node = std::lower_bound(m_nodes, m_nodes + m_n_nodes, h,
+            [](const TrieNode& n, uint64_t v) { return n.hash < v; });
+
+    if (node == m_nodes + m_n_nodes || node->hash != h || node->first + (uint64_t) node->n > m_n_moves) {
+        return 0;
+    }
+
+    // 正規化した向き・色から盤面の向き・色に戻す
+    int inv = sym_inverse(sym / 2);
+    int size = board.get_size();
+
+    for (uint32_t i = 0; i < node->n; i++) {
+        const TrieMove& m = m_moves[node->first + i];
+        Point pt = sym_transform(inv, size, Point(m.x, m.y));
+        int cell = (sym % 2) ? swap_color(m.cell) : m.cell;
+
+        hints.push_back({Move(cell, pt.x, pt.y), (int) m.count, (double) m.count / node->total});
+    }
+
+    std::sort(hints.begin(), hints.end(), [](const TrieHint& a, const TrieHint& b) {
+        return a.count > b.count;
+    });
+
+    return node->total;
+}
@@ -0,0 +1,99 @@
+#ifndef OPENING_TRIE_H
+#define OPENING_TRIE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "board.h"
+#include "mapped_file.h"
+
+class Node;
+
+// 定石・布石の木。局面（対称変換と黒白の入れ替えで正規化したハッシュ）ごとに、
+// 次に打たれた手と回数を持つ。手順が違っても同じ局面になれば1つにまとまる。
+//
+// ファイルの形式（リトルエンディアン）:
+//   TrieHeader
+//   TrieNode n_nodes個（hashの順）
+//   TrieMove n_moves個（ノードごとに y, x, cell の順）
+//
+// 手は正規化した向きと色で持ち、引くときに今の盤面の向きと色に戻す
+
+#define OPENING_TRIE_VERSION (1)
+#define DEFAULT_TRIE_DEPTH (40)
+
+struct TrieHeader
+{
+    char magic[4];  // "GOQT"
+    uint32_t version;
+    uint32_t max_depth;
+    uint32_t reserved;
+    uint64_t n_nodes;
+    uint64_t n_moves;
+    uint64_t nodes_off;
+    uint64_t moves_off;
+};
+
+struct TrieNode
+{
+    uint64_t hash;
+    uint32_t first;  // TrieMoveの添字
+    uint32_t n;
+    uint32_t total;  // 次の手の回数の合計
+    uint32_t reserved;
+};
+
+struct TrieMove
+{
+    uint8_t x, y;
+    uint8_t cell;
+    uint8_t reserved;
+    uint32_t count;
+};
+
+// 次の手の候補
+struct TrieHint
+{
+    Move move;
+    int count;
+    double ratio;  // countの割合（0-1）
+};
+
+class OpeningTrieBuilder
+{
+    int m_max_depth;
+    // 局面 -> (y, x, cell) -> 回数
+    std::unordered_map<uint64_t, std::map<uint32_t, uint32_t>> m_nodes;
+public:
+    OpeningTrieBuilder(int max_depth = DEFAULT_TRIE_DEPTH);
+
+    bool add_file(const std::string& file);
+    // 本手順の最初のmax_depth手を登録する。パスは登録しない
+    void add_tree(std::shared_ptr<Node> root);
+
+    size_t n_nodes() const { return m_nodes.size(); };
+
+    bool write(const std::string& out);
+};
+
+class OpeningTrie
+{
+    MappedFile m_file;
+    const TrieNode* m_nodes = nullptr;
+    uint64_t m_n_nodes = 0;
+    const TrieMove* m_moves = nullptr;
+    uint64_t m_n_moves = 0;
+public:
+    bool open(const std::string& file);
+    void close();
+
+    uint64_t n_nodes() const { return m_n_nodes; };
+
+    // 次の手を回数の多い順にhintsに入れ、回数の合計を返す。hintsの手は盤面の向きと色
+    int lookup(const Board& board, std::vector<TrieHint>& hints) const;
+};
+
+#endif
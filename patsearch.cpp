@@ -0,0 +1,181 @@
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include "goq.h"
+#include "pattern.h"
+#include "prof.h"
+#include "trace.h"
+
+// 盤の一部の形で棋譜を探し、次の手を数える
+//
+//   goq-pattern [-j スレッド数] [-s 盤の大きさ] [-a x,y] [-n] [-l 表示数] -p 形 FILE...
+//
+// -a で形の左上を置く位置（既定は1,1）。-n で黒白を入れ替えた形は探さない。
+// 形の書き方は pattern.h を参照
+
+static void usage()
+{
+    std::cerr << "usage: goq-pattern [-j threads] [-s size] [-a x,y] [-n] [-l limit] -p PATTERN FILE..." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    prof_init();
+    trace_init();
+
+    int n_threads = std::thread::hardware_concurrency();
+    int size = 19;
+    int ax = 1;
+    int ay = 1;
+    bool color_swap = true;
+    int limit = 20;
+    std::string pat_str = "";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:s:a:nl:p:")) != -1) {
+        switch (opt) {
+        case 'j':
+            n_threads = atoi(optarg);
+            break;
+        case 's':
+            size = atoi(optarg);
+            break;
+        case 'a':
+            if (sscanf(optarg, "%d,%d", &ax, &ay) != 2) {
+                usage();
+                return 2;
+            }
+            break;
+        case 'n':
+            color_swap = false;
+            break;
+        case 'l':
+            limit = atoi(optarg);
+            break;
+        case 'p':
+            pat_str = optarg;
+            break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+
+    Pattern pat;
+
+    if (pat_str == "" || optind >= argc) {
+        usage();
+        return 2;
+    }
+
+    if (!pat.parse(pat_str)) {
+        std::cerr << "Error: bad pattern: " << pat_str << std::endl;
+        return 2;
+    }
+
+    if (size < 1 || size > MAX_BOARD_SIZE || ax < 1 || ay < 1 ||
+            ax + pat.width() - 1 > size || ay + pat.height() - 1 > size) {
+        std::cerr << "Error: pattern is out of the board" << std::endl;
+        return 2;
+    }
+
+    std::vector<std::string> files(argv + optind, argv + argc);
+
+    if (n_threads < 1) {
+        n_threads = 1;
+    }
+    if (n_threads > (int) files.size()) {
+        n_threads = files.size();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // スレッドごとに探して、最後にまとめる
+    std::vector<std::unique_ptr<PatternSearch>> searches;
+    for (int i = 0; i < n_threads; i++) {
+        searches.emplace_back(new PatternSearch(pat, size, ax, ay, color_swap));
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < n_threads; i++) {
+        PatternSearch* search = searches[i].get();
+
+        threads.emplace_back([&, search]() {
+            for (size_t k = next++; k < files.size(); k = next++) {
+                if (!search->search_file(k, files[k])) {
+                    failed = true;
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    PatternSearch& result = *searches[0];
+    for (int i = 1; i < n_threads; i++) {
+        result.merge(*searches[i]);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    std::vector<PatHit> hits = result.hits();
+    std::sort(hits.begin(), hits.end(), [](const PatHit& a, const PatHit& b) {
+        if (a.file != b.file) {
+            return a.file < b.file;
+        }
+        if (a.game != b.game) {
+            return a.game < b.game;
+        }
+        return a.move < b.move;
+    });
+
+    for (int i = 0; i < (int) hits.size() && i < limit; i++) {
+        const PatHit& h = hits[i];
+        std::cout << files[h.file] << "#" << h.game + 1 << " move " << h.move
+            << (h.color_swap ? " (swapped)" : "") << std::endl;
+    }
+    if ((int) hits.size() > limit) {
+        std::cout << "... " << hits.size() - limit << " more" << std::endl;
+    }
+
+    // 次の手。回数の多い順
+    std::vector<std::pair<Move, int>> next_moves(result.continuations().begin(), result.continuations().end());
+    std::sort(next_moves.begin(), next_moves.end(), [](const std::pair<Move, int>& a, const std::pair<Move, int>& b) {
+        return a.second > b.second;
+    });
+
+    int total = 0;
+    for (auto& kv : next_moves) {
+        total += kv.second;
+    }
+
+    if (total > 0) {
+        std::cout << "continuations:" << std::endl;
+    }
+
+    for (int i = 0; i < (int) next_moves.size() && i < limit; i++) {
+        const Move& m = next_moves[i].first;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "  %c (%d,%d) %6d %5.1f%%",
+                m.cell == CELL_BLACK ? 'B' : 'W', m.x, m.y,
+                next_moves[i].second, 100.0 * next_moves[i].second / total);
+        std::cout << buf << std::endl;
+    }
+
+    std::cerr << result.n_games << " games (" << result.n_skipped_games << " skipped), "
+        << result.n_positions << " positions, " << result.n_candidates << " candidates, "
+        << hits.size() << " hits, " << result.n_variants() << " variants ("
+        << std::chrono::duration<double, std::milli>(end - start).count() << " ms)" << std::endl;
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,352 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <cstring>
+#include "pattern.h"
+#include "node.h"
+#include "replay.h"
+#include "zobrist.h"
+#include "prof.h"
+
+bool Pattern::parse(const std::string& s)
+{
+    std::vector<std::string> rows;
+    std::string row;
+
+    for (char ch : s) {
+        if (ch == '/' || ch == '\n') {
+            if (!row.empty()) {
+                rows.push_back(row);
+            }
+            row = "";
+        } else if (ch != ' ' && ch != '\r') {
+            row += ch;
+        }
+    }
+    if (!row.empty()) {
+        rows.push_back(row);
+    }
+
+    if (rows.empty() || rows.size() > MAX_BOARD_SIZE) {
+        return false;
+    }
+
+    m_w = rows[0].size();
+    m_h = rows.size();
+
+    if (m_w > MAX_BOARD_SIZE) {
+        return false;
+    }
+
+    m_cells.clear();
+
+    for (auto& r : rows) {
+        if ((int) r.size() != m_w) {
+            return false;
+        }
+
+        for (char ch : r) {
+            switch (ch) {
+            case 'X':
+            case 'x':
+            case 'B':
+                m_cells.push_back(PAT_BLACK);
+                break;
+            case 'O':
+            case 'o':
+            case 'W':
+                m_cells.push_back(PAT_WHITE);
+                break;
+            case '.':
+                m_cells.push_back(PAT_EMPTY);
+                break;
+            case '*':
+            case '?':
+                m_cells.push_back(PAT_ANY);
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void BitBoard::set(const Board& board)
+{
+    int size = board.get_size();
+
+    memset(this, 0, sizeof(*this));
+
+    for (int y = 1; y <= size; y++) {
+        uint32_t b = 0;
+        uint32_t w = 0;
+
+        for (int x = 1; x <= size; x++) {
+            int v = board.get_val(x, y) & 3;
+
+            if (v == CELL_BLACK) {
+                b |= 1u << (x - 1);
+                black_zones |= zone_bit(x, y);
+                n_black++;
+            } else if (v == CELL_WHITE) {
+                w |= 1u << (x - 1);
+                white_zones |= zone_bit(x, y);
+                n_white++;
+            }
+        }
+
+        black[y - 1] = b;
+        white[y - 1] = w;
+    }
+}
+
+bool PatVariant::match(const BitBoard& bb) const
+{
+    const uint32_t* b = bb.black + (y0 - 1);
+    const uint32_t* w = bb.white + (y0 - 1);
+    int shift = x0 - 1;
+
+#ifdef __SSE2__
+    // 4行ずつ比べる
+    __m128i cnt = _mm_cvtsi32_si128(shift);
+
+    for (int i = 0; i < n_rows; i += 4) {
+        __m128i c = _mm_loadu_si128((const __m128i*) (care + i));
+        __m128i vb = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128((const __m128i*) (b + i)), cnt), c);
+        __m128i vw = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128((const __m128i*) (w + i)), cnt), c);
+        __m128i eq = _mm_and_si128(
+                _mm_cmpeq_epi32(vb, _mm_loadu_si128((const __m128i*) (black + i))),
+                _mm_cmpeq_epi32(vw, _mm_loadu_si128((const __m128i*) (white + i))));
+
+        if (_mm_movemask_epi8(eq) != 0xffff) {
+            return false;
+        }
+    }
+#else
+    for (int i = 0; i < h; i++) {
+        if (((b[i] >> shift) & care[i]) != black[i] || ((w[i] >> shift) & care[i]) != white[i]) {
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+static bool same_variant(const PatVariant& a, const PatVariant& b)
+{
+    return a.x0 == b.x0 && a.y0 == b.y0 && a.h == b.h &&
+        memcmp(a.care, b.care, sizeof(a.care)) == 0 &&
+        memcmp(a.black, b.black, sizeof(a.black)) == 0 &&
+        memcmp(a.white, b.white, sizeof(a.white)) == 0;
+}
+
+PatternSearch::PatternSearch(const Pattern& pat, int size, int x, int y, bool color_swap)
+    : m_size(size), m_ax(x), m_ay(y)
+{
+    for (int s = 0; s < N_SYMS; s++) {
+        for (int c = 0; c <= (color_swap ? 1 : 0); c++) {
+            PatVariant v;
+            memset(&v, 0, sizeof(v));
+            v.sym = s;
+            v.color_swap = c;
+
+            // 変換した後の左上
+            int x1 = size;
+            int y1 = size;
+            int y2 = 1;
+            for (int j = 0; j < pat.height(); j++) {
+                for (int i = 0; i < pat.width(); i++) {
+                    Point pt = sym_transform(s, size, Point(x + i, y + j));
+                    x1 = std::min(x1, pt.x);
+                    y1 = std::min(y1, pt.y);
+                    y2 = std::max(y2, pt.y);
+                }
+            }
+
+            v.x0 = x1;
+            v.y0 = y1;
+            v.h = y2 - y1 + 1;
+            v.n_rows = (v.h + 3) & ~3;
+
+            for (int j = 0; j < pat.height(); j++) {
+                for (int i = 0; i < pat.width(); i++) {
+                    int cell = pat.get(i, j);
+
+                    if (cell == PAT_ANY) {
+                        continue;
+                    }
+
+                    if (c && cell == PAT_BLACK) {
+                        cell = PAT_WHITE;
+                    } else if (c && cell == PAT_WHITE) {
+                        cell = PAT_BLACK;
+                    }
+
+                    Point pt = sym_transform(s, size, Point(x + i, y + j));
+                    int r = pt.y - v.y0;
+                    uint32_t bit = 1u << (pt.x - v.x0);
+
+                    v.care[r] |= bit;
+
+                    if (cell == PAT_BLACK) {
+                        v.black[r] |= bit;
+                        v.black_zones |= zone_bit(pt.x, pt.y);
+                        v.n_black++;
+                    } else if (cell == PAT_WHITE) {
+                        v.white[r] |= bit;
+                        v.white_zones |= zone_bit(pt.x, pt.y);
+                        v.n_white++;
+                    }
+                }
+            }
+
+            // 対称な形は同じものが何度もできる
+            bool dup = false;
+            for (auto& other : m_variants) {
+                if (same_variant(v, other)) {
+                    dup = true;
+                    break;
+                }
+            }
+
+            if (!dup) {
+                m_variants.push_back(v);
+            }
+        }
+    }
+}
+
+bool PatternSearch::search_file(int file, const std::string& filename)
+{
+    std::vector<std::shared_ptr<Node>> trees;
+
+    if (!load_trees(filename, trees)) {
+        return false;
+    }
+
+    for (int i = 0; i < (int) trees.size(); i++) {
+        search_tree(file, i, trees[i]);
+    }
+
+    return true;
+}
+
+// 本手順で一度でも石が置かれた区画
+static void game_zones(std::shared_ptr<Node> root, uint64_t& black_zones, uint64_t& white_zones)
+{
+    black_zones = 0;
+    white_zones = 0;
+
+    for (std::shared_ptr<Node> node = root; node; ) {
+        for (auto& p : node->properties) {
+            PID pid = p->pid();
+            uint64_t* zones;
+
+            if (pid == PID::B || pid == PID::AB) {
+                zones = &black_zones;
+            } else if (pid == PID::W || pid == PID::AW) {
+                zones = &white_zones;
+            } else {
+                continue;
+            }
+
+            for (auto& pt : p->points()) {
+                if (pt.x >= 1 && pt.x <= MAX_BOARD_SIZE && pt.y >= 1 && pt.y <= MAX_BOARD_SIZE) {
+                    *zones |= zone_bit(pt.x, pt.y);
+                }
+            }
+        }
+
+        node = node->children.empty() ? nullptr : node->children.front();
+    }
+}
+
+void PatternSearch::search_tree(int file, int game, std::shared_ptr<Node> root)
+{
+    PROF_SCOPE("pattern.search_tree");
+
+    if (tree_size(root) != m_size) {
+        return;
+    }
+
+    n_games++;
+
+    // 形に必要な石が一度も置かれない棋譜は盤に並べない
+    uint64_t black_zones, white_zones;
+    game_zones(root, black_zones, white_zones);
+
+    std::vector<const PatVariant*> variants;
+    for (auto& v : m_variants) {
+        if ((black_zones & v.black_zones) == v.black_zones &&
+                (white_zones & v.white_zones) == v.white_zones) {
+            variants.push_back(&v);
+        }
+    }
+
+    if (variants.empty()) {
+        n_skipped_games++;
+        return;
+    }
+
+    BitBoard bb;
+    bool prev_match = false;
+
+    replay_main_line(root, [&](const Board& board, const Move& next, int n) {
+        n_positions++;
+        bb.set(board);
+
+        const PatVariant* found = nullptr;
+
+        for (auto v : variants) {
+            if (bb.n_black < v->n_black || bb.n_white < v->n_white ||
+                    (bb.black_zones & v->black_zones) != v->black_zones ||
+                    (bb.white_zones & v->white_zones) != v->white_zones) {
+                continue;
+            }
+
+            n_candidates++;
+
+            if (v->match(bb)) {
+                found = v;
+                break;
+            }
+        }
+
+        // 形ができた局面だけを数える。形が続いている間は数えない
+        if (found && !prev_match) {
+            m_hits.push_back({file, game, n, found->sym, found->color_swap});
+
+            if (next.cell != CELL_SPACE && !(next.x == 20 && next.y == 20)) {
+                Point pt = sym_transform(sym_inverse(found->sym), m_size, Point(next.x, next.y));
+                int cell = next.cell;
+
+                if (found->color_swap) {
+                    cell = (cell == CELL_BLACK) ? CELL_WHITE : CELL_BLACK;
+                }
+
+                m_next[Move(cell, pt.x, pt.y)]++;
+            }
+        }
+
+        prev_match = (found != nullptr);
+
+        return true;
+    });
+}
+
+void PatternSearch::merge(const PatternSearch& other)
+{
+    m_hits.insert(m_hits.end(), other.m_hits.begin(), other.m_hits.end());
+
+    for (auto& kv : other.m_next) {
+        m_next[kv.first] += kv.second;
+    }
+
+    n_games += other.n_games;
+    n_skipped_games += other.n_skipped_games;
+    n_positions += other.n_positions;
+    n_candidates += other.n_candidates;
+}
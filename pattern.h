@@ -0,0 +1,120 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "board.h"
+
+class Node;
+
+// 盤の一部の形で棋譜を探す（Kombiloの位置固定の検索と同じ）
+//
+// 形は行を / か改行で区切った文字列で書く。
+//   X 黒  O 白  . 空点  * か ? どれでもよい
+// 例: "..X/.OX/..*"
+
+enum {
+    PAT_ANY = 0,
+    PAT_EMPTY,
+    PAT_BLACK,
+    PAT_WHITE,
+};
+
+class Pattern
+{
+    int m_w = 0;
+    int m_h = 0;
+    std::vector<int> m_cells;  // [y * m_w + x]
+public:
+    bool parse(const std::string& s);
+
+    int width() const { return m_w; };
+    int height() const { return m_h; };
+    int get(int x, int y) const { return m_cells[y * m_w + x]; };  // 0から
+};
+
+// 19路のビットボード。rows[y - 1]の(x - 1)ビット目が(x, y)
+// SIMDでまとめて読むので、最後の行の後ろにも0の行を置いておく
+#define BB_ROWS (MAX_BOARD_SIZE + 5)
+
+struct BitBoard
+{
+    uint32_t black[BB_ROWS];
+    uint32_t white[BB_ROWS];
+    int n_black;
+    int n_white;
+    uint64_t black_zones;  // 3x3の区画ごとに石があるか
+    uint64_t white_zones;
+
+    void set(const Board& board);
+};
+
+// 3x3の区画のビット（19路で7x7=49区画）
+inline uint64_t zone_bit(int x, int y)
+{
+    return 1ULL << (((y - 1) / 3) * 7 + (x - 1) / 3);
+}
+
+// 対称変換・黒白の入れ替えをした形の1つ。盤上の位置も決まっている
+struct PatVariant
+{
+    int sym;
+    bool color_swap;
+    int x0, y0;  // 左上
+    int h;
+    int n_rows;  // hを4の倍数に切り上げたもの
+    uint32_t care[BB_ROWS];  // 空点・黒・白を指定した位置
+    uint32_t black[BB_ROWS];
+    uint32_t white[BB_ROWS];
+    int n_black;
+    int n_white;
+    uint64_t black_zones;  // 石が必要な区画
+    uint64_t white_zones;
+
+    bool match(const BitBoard& bb) const;
+};
+
+struct PatHit
+{
+    int file;
+    int game;
+    int move;  // 手数
+    int sym;
+    bool color_swap;
+};
+
+class PatternSearch
+{
+    int m_size;
+    int m_ax, m_ay;  // 形を置く位置（左上）
+    std::vector<PatVariant> m_variants;
+
+    std::vector<PatHit> m_hits;
+    // 一致した局面の次の手。元の形の向き・色に戻して数える。パスは数えない
+    std::map<Move, int> m_next;
+public:
+    // 形の左上を(x, y)に置いて探す。color_swapなら黒白を入れ替えた形も探す
+    PatternSearch(const Pattern& pat, int size, int x, int y, bool color_swap = true);
+
+    int n_variants() const { return m_variants.size(); };
+
+    bool search_file(int file, const std::string& filename);
+    void search_tree(int file, int game, std::shared_ptr<Node> root);
+
+    // 別のスレッドで探した結果をまとめる
+    void merge(const PatternSearch& other);
+
+    const std::vector<PatHit>& hits() const { return m_hits; };
+    const std::map<Move, int>& continuations() const { return m_next; };
+
+    // 統計
+    int n_games = 0;
+    int n_skipped_games = 0;  // 区画の絞り込みで盤に並べずに済んだ棋譜
+    int64_t n_positions = 0;
+    int64_t n_candidates = 0;  // 石の数と区画の絞り込みを通った局面
+};
+
+#endif
@@ -0,0 +1,491 @@
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include "pos_index.h"
+#include "replay.h"
+#include "zobrist.h"
+#include "prof.h"
+
+PosIndexBuilder::PosIndexBuilder(bool canonical, size_t max_entries, const std::string& tmp_prefix)
+    : m_canonical(canonical), m_max_entries(max_entries), m_tmp_prefix(tmp_prefix)
+{
+    if (m_max_entries < 1) {
+        m_max_entries = 1;
+    }
+}
+
+PosIndexBuilder::~PosIndexBuilder()
+{
+    for (auto& r : m_runs) {
+        unlink(r.path.c_str());
+    }
+}
+
+bool PosIndexBuilder::add_file(const std::string& file)
+{
+    std::vector<std::shared_ptr<Node>> trees;
+
+    if (!load_trees(file, trees)) {
+        return false;
+    }
+
+    int file_idx = m_files.size();
+    m_files.push_back(file);
+
+    for (int i = 0; i < (int) trees.size(); i++) {
+        add_tree(file_idx, i, trees[i]);
+    }
+
+    return !m_failed;
+}
+
+void PosIndexBuilder::add_tree(int file, int game, std::shared_ptr<Node> root)
+{
+    uint32_t game_idx = m_games.size();
+    m_games.push_back({(uint32_t) file, (uint32_t) game});
+
+    BoardHasher hasher(m_canonical);
+
+    replay_main_line(root, [this, game_idx, &hasher](const Board& board, const Move& next, int n) {
+        (void) next;
+
+        if (!board.is_empty()) {
+            m_entries.push_back({hasher.hash(board), game_idx, (uint32_t) n});
+            m_n_entries++;
+        }
+
+        return true;
+    });
+
+    // 棋譜の途中では書き出さないので、上限を1局分超えることはある
+    if (m_entries.size() >= m_max_entries) {
+        spill();
+    }
+}
+
+// メモリにある分を並べ替えて一時ファイルに書き出す
+bool PosIndexBuilder::spill()
+{
+    PROF_SCOPE("pos_index.spill");
+
+    if (m_entries.empty()) {
+        return true;
+    }
+
+    std::sort(m_entries.begin(), m_entries.end());
+
+    Run run;
+    run.path = m_tmp_prefix + "." + std::to_string(m_runs.size()) + ".run";
+    run.n_entries = m_entries.size();
+    run.game_offset = 0;
+
+    std::ofstream ofs(run.path, std::ios::out | std::ios::binary | std::ios::trunc);
+    ofs.write((const char*) m_entries.data(), m_entries.size() * sizeof(PosEntry));
+    ofs.close();
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << run.path << std::endl;
+        unlink(run.path.c_str());
+        m_failed = true;
+        return false;
+    }
+
+    m_runs.push_back(run);
+
+    // メモリを返す
+    std::vector<PosEntry>().swap(m_entries);
+
+    return true;
+}
+
+bool PosIndexBuilder::merge(PosIndexBuilder& other)
+{
+    uint32_t file_offset = m_files.size();
+    uint32_t game_offset = m_games.size();
+
+    // 断片の名前が重ならないように、otherのメモリにある分はotherの名前で書き出す
+    if (!m_runs.empty() || !other.m_runs.empty()) {
+        if (!spill() || !other.spill()) {
+            return false;
+        }
+    }
+
+    m_files.insert(m_files.end(), other.m_files.begin(), other.m_files.end());
+
+    for (auto g : other.m_games) {
+        g.file += file_offset;
+        m_games.push_back(g);
+    }
+
+    for (auto& e : other.m_entries) {
+        m_entries.push_back({e.hash, e.game + game_offset, e.move});
+    }
+
+    for (auto r : other.m_runs) {
+        r.game_offset += game_offset;
+        m_runs.push_back(r);
+    }
+
+    m_n_entries += other.m_n_entries;
+    m_failed = m_failed || other.m_failed;
+
+    other.m_files.clear();
+    other.m_games.clear();
+    std::vector<PosEntry>().swap(other.m_entries);
+    other.m_runs.clear();
+    other.m_n_entries = 0;
+
+    return !m_failed;
+}
+
+// 一時ファイルを少しずつ読む
+namespace {
+
+struct RunReader
+{
+    std::ifstream ifs;
+    std::vector<PosEntry> buf;
+    size_t pos = 0;
+    uint64_t left;
+    uint32_t game_offset;
+
+    bool next(PosEntry& e) {
+        if (pos == buf.size()) {
+            if (left == 0) {
+                return false;
+            }
+
+            size_t n = std::min<uint64_t>(left, 1 << 14);
+            buf.resize(n);
+            ifs.read((char*) buf.data(), n * sizeof(PosEntry));
+
+            if (!ifs) {
+                return false;
+            }
+
+            left -= n;
+            pos = 0;
+        }
+
+        e = buf[pos++];
+        e.game += game_offset;
+
+        return true;
+    }
+};
+
+}
+
+// 断片をk-way mergeしながら書く
+bool PosIndexBuilder::write_merged(std::ostream& os)
+{
+    PROF_SCOPE("pos_index.merge");
+
+    std::vector<std::unique_ptr<RunReader>> readers;
+
+    for (auto& r : m_runs) {
+        std::unique_ptr<RunReader> reader(new RunReader());
+        reader->ifs.open(r.path, std::ios::in | std::ios::binary);
+        reader->left = r.n_entries;
+        reader->game_offset = r.game_offset;
+
+        if (!reader->ifs) {
+            std::cerr << "Error: couldn't open file: " << r.path << std::endl;
+            return false;
+        }
+
+        readers.push_back(std::move(reader));
+    }
+
+    typedef std::pair<PosEntry, int> Head;
+    auto greater = [](const Head& a, const Head& b) { return b.first < a.first; };
+    std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(greater);
+
+    for (int i = 0; i < (int) readers.size(); i++) {
+        PosEntry e;
+        if (readers[i]->next(e)) {
+            heads.push({e, i});
+        }
+    }
+
+    std::vector<PosEntry> out;
+    out.reserve(1 << 14);
+    uint64_t n = 0;
+    uint64_t out_hash = 0;
+
+    while (!heads.empty()) {
+        Head h = heads.top();
+        heads.pop();
+
+        if (n == 0 || h.first.hash != out_hash) {
+            out_hash = h.first.hash;
+            m_n_hashes++;
+
+            if (!m_bloom.empty()) {
+                m_bloom.add(out_hash);
+            }
+        }
+
+        out.push_back(h.first);
+        n++;
+
+        if (out.size() == out.capacity()) {
+            os.write((const char*) out.data(), out.size() * sizeof(PosEntry));
+            out.clear();
+        }
+
+        PosEntry e;
+        if (readers[h.second]->next(e)) {
+            heads.push({e, h.second});
+        }
+    }
+
+    os.write((const char*) out.data(), out.size() * sizeof(PosEntry));
+
+    if (n != m_n_entries) {
+        std::cerr << "Error: broken run files" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+static void write_u32(std::ostream& os, uint32_t v)
+{
+    os.write((const char*) &v, sizeof(v));
+}
+
+bool PosIndexBuilder::write(const std::string& out)
+{
+    if (m_failed) {
+        return false;
+    }
+
+    // 書き出した断片があれば、残りも書き出して全部を併合する
+    if (!m_runs.empty() && !spill()) {
+        return false;
+    }
+
+    // 併合するときは異なるhashの数がわからないので、全部の数で大きさを決める
+    m_n_hashes = 0;
+
+    if (m_runs.empty()) {
+        std::sort(m_entries.begin(), m_entries.end());
+
+        for (size_t i = 0; i < m_entries.size(); i++) {
+            if (i == 0 || m_entries[i].hash != m_entries[i - 1].hash) {
+                m_n_hashes++;
+            }
+        }
+
+        if (m_bloom_bits > 0) {
+            m_bloom.init(m_n_hashes, m_bloom_bits);
+
+            for (size_t i = 0; i < m_entries.size(); i++) {
+                if (i == 0 || m_entries[i].hash != m_entries[i - 1].hash) {
+                    m_bloom.add(m_entries[i].hash);
+                }
+            }
+        }
+    } else if (m_bloom_bits > 0) {
+        m_bloom.init(m_n_entries, m_bloom_bits);
+    }
+
+    PosHeader h;
+    memcpy(h.magic, "GOQP", 4);
+    h.version = POS_INDEX_VERSION;
+    h.flags = m_canonical ? POS_CANONICAL : 0;
+    h.n_files = m_files.size();
+    h.n_games = m_games.size();
+    h.n_entries = m_n_entries;
+
+    uint64_t off = sizeof(h);
+    for (auto& f : m_files) {
+        off += sizeof(uint32_t) + f.size();
+    }
+    off = (off + 7) & ~7ULL;
+
+    h.games_off = off;
+    h.entries_off = off + m_games.size() * sizeof(PosGame);
+    h.n_hashes = m_n_hashes;
+    h.bloom_blocks = m_bloom.n_blocks();
+    h.bloom_off = (h.entries_off + m_n_entries * sizeof(PosEntry) + 63) & ~63ULL;
+
+    std::string tmp = out + ".tmp";
+    std::ofstream ofs(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    ofs.write((const char*) &h, sizeof(h));
+
+    uint64_t pos = sizeof(h);
+    for (auto& f : m_files) {
+        write_u32(ofs, f.size());
+        ofs.write(f.data(), f.size());
+        pos += sizeof(uint32_t) + f.size();
+    }
+
+    static const char zeros[8] = {};
+    ofs.write(zeros, h.games_off - pos);
+
+    ofs.write((const char*) m_games.data(), m_games.size() * sizeof(PosGame));
+
+    if (m_runs.empty()) {
+        ofs.write((const char*) m_entries.data(), m_entries.size() * sizeof(PosEntry));
+    } else if (!write_merged(ofs)) {
+        ofs.close();
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    if (!m_bloom.empty()) {
+        static const char pad[64] = {};
+        ofs.write(pad, h.bloom_off - (h.entries_off + m_n_entries * sizeof(PosEntry)));
+        ofs.write((const char*) m_bloom.data(), m_bloom.size_bytes());
+    }
+
+    // 併合したときはここでn_hashesがわかる
+    if (!m_runs.empty()) {
+        h.n_hashes = m_n_hashes;
+        ofs.seekp(0);
+        ofs.write((const char*) &h, sizeof(h));
+    }
+
+    ofs.close();
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    if (rename(tmp.c_str(), out.c_str()) != 0) {
+        std::cerr << "Error: couldn't rename file: " << tmp << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void PosIndex::close()
+{
+    m_file.close();
+    m_files.clear();
+    m_games = nullptr;
+    m_entries = nullptr;
+    m_n_games = 0;
+    m_n_entries = 0;
+    m_n_hashes = 0;
+    m_bloom.attach(nullptr, 0);
+}
+
+bool PosIndex::open(const std::string& file)
+{
+    close();
+
+    if (!m_file.open(file)) {
+        return false;
+    }
+
+    const char* base = m_file.data();
+    size_t len = m_file.size();
+    const PosHeader* h = (const PosHeader*) base;
+
+    if (len < POS_HEADER_V1_SIZE || memcmp(h->magic, "GOQP", 4) != 0
+            || h->version < 1 || h->version > POS_INDEX_VERSION
+            || (h->version >= 2 && len < sizeof(PosHeader))
+            || h->games_off + h->n_games * sizeof(PosGame) > len
+            || h->entries_off + h->n_entries * sizeof(PosEntry) > len) {
+        std::cerr << "Error: broken index: " << file << std::endl;
+        close();
+        return false;
+    }
+
+    const char* p = base + (h->version >= 2 ? sizeof(PosHeader) : POS_HEADER_V1_SIZE);
+    for (uint32_t i = 0; i < h->n_files; i++) {
+        uint32_t n;
+
+        if (p + sizeof(n) > base + h->games_off) {
+            std::cerr << "Error: broken index: " << file << std::endl;
+            close();
+            return false;
+        }
+
+        memcpy(&n, p, sizeof(n));
+        p += sizeof(n);
+
+        if (p + n > base + h->games_off) {
+            std::cerr << "Error: broken index: " << file << std::endl;
+            close();
+            return false;
+        }
+
+        m_files.push_back(std::string(p, n));
+        p += n;
+    }
+
+    m_flags = h->flags;
+    m_games = (const PosGame*) (base + h->games_off);
+    m_n_games = h->n_games;
+    m_entries = (const PosEntry*) (base + h->entries_off);
+    m_n_entries = h->n_entries;
+
+    if (h->version >= 2) {
+        m_n_hashes = h->n_hashes;
+
+        if (h->bloom_blocks > 0 && h->bloom_off % 64 == 0 &&
+                h->bloom_off + h->bloom_blocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t) <= len) {
+            m_bloom.attach((const uint64_t*) (base + h->bloom_off), h->bloom_blocks);
+        }
+    }
+
+    return true;
+}
+
+uint64_t PosIndex::hash(const Board& board) const
+{
+    return board_hash(board, is_canonical());
+}
+
+size_t PosIndex::lookup(uint64_t hash, std::vector<PosHit>& hits, size_t limit) const
+{
+    PROF_SCOPE("pos_index.lookup");
+
+    if (!m_entries) {
+        return 0;
+    }
+
+    if (!m_bloom.may_contain(hash)) {
+        PROF_COUNT("pos_index.bloom_negative", 1);
+        return 0;
+    }
+
+    const PosEntry* first = std::lower_bound(m_entries, m_entries + m_n_entries, hash,
+            [](const PosEntry& e, uint64_t h) { return e.hash < h; });
+    const PosEntry* last = first;
+
+    while (last != m_entries + m_n_entries && last->hash == hash) {
+        if ((size_t) (last - first) < limit && last->game < m_n_games) {
+            const PosGame& game = m_games[last->game];
+
+            if (game.file < m_files.size()) {
+                hits.push_back({m_files[game.file], (int) game.game, (int) last->move});
+            }
+        }
+
+        last++;
+    }
+
+    return last - first;
+}
+
+size_t PosIndex::lookup(const Board& board, std::vector<PosHit>& hits, size_t limit) const
+{
+    return lookup(hash(board), hits, limit);
+}
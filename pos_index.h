@@ -0,0 +1,170 @@
+#ifndef POS_INDEX_H
+#define POS_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "board.h"
+#include "bloom.h"
+#include "mapped_file.h"
+
+class Node;
+
+// 局面の索引。局面のZobristハッシュから、その局面が現れた（ファイル, 何番目の棋譜, 手数）を引く。
+//
+// ファイルの形式（リトルエンディアン）:
+//   PosHeader
+//   ファイル名 n_files個 [u32 長さ][バイト列]
+//   （8バイト境界まで0で埋める）
+//   PosGame n_games個
+//   PosEntry n_entries個（hash, game, moveの順に並べてある）
+//   （64バイト境界まで0で埋める）
+//   BloomFilterのブロック bloom_blocks個（version 2から。0個ならない）
+//
+// 読むときはmmapして二分探索する。Bloomフィルタがあれば先にそれを見て、
+// 無い局面は二分探索しない
+
+#define POS_INDEX_VERSION (2)
+#define DEFAULT_BLOOM_BITS (10)  // 1局面あたりのビット数
+
+enum {
+    POS_CANONICAL = 0x01,  // 対称変換と黒白の入れ替えを同じ局面とみなす
+};
+
+struct PosHeader
+{
+    char magic[4];  // "GOQP"
+    uint32_t version;
+    uint32_t flags;
+    uint32_t n_files;
+    uint64_t n_games;
+    uint64_t n_entries;
+    uint64_t games_off;
+    uint64_t entries_off;
+    // version 2
+    uint64_t n_hashes;  // 異なるhashの数
+    uint64_t bloom_off;
+    uint64_t bloom_blocks;
+};
+
+// version 1のヘッダの大きさ
+#define POS_HEADER_V1_SIZE (48)
+
+struct PosGame
+{
+    uint32_t file;
+    uint32_t game;  // ファイル内で何番目か（0から）
+};
+
+struct PosEntry
+{
+    uint64_t hash;
+    uint32_t game;  // PosGameの添字
+    uint32_t move;  // この局面までの手数
+
+    bool operator<(const PosEntry& e) const {
+        if (hash != e.hash) {
+            return hash < e.hash;
+        }
+        if (game != e.game) {
+            return game < e.game;
+        }
+        return move < e.move;
+    };
+};
+
+struct PosHit
+{
+    std::string file;
+    int game;
+    int move;
+};
+
+// 索引を作る。メモリに収まらないときは、並べ替えた断片（run）を一時ファイルに
+// 書き出しておき、最後にまとめて併合する。
+// スレッドごとに1つ作り、最後にmerge()で1つにまとめて書き出す
+class PosIndexBuilder
+{
+    struct Run
+    {
+        std::string path;
+        uint64_t n_entries;
+        uint32_t game_offset;  // 書き出したときのgameの添字に足す
+    };
+
+    bool m_canonical;
+    size_t m_max_entries;  // メモリに置くPosEntryの数の上限
+    std::string m_tmp_prefix;
+    std::vector<std::string> m_files;
+    std::vector<PosGame> m_games;
+    std::vector<PosEntry> m_entries;
+    std::vector<Run> m_runs;
+    uint64_t m_n_entries = 0;  // 書き出した分も含めた数
+    uint64_t m_n_hashes = 0;
+    int m_bloom_bits = DEFAULT_BLOOM_BITS;
+    BloomFilter m_bloom;
+    bool m_failed = false;
+
+    bool spill();
+    bool write_merged(std::ostream& os);
+public:
+    // tmp_prefixの後ろに番号を付けたファイルに断片を書く
+    PosIndexBuilder(bool canonical, size_t max_entries = SIZE_MAX, const std::string& tmp_prefix = "");
+    ~PosIndexBuilder();
+
+    PosIndexBuilder(const PosIndexBuilder&) = delete;
+    PosIndexBuilder& operator=(const PosIndexBuilder&) = delete;
+
+    bool add_file(const std::string& file);
+    // 本手順の局面をすべて登録する。石のない局面は登録しない
+    void add_tree(int file, int game, std::shared_ptr<Node> root);
+
+    // otherのファイル・棋譜・局面を引き取る。otherは空になる
+    bool merge(PosIndexBuilder& other);
+
+    size_t n_games() const { return m_games.size(); };
+    uint64_t n_entries() const { return m_n_entries; };
+    size_t n_runs() const { return m_runs.size(); };
+    uint64_t n_hashes() const { return m_n_hashes; };
+
+    // 0ならBloomフィルタを作らない
+    void set_bloom_bits(int bits_per_key) { m_bloom_bits = bits_per_key; };
+
+    bool write(const std::string& out);
+};
+
+class PosIndex
+{
+    MappedFile m_file;
+
+    uint32_t m_flags = 0;
+    std::vector<std::string> m_files;
+    const PosGame* m_games = nullptr;
+    uint64_t m_n_games = 0;
+    const PosEntry* m_entries = nullptr;
+    uint64_t m_n_entries = 0;
+    uint64_t m_n_hashes = 0;
+    BloomFilter m_bloom;
+public:
+    bool open(const std::string& file);
+    void close();
+
+    bool is_canonical() const { return (m_flags & POS_CANONICAL) != 0; };
+    uint64_t n_entries() const { return m_n_entries; };
+    uint64_t n_hashes() const { return m_n_hashes; };
+    const BloomFilter& bloom() const { return m_bloom; };
+
+    // Bloomフィルタで無いとわかればfalse。trueでも無いことはある
+    bool may_contain(uint64_t hash) const { return m_bloom.may_contain(hash); };
+
+    // 索引を作ったときと同じ方法でハッシュする
+    uint64_t hash(const Board& board) const;
+
+    // 見つかった数を返す。hitsにはlimit個まで入れる
+    size_t lookup(uint64_t hash, std::vector<PosHit>& hits, size_t limit = SIZE_MAX) const;
+    size_t lookup(const Board& board, std::vector<PosHit>& hits, size_t limit = SIZE_MAX) const;
+};
+
+#endif
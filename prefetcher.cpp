@@ -0,0 +1,151 @@
+#include <sys/stat.h>
+#include "prefetcher.h"
+#include "prof.h"
+#include "replay.h"
+#include "trace.h"
+
+static bool stat_file(const std::string& file, int64_t& mtime, uint64_t& size)
+{
+    struct stat st;
+
+    if (stat(file.c_str(), &st) != 0) {
+        return false;
+    }
+
+    mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    size = st.st_size;
+
+    return true;
+}
+
+Prefetcher::Prefetcher(ReadyFn fn)
+    : m_ready(fn)
+{
+}
+
+Prefetcher::~Prefetcher()
+{
+    stop();
+}
+
+void Prefetcher::start()
+{
+    m_thread = std::thread(&Prefetcher::run, this);
+}
+
+void Prefetcher::stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+
+    m_thread.join();
+}
+
+void Prefetcher::request(const std::string& file)
+{
+    if (file == "" || file == "-") {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_pending.count(file) || m_done.count(file)) {
+            return;
+        }
+
+        m_pending.insert(file);
+        m_requests.push_back(file);
+    }
+    m_wake.notify_one();
+}
+
+bool Prefetcher::take(const std::string& file, std::vector<std::shared_ptr<Node>>& trees)
+{
+    Prefetched p;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto itr = m_done.find(file);
+        if (itr == m_done.end()) {
+            return false;
+        }
+
+        p = std::move(itr->second);
+        m_done.erase(itr);
+    }
+
+    int64_t mtime;
+    uint64_t size;
+
+    // 読めなかったファイルは、開くときにいつもどおり読んでエラーを出す
+    if (!p.ok) {
+        return false;
+    }
+
+    if (!stat_file(file, mtime, size) || mtime != p.mtime || size != p.size) {
+        PROF_COUNT("prefetch.stale", 1);
+        return false;
+    }
+
+    PROF_COUNT("prefetch.hit", 1);
+    trees = std::move(p.trees);
+
+    return true;
+}
+
+void Prefetcher::run()
+{
+    for (;;) {
+        std::string file;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stop || !m_requests.empty(); });
+
+            if (m_stop) {
+                return;
+            }
+
+            file = m_requests.front();
+            m_requests.pop_front();
+        }
+
+        Prefetched p;
+        bool ok;
+
+        {
+            PROF_SCOPE("prefetch.load");
+            TRACE_SCOPE("prefetch.load");
+
+            // 読んでいる間に書き換えられても、take()で気づくように先に調べる
+            p.ok = stat_file(file, p.mtime, p.size) && load_trees(file, p.trees);
+            ok = p.ok;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_pending.erase(file);
+
+            // 取られないままのものは、どれか捨てる
+            if (m_done.size() >= PREFETCH_MAX_FILES) {
+                m_done.erase(m_done.begin());
+            }
+
+            m_done[file] = std::move(p);
+        }
+
+        if (ok && m_ready) {
+            m_ready();
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Node;
+
+// 次に開く棋譜のファイルを別のスレッドで先に読んでおく。
+// 読んだあとに書き換えられたファイルは、take()で捨てる
+
+#define PREFETCH_GAMES (2)  // 今の棋譜のあといくつ用意しておくか
+#define PREFETCH_MAX_FILES (8)  // 取られないまま溜めておく数
+
+// 読み終わったときに、先読みのスレッドから呼ぶ
+typedef std::function<void()> ReadyFn;
+
+class Prefetcher
+{
+    struct Prefetched
+    {
+        bool ok = false;  // 読めなかったものも、何度も読まないように残す
+        std::vector<std::shared_ptr<Node>> trees;
+        int64_t mtime = 0;  // ナノ秒
+        uint64_t size = 0;
+    };
+
+    ReadyFn m_ready;
+    std::thread m_thread;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop = false;
+    std::deque<std::string> m_requests;
+    std::set<std::string> m_pending;  // 頼まれたか読んでいるところ
+    std::map<std::string, Prefetched> m_done;
+
+    void run();
+public:
+    Prefetcher(ReadyFn fn);
+    ~Prefetcher();
+
+    void start();
+    void stop();
+
+    // すでに頼まれているか読み終わっていれば何もしない
+    void request(const std::string& file);
+    // 読み終わっていればtreesに移してtrue
+    bool take(const std::string& file, std::vector<std::shared_ptr<Node>>& trees);
+};
+
+#endif
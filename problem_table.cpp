@@ -0,0 +1,627 @@
+#include <sys/stat.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "problem_table.h"
+#include "g.h"
+#include "node.h"
+#include "prof.h"
+
+// G::load()と同じく、SZがなければ13
+static int game_size(std::shared_ptr<Node> root)
+{
+    int size = 13;
+
+    for (auto& p : root->properties) {
+        if (p->pid() == PID::SZ) {
+            p->int_val(&size);
+            break;
+        }
+    }
+
+    return size;
+}
+
+static int tree_depth(std::shared_ptr<Node> node)
+{
+    int depth = 0;
+
+    for (auto& child : node->children) {
+        depth = std::max(depth, tree_depth(child) + 1);
+    }
+
+    return depth;
+}
+
+static bool has_correct(std::shared_ptr<Node> node)
+{
+    for (auto& p : node->properties) {
+        if (p->is_correct()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int count_correct(std::shared_ptr<Node> node)
+{
+    int n = has_correct(node) ? 1 : 0;
+
+    for (auto& child : node->children) {
+        n += count_correct(child);
+    }
+
+    return n;
+}
+
+// 最初に見つかる正解までの手順
+static bool find_correct(std::shared_ptr<Node> node, std::vector<std::shared_ptr<Node>>& path)
+{
+    path.push_back(node);
+
+    if (has_correct(node)) {
+        return true;
+    }
+
+    for (auto& child : node->children) {
+        if (find_correct(child, path)) {
+            return true;
+        }
+    }
+
+    path.pop_back();
+
+    return false;
+}
+
+static int move_color(std::shared_ptr<Node> node)
+{
+    for (auto& p : node->properties) {
+        if (p->pid() == PID::B) {
+            return CELL_BLACK;
+        } else if (p->pid() == PID::W) {
+            return CELL_WHITE;
+        }
+    }
+
+    return CELL_SPACE;
+}
+
+// 正解手順の自分の手ごとに10、そこで選べた他の手ごとに1
+static int difficulty_of(std::shared_ptr<Node> root, int my_stone)
+{
+    std::vector<std::shared_ptr<Node>> path;
+
+    if (!find_correct(root, path)) {
+        return 0;
+    }
+
+    int d = 0;
+
+    for (size_t i = 0; i + 1 < path.size(); i++) {
+        if (move_color(path[i + 1]) == my_stone) {
+            d += 10 + path[i]->children.size() - 1;
+        }
+    }
+
+    return d;
+}
+
+static int region_of(int size, int x1, int y1, int x2, int y2)
+{
+    if (x1 > x2) {
+        return PROBLEM_NONE;
+    }
+
+    // 盤を3つに分けて、外接矩形の中心がどこにあるか
+    int w = x2 - x1 + 1;
+    int h = y2 - y1 + 1;
+
+    if (w * 3 > size * 2 || h * 3 > size * 2) {
+        return PROBLEM_WHOLE;
+    }
+
+    int cx = (x1 + x2) * 3 / 2;
+    int cy = (y1 + y2) * 3 / 2;
+    bool edge_x = (cx <= size + 1 || cx > (size + 1) * 2);
+    bool edge_y = (cy <= size + 1 || cy > (size + 1) * 2);
+
+    if (edge_x && edge_y) {
+        return PROBLEM_CORNER;
+    } else if (edge_x || edge_y) {
+        return PROBLEM_SIDE;
+    }
+
+    return PROBLEM_CENTER;
+}
+
+void ProblemTable::add_game(uint32_t file_id, uint32_t game_id, Game& g)
+{
+    std::shared_ptr<Node> root = g.get_root();
+    int sz = game_size(root);
+
+    // setup()で進めた最初の局面
+    Board board(std::min(std::max(sz, 1), MAX_BOARD_SIZE));
+    std::list<Move> hama;
+    const std::vector<std::shared_ptr<Node>>& nodes = g.get_route().get_nodes();
+
+    for (int i = 0; i <= g.get_route().get_idx(); i++) {
+        for (auto& p : nodes[i]->properties) {
+            int cell = -1;
+
+            switch (p->pid()) {
+            case PID::B:
+            case PID::W:
+                hama.clear();
+                board.make_move((p->pid() == PID::B) ? CELL_BLACK : CELL_WHITE, p->point().x, p->point().y, hama);
+                break;
+            case PID::AB:
+                cell = CELL_BLACK;
+                break;
+            case PID::AW:
+                cell = CELL_WHITE;
+                break;
+            case PID::AE:
+                cell = CELL_SPACE;
+                break;
+            default:
+                break;
+            }
+
+            if (cell == -1) {
+                continue;
+            }
+
+            for (auto& pt : p->points()) {
+                if (!board.is_out(pt.x, pt.y)) {
+                    board.set_cell(cell, pt.x, pt.y);
+                }
+            }
+        }
+    }
+
+    int n_stones = 0;
+    int bx1 = MAX_BOARD_SIZE + 1, by1 = MAX_BOARD_SIZE + 1, bx2 = 0, by2 = 0;
+
+    for (int y = 1; y <= board.get_size(); y++) {
+        for (int x = 1; x <= board.get_size(); x++) {
+            int cell = board.get_cell(x, y);
+
+            if (cell == CELL_BLACK || cell == CELL_WHITE) {
+                n_stones++;
+                bx1 = std::min(bx1, x);
+                by1 = std::min(by1, y);
+                bx2 = std::max(bx2, x);
+                by2 = std::max(by2, y);
+            }
+        }
+    }
+
+    file.push_back(file_id);
+    game.push_back(game_id);
+    hash.push_back(g.problem_hash());
+    size.push_back(sz);
+    to_play.push_back(g.get_my_stone());
+    stones.push_back(n_stones);
+    region.push_back(region_of(board.get_size(), bx1, by1, bx2, by2));
+    x1.push_back(n_stones ? bx1 : 0);
+    y1.push_back(n_stones ? by1 : 0);
+    x2.push_back(bx2);
+    y2.push_back(by2);
+    depth.push_back(std::min(tree_depth(root), 0xffff));
+    correct.push_back(std::min(count_correct(root), 0xffff));
+    difficulty.push_back(std::min(difficulty_of(root, g.get_my_stone()), 0xffff));
+}
+
+void ProblemTable::append_rows(const ProblemTable& other, uint32_t first, uint32_t n, uint32_t file_id)
+{
+    for (uint32_t i = first; i < first + n; i++) {
+        file.push_back(file_id);
+        game.push_back(other.game[i]);
+        hash.push_back(other.hash[i]);
+        size.push_back(other.size[i]);
+        to_play.push_back(other.to_play[i]);
+        stones.push_back(other.stones[i]);
+        region.push_back(other.region[i]);
+        x1.push_back(other.x1[i]);
+        y1.push_back(other.y1[i]);
+        x2.push_back(other.x2[i]);
+        y2.push_back(other.y2[i]);
+        depth.push_back(other.depth[i]);
+        correct.push_back(other.correct[i]);
+        difficulty.push_back(other.difficulty[i]);
+    }
+}
+
+bool ProblemTable::update(const std::vector<std::string>& files)
+{
+    PROF_SCOPE("problem_table.update");
+
+    ProblemTable old;
+    std::swap(old, *this);
+
+    std::map<std::string, const FileEntry*> old_files;
+    for (auto& f : old.m_files) {
+        old_files[f.name] = &f;
+    }
+
+    bool ok = true;
+
+    for (auto& name : files) {
+        struct stat st;
+
+        if (stat(name.c_str(), &st) != 0) {
+            std::cerr << "Error: couldn't open file: " << name << ": " << strerror(errno) << std::endl;
+            ok = false;
+            continue;
+        }
+
+        int64_t mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        uint32_t file_id = m_files.size();
+        FileEntry entry = {name, mtime, (uint64_t) st.st_size, (uint32_t) n_rows(), 0};
+
+        // 変わっていなければ前の表から引き継ぐ
+        auto itr = old_files.find(name);
+        if (itr != old_files.end() && itr->second->mtime == mtime && itr->second->size == entry.size) {
+            append_rows(old, itr->second->first, itr->second->n, file_id);
+            entry.n = itr->second->n;
+            m_files.push_back(entry);
+            m_n_reused++;
+            continue;
+        }
+
+        G g;
+
+        if (!g.load(Gmode::ANSWER, name)) {
+            ok = false;
+            continue;
+        }
+
+        for (Game* gm : g.get_games()) {
+            add_game(file_id, gm->file_game, *gm);
+        }
+
+        entry.n = n_rows() - entry.first;
+        m_files.push_back(entry);
+        m_n_parsed++;
+    }
+
+    return ok;
+}
+
+template <typename T>
+static void write_col(std::ostream& os, const std::vector<T>& col)
+{
+    os.write((const char*) col.data(), col.size() * sizeof(T));
+}
+
+template <typename T>
+static bool read_col(std::istream& is, std::vector<T>& col, uint64_t n)
+{
+    col.resize(n);
+    is.read((char*) col.data(), n * sizeof(T));
+
+    return (bool) is;
+}
+
+bool ProblemTable::save(const std::string& cache)
+{
+    std::string tmp = cache + ".tmp";
+    std::ofstream ofs(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    uint32_t version = PROBLEM_TABLE_VERSION;
+    uint32_t n_files = m_files.size();
+    uint32_t reserved = 0;
+    uint64_t n = n_rows();
+
+    ofs.write("GOQM", 4);
+    ofs.write((const char*) &version, sizeof(version));
+    ofs.write((const char*) &n_files, sizeof(n_files));
+    ofs.write((const char*) &reserved, sizeof(reserved));
+    ofs.write((const char*) &n, sizeof(n));
+
+    for (auto& f : m_files) {
+        uint32_t len = f.name.size();
+        ofs.write((const char*) &len, sizeof(len));
+        ofs.write(f.name.data(), len);
+        ofs.write((const char*) &f.mtime, sizeof(f.mtime));
+        ofs.write((const char*) &f.size, sizeof(f.size));
+        ofs.write((const char*) &f.first, sizeof(f.first));
+        ofs.write((const char*) &f.n, sizeof(f.n));
+    }
+
+    write_col(ofs, file);
+    write_col(ofs, game);
+    write_col(ofs, hash);
+    write_col(ofs, size);
+    write_col(ofs, to_play);
+    write_col(ofs, stones);
+    write_col(ofs, region);
+    write_col(ofs, x1);
+    write_col(ofs, y1);
+    write_col(ofs, x2);
+    write_col(ofs, y2);
+    write_col(ofs, depth);
+    write_col(ofs, correct);
+    write_col(ofs, difficulty);
+    ofs.close();
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't write file: " << tmp << std::endl;
+        return false;
+    }
+
+    if (rename(tmp.c_str(), cache.c_str()) != 0) {
+        std::cerr << "Error: couldn't rename file: " << tmp << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool ProblemTable::load(const std::string& cache)
+{
+    std::ifstream ifs(cache, std::ios::in | std::ios::binary);
+
+    if (!ifs) {
+        std::cerr << "Error: couldn't open file: " << cache << std::endl;
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t n_files = 0;
+    uint32_t reserved;
+    uint64_t n = 0;
+
+    ifs.read(magic, 4);
+    ifs.read((char*) &version, sizeof(version));
+    ifs.read((char*) &n_files, sizeof(n_files));
+    ifs.read((char*) &reserved, sizeof(reserved));
+    ifs.read((char*) &n, sizeof(n));
+
+    ProblemTable t;
+    bool ok = ifs && memcmp(magic, "GOQM", 4) == 0 && version == PROBLEM_TABLE_VERSION;
+
+    for (uint32_t i = 0; ok && i < n_files; i++) {
+        FileEntry f;
+        uint32_t len = 0;
+
+        ifs.read((char*) &len, sizeof(len));
+        f.name.resize(ifs ? len : 0);
+        ifs.read(&f.name[0], f.name.size());
+        ifs.read((char*) &f.mtime, sizeof(f.mtime));
+        ifs.read((char*) &f.size, sizeof(f.size));
+        ifs.read((char*) &f.first, sizeof(f.first));
+        ifs.read((char*) &f.n, sizeof(f.n));
+
+        ok = ifs && (uint64_t) f.first + f.n <= n;
+        t.m_files.push_back(f);
+    }
+
+    ok = ok && read_col(ifs, t.file, n) && read_col(ifs, t.game, n) && read_col(ifs, t.hash, n)
+        && read_col(ifs, t.size, n) && read_col(ifs, t.to_play, n) && read_col(ifs, t.stones, n)
+        && read_col(ifs, t.region, n) && read_col(ifs, t.x1, n) && read_col(ifs, t.y1, n)
+        && read_col(ifs, t.x2, n) && read_col(ifs, t.y2, n) && read_col(ifs, t.depth, n)
+        && read_col(ifs, t.correct, n) && read_col(ifs, t.difficulty, n);
+
+    for (uint64_t i = 0; ok && i < n; i++) {
+        ok = t.file[i] < n_files;
+    }
+
+    if (!ok) {
+        std::cerr << "Error: broken problem table: " << cache << std::endl;
+        return false;
+    }
+
+    std::swap(*this, t);
+
+    return true;
+}
+
+template <typename T>
+static void filter_eq(const std::vector<T>& col, int v, std::vector<uint8_t>& keep)
+{
+    for (size_t i = 0; i < col.size(); i++) {
+        keep[i] &= (col[i] == v);
+    }
+}
+
+template <typename T>
+static void filter_range(const std::vector<T>& col, int lo, int hi, std::vector<uint8_t>& keep)
+{
+    for (size_t i = 0; i < col.size(); i++) {
+        keep[i] &= (col[i] >= lo) & (col[i] <= hi);
+    }
+}
+
+template <typename T>
+static void sort_by(const std::vector<T>& col, bool desc, std::vector<uint32_t>& rows)
+{
+    if (desc) {
+        std::stable_sort(rows.begin(), rows.end(), [&col](uint32_t a, uint32_t b) { return col[a] > col[b]; });
+    } else {
+        std::stable_sort(rows.begin(), rows.end(), [&col](uint32_t a, uint32_t b) { return col[a] < col[b]; });
+    }
+}
+
+bool ProblemTable::query(const ProblemFilter& f, const std::string& key, bool desc,
+        std::vector<uint32_t>& rows) const
+{
+    PROF_SCOPE("problem_table.query");
+
+    std::vector<uint8_t> keep(n_rows(), 1);
+
+    if (f.size) {
+        filter_eq(size, f.size, keep);
+    }
+    if (f.to_play) {
+        filter_eq(to_play, f.to_play, keep);
+    }
+    if (f.region >= 0) {
+        filter_eq(region, f.region, keep);
+    }
+    filter_range(stones, f.min_stones, f.max_stones, keep);
+    filter_range(depth, f.min_depth, f.max_depth, keep);
+    filter_range(correct, f.min_correct, f.max_correct, keep);
+    filter_range(difficulty, f.min_difficulty, f.max_difficulty, keep);
+
+    rows.clear();
+    for (size_t i = 0; i < keep.size(); i++) {
+        if (keep[i]) {
+            rows.push_back(i);
+        }
+    }
+
+    if (key == "") {
+        return true;
+    } else if (key == "size") {
+        sort_by(size, desc, rows);
+    } else if (key == "stones") {
+        sort_by(stones, desc, rows);
+    } else if (key == "depth") {
+        sort_by(depth, desc, rows);
+    } else if (key == "correct") {
+        sort_by(correct, desc, rows);
+    } else if (key == "difficulty") {
+        sort_by(difficulty, desc, rows);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<std::pair<std::string, int>> ProblemTable::to_queue(const std::vector<uint32_t>& rows) const
+{
+    std::vector<std::pair<std::string, int>> queue;
+
+    for (auto r : rows) {
+        queue.push_back(std::make_pair(m_files[file[r]].name, (int) game[r]));
+    }
+
+    return queue;
+}
+
+// 0以上の整数だけ。"stones<0" は何にも合わない条件になる
+static bool parse_count(const std::string& val, int* v)
+{
+    if (val == "" || val.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+
+    errno = 0;
+    long n = strtol(val.c_str(), nullptr, 10);
+    if (errno != 0 || n >= INT_MAX) {
+        return false;
+    }
+
+    *v = (int) n;
+
+    return true;
+}
+
+static bool set_range(const std::string& op, int v, int* lo, int* hi)
+{
+    if (op == "=") {
+        *lo = v;
+        *hi = v;
+    } else if (op == "<") {
+        *hi = v - 1;
+    } else if (op == "<=") {
+        *hi = v;
+    } else if (op == ">") {
+        *lo = v + 1;
+    } else if (op == ">=") {
+        *lo = v;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+bool ProblemFilter::parse(const std::string& s)
+{
+    std::istringstream iss(s);
+    std::string term;
+
+    while (std::getline(iss, term, ',')) {
+        if (term == "") {
+            continue;
+        }
+
+        size_t p = term.find_first_of("=<>");
+        if (p == std::string::npos || p == 0) {
+            return false;
+        }
+
+        size_t q = term.find_first_not_of("=<>", p);
+        if (q == std::string::npos) {
+            return false;
+        }
+
+        std::string key = term.substr(0, p);
+        std::string op = term.substr(p, q - p);
+        std::string val = term.substr(q);
+        int v = 0;
+
+        if (key != "play" && key != "region" && !parse_count(val, &v)) {
+            return false;
+        }
+
+        if (key == "size" && op == "=") {
+            size = v;
+        } else if (key == "play" && op == "=") {
+            if (val == "B" || val == "b" || val == "black") {
+                to_play = CELL_BLACK;
+            } else if (val == "W" || val == "w" || val == "white") {
+                to_play = CELL_WHITE;
+            } else {
+                return false;
+            }
+        } else if (key == "region" && op == "=") {
+            if (val == "corner") {
+                region = PROBLEM_CORNER;
+            } else if (val == "side") {
+                region = PROBLEM_SIDE;
+            } else if (val == "center") {
+                region = PROBLEM_CENTER;
+            } else if (val == "whole") {
+                region = PROBLEM_WHOLE;
+            } else {
+                return false;
+            }
+        } else if (key == "stones") {
+            if (!set_range(op, v, &min_stones, &max_stones)) {
+                return false;
+            }
+        } else if (key == "depth") {
+            if (!set_range(op, v, &min_depth, &max_depth)) {
+                return false;
+            }
+        } else if (key == "correct") {
+            if (!set_range(op, v, &min_correct, &max_correct)) {
+                return false;
+            }
+        } else if (key == "difficulty") {
+            if (!set_range(op, v, &min_difficulty, &max_difficulty)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
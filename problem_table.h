@@ -0,0 +1,118 @@
+#ifndef PROBLEM_TABLE_H
+#define PROBLEM_TABLE_H
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Game;
+
+// 問題ごとの属性の表。列ごとに配列で持ち、絞り込みと並べ替えは列をなめるだけで
+// SGFの木には触らない。
+// 作った表はファイルに保存し、大きさと更新時刻が同じファイルは計算し直さない。
+//
+// 列:
+//   size        盤の大きさ
+//   to_play     解く側の色（Game::set_my_stone()と同じ）
+//   stones      最初の局面の石の数
+//   region      石のある範囲（PROBLEM_CORNER など）。x1, y1, x2, y2 はその外接矩形
+//   depth       木の深さ（rootからの手数の最大）
+//   correct     正解の数（正解の印のある手）
+//   difficulty  難しさの目安。最初の正解手順の自分の手数 * 10 + その途中で選べた他の手の数
+//   hash        Game::problem_hash()。間違えた問題の記録と突き合わせる
+//
+// ファイルの形式（リトルエンディアン）:
+//   "GOQM" u32 version u32 n_files u32 予約 u64 n_rows
+//   ファイル n_files個 [u32 長さ][バイト列][i64 更新時刻（ナノ秒）][u64 大きさ][u32 最初の行][u32 行数]
+//   列ごとに n_rows個ずつ（file, game, hash, size, to_play, stones, region, x1, y1, x2, y2,
+//   depth, correct, difficulty の順）
+
+#define PROBLEM_TABLE_VERSION (1)
+
+enum {
+    PROBLEM_NONE = 0,  // 石がない
+    PROBLEM_CORNER,
+    PROBLEM_SIDE,
+    PROBLEM_CENTER,
+    PROBLEM_WHOLE,     // 盤の大部分
+};
+
+// 絞り込みの条件。sizeとto_playの0、regionの-1は条件なし。
+// 範囲はmin以上max以下で、初めは0からINT_MAXまで
+struct ProblemFilter
+{
+    int size = 0;
+    int to_play = 0;  // CELL_BLACK か CELL_WHITE
+    int region = -1;
+    int min_stones = 0;
+    int max_stones = INT_MAX;
+    int min_depth = 0;
+    int max_depth = INT_MAX;
+    int min_correct = 0;
+    int max_correct = INT_MAX;
+    int min_difficulty = 0;
+    int max_difficulty = INT_MAX;
+
+    // "size=9,play=B,stones<12,region=corner" のような書き方。
+    // 比較は = < <= > >=。数は0以上の整数。わからなければfalse
+    bool parse(const std::string& s);
+};
+
+class ProblemTable
+{
+    struct FileEntry
+    {
+        std::string name;
+        int64_t mtime;
+        uint64_t size;
+        uint32_t first;
+        uint32_t n;
+    };
+
+    std::vector<FileEntry> m_files;
+    size_t m_n_parsed = 0;
+    size_t m_n_reused = 0;
+
+    void add_game(uint32_t file, uint32_t game, Game& g);
+    void append_rows(const ProblemTable& other, uint32_t first, uint32_t n, uint32_t file);
+public:
+    // 列
+    std::vector<uint32_t> file;
+    std::vector<uint32_t> game;  // ファイル内で何番目か（0から）
+    std::vector<uint64_t> hash;
+    std::vector<uint8_t> size;
+    std::vector<uint8_t> to_play;
+    std::vector<uint16_t> stones;
+    std::vector<uint8_t> region;
+    std::vector<uint8_t> x1, y1, x2, y2;
+    std::vector<uint16_t> depth;
+    std::vector<uint16_t> correct;
+    std::vector<uint16_t> difficulty;
+
+    size_t n_rows() const { return file.size(); };
+    size_t n_files() const { return m_files.size(); };
+    const std::string& file_name(uint32_t i) const { return m_files[i].name; };
+
+    size_t n_parsed() const { return m_n_parsed; };
+    size_t n_reused() const { return m_n_reused; };
+
+    bool load(const std::string& cache);
+    bool save(const std::string& cache);
+
+    // filesの表にする。前の表（load()したもの）から変わっていないファイルは引き継ぐ
+    bool update(const std::vector<std::string>& files);
+
+    // 条件に合う行を、sort_keyの列の順（descなら大きい順）に返す。
+    // sort_keyが""なら元の順。わからない列名ならfalse
+    bool query(const ProblemFilter& filter, const std::string& sort_key, bool desc,
+            std::vector<uint32_t>& rows) const;
+
+    // 行を（ファイル名, 何番目か）にする
+    std::vector<std::pair<std::string, int>> to_queue(const std::vector<uint32_t>& rows) const;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include "prof.h"
+
+std::atomic<bool> prof_enabled(false);
+
+static std::mutex sites_mutex;
+static ProfSite* sites = nullptr;
+static std::string out_file = "";
+
+ProfSite::ProfSite(const char* name, bool is_timer)
+    : name(name), count(0), total_ns(0), max_ns(0), is_timer(is_timer)
+{
+    for (auto& b : buckets) {
+        b.store(0, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(sites_mutex);
+    next = sites;
+    sites = this;
+}
+
+void ProfSite::record(uint64_t ns)
+{
+    int i = 0;
+    while (i < PROF_BUCKETS - 1 && (ns >> (i + 1)) != 0) {
+        i++;
+    }
+
+    count.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = max_ns.load(std::memory_order_relaxed);
+    while (ns > max && !max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+// ヒストグラムから百分位数の上限を求める
+static uint64_t bucket_percentile(const ProfSite& site, uint64_t n, double p)
+{
+    uint64_t rank = n * p / 100;
+    uint64_t sum = 0;
+
+    int i = 0;
+    for (; i < PROF_BUCKETS - 1; i++) {
+        sum += site.buckets[i].load(std::memory_order_relaxed);
+        if (sum > rank) {
+            break;
+        }
+    }
+
+    uint64_t bound = uint64_t(1) << (i + 1);
+    uint64_t max = site.max_ns.load(std::memory_order_relaxed);
+
+    return bound < max ? bound : max;
+}
+
+void prof_dump(std::ostream& os)
+{
+    std::lock_guard<std::mutex> lock(sites_mutex);
+
+    os << "==== goq prof ====" << std::endl;
+
+    for (ProfSite* site = sites; site != nullptr; site = site->next) {
+        uint64_t n = site->count.load(std::memory_order_relaxed);
+
+        if (n == 0) {
+            continue;
+        }
+
+        char buf[256];
+
+        if (!site->is_timer) {
+            snprintf(buf, sizeof(buf), "%-24s count=%llu", site->name, (unsigned long long) n);
+            os << buf << std::endl;
+            continue;
+        }
+
+        double total = site->total_ns.load(std::memory_order_relaxed) / 1e6;
+        snprintf(buf, sizeof(buf), "%-24s count=%llu total=%.3fms mean=%.1fus p50<%.1fus p99<%.1fus max=%.1fus",
+                site->name, (unsigned long long) n, total, total * 1000 / n,
+                bucket_percentile(*site, n, 50) / 1e3, bucket_percentile(*site, n, 99) / 1e3,
+                site->max_ns.load(std::memory_order_relaxed) / 1e3);
+        os << buf << std::endl;
+
+        for (int i = 0; i < PROF_BUCKETS; i++) {
+            uint64_t c = site->buckets[i].load(std::memory_order_relaxed);
+
+            if (c == 0) {
+                continue;
+            }
+
+            int bar = c * 40 / n;
+            snprintf(buf, sizeof(buf), "    < %12.3fus %8llu ", (uint64_t(1) << (i + 1)) / 1e3,
+                    (unsigned long long) c);
+            os << buf << std::string(bar, '#') << std::endl;
+        }
+    }
+}
+
+#ifdef GOQ_PROF
+static void dump_at_exit()
+{
+    if (out_file == "") {
+        prof_dump(std::cerr);
+        return;
+    }
+
+    std::ofstream ofs(out_file);
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't open file: " << out_file << std::endl;
+        return;
+    }
+
+    prof_dump(ofs);
+}
+#endif
+
+void prof_enable(const std::string& out)
+{
+#ifndef GOQ_PROF
+    (void) out;
+    std::cerr << "goq: built without GOQ_PROF (make PROF=1), profiling is not available" << std::endl;
+#else
+    if (prof_enabled.exchange(true)) {
+        return;
+    }
+
+    out_file = out;
+    atexit(dump_at_exit);
+#endif
+}
+
+void prof_init()
+{
+    const char* env = getenv("GOQ_PROF");
+
+    if (env == nullptr || env[0] == '\0' || std::string(env) == "0") {
+        return;
+    }
+
+    if (std::string(env) == "1") {
+        prof_enable();
+    } else {
+        prof_enable(env);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+
+// 処理時間の計測。-DGOQ_PROF（make PROF=1）でコンパイルしたときだけ有効になる。
+// 有効でも、環境変数 GOQ_PROF か --prof を指定しなければ計測しない
+//
+//   PROF_SCOPE("g.load");        // スコープを抜けるまでの時間
+//   PROF_COUNT("paint.cells", n);  // 回数を足す
+//
+// 終了時（またはPROF_DUMP()）に、名前ごとの回数と時間のヒストグラムを書き出す
+
+#define PROF_BUCKETS (40)  // 2^i ナノ秒ごと
+
+class ProfSite
+{
+public:
+    const char* name;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> buckets[PROF_BUCKETS];
+    bool is_timer;
+    ProfSite* next;
+
+    ProfSite(const char* name, bool is_timer);
+
+    void add(uint64_t n) { count.fetch_add(n, std::memory_order_relaxed); };
+    void record(uint64_t ns);
+};
+
+extern std::atomic<bool> prof_enabled;
+
+class ProfScope
+{
+    ProfSite* m_site = nullptr;
+    std::chrono::steady_clock::time_point m_start;
+public:
+    ProfScope(ProfSite& site) {
+        if (prof_enabled.load(std::memory_order_relaxed)) {
+            m_site = &site;
+            m_start = std::chrono::steady_clock::now();
+        }
+    };
+    ~ProfScope() {
+        if (m_site) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - m_start).count();
+            m_site->record(ns);
+        }
+    };
+};
+
+// 環境変数 GOQ_PROF を見て計測を始める。値が 1 以外ならそのファイルに書き出す
+void prof_init();
+void prof_enable(const std::string& out="");
+void prof_dump(std::ostream& os);
+
+#define PROF_CAT2(a, b) a##b
+#define PROF_CAT(a, b) PROF_CAT2(a, b)
+
+#ifdef GOQ_PROF
+#define PROF_SCOPE(name) \
+    static ProfSite PROF_CAT(prof_site_, __LINE__)(name, true); \
+    ProfScope PROF_CAT(prof_scope_, __LINE__)(PROF_CAT(prof_site_, __LINE__))
+#define PROF_COUNT(name, n) \
+    do { \
+        static ProfSite prof_site(name, false); \
+        if (prof_enabled.load(std::memory_order_relaxed)) { \
+            prof_site.add(n); \
+        } \
+    } while (0)
+#define PROF_DUMP() prof_dump(std::cerr)
+#else
+#define PROF_SCOPE(name)
+#define PROF_COUNT(name, n)
+#define PROF_DUMP()
+#endif
+
+#endif
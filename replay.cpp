@@ -0,0 +1,130 @@
+#include <fstream>
+#include <iostream>
+#include "replay.h"
+#include "g.h"
+#include "gio.h"
+#include "node.h"
+
+bool load_trees(std::istream& is, std::vector<std::shared_ptr<Node>>& trees)
+{
+    std::shared_ptr<Node> root(new Node(true));
+    Route route(root);
+    int num = 0;
+
+    while (get_token(is) == Token::L_PAREN) {
+        if (!load_node(route, is)) {
+            break;
+        }
+        num++;
+    }
+
+    if (num == 0) {
+        return false;
+    }
+
+    for (auto n : root->children) {
+        trees.push_back(n);
+    }
+
+    return true;
+}
+
+bool load_trees(const std::string& file, std::vector<std::shared_ptr<Node>>& trees)
+{
+    std::ifstream ifs(file);
+
+    if (!ifs) {
+        std::cerr << "Error: couldn't open file: " << file << std::endl;
+        return false;
+    }
+
+    if (!load_trees(ifs, trees)) {
+        std::cerr << "Error: not found '('. file = " << file << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+int tree_size(std::shared_ptr<Node> root)
+{
+    int size = MAX_BOARD_SIZE;
+
+    for (auto& p : root->properties) {
+        if (p->pid() == PID::SZ) {
+            p->int_val(&size);
+            break;
+        }
+    }
+
+    if (size < 1 || size > MAX_BOARD_SIZE) {
+        size = MAX_BOARD_SIZE;
+    }
+
+    return size;
+}
+
+int replay_main_line(std::shared_ptr<Node> root, const ReplayFn& fn)
+{
+    int size = tree_size(root);
+    Board board(size);
+    std::list<Move> hama;
+    int n = 0;
+
+    for (std::shared_ptr<Node> node = root; node; ) {
+        Move move;
+
+        for (auto& p : node->properties) {
+            int cell = -1;
+
+            switch (p->pid()) {
+            case PID::B:
+            case PID::W:
+                move.cell = (p->pid() == PID::B) ? CELL_BLACK : CELL_WHITE;
+                move.x = p->point().x;
+                move.y = p->point().y;
+                break;
+            case PID::AB:
+                cell = CELL_BLACK;
+                break;
+            case PID::AW:
+                cell = CELL_WHITE;
+                break;
+            case PID::AE:
+                cell = CELL_SPACE;
+                break;
+            default:
+                break;
+            }
+
+            if (cell == -1) {
+                continue;
+            }
+
+            for (auto& pt : p->points()) {
+                if (!board.is_out(pt.x, pt.y)) {
+                    board.set_cell(cell, pt.x, pt.y);
+                }
+            }
+        }
+
+        if (move.cell != CELL_SPACE) {
+            if (!fn(board, move, n)) {
+                return n;
+            }
+
+            hama.clear();
+            if (!board.make_move(move.cell, move.x, move.y, hama)) {
+                return n;
+            }
+
+            n++;
+        }
+
+        node = node->children.empty() ? nullptr : node->children.front();
+    }
+
+    fn(board, Move(), n);
+
+    return n;
+}
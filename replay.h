@@ -0,0 +1,29 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "board.h"
+
+class Node;
+
+// 索引を作るツール向け。Gameを作らずにSGFの木だけを読み込む
+bool load_trees(std::istream& is, std::vector<std::shared_ptr<Node>>& trees);
+bool load_trees(const std::string& file, std::vector<std::shared_ptr<Node>>& trees);
+
+// 木のrootから盤の大きさを読む。なければ19
+int tree_size(std::shared_ptr<Node> root);
+
+// 着手の前の盤面、次の手、手数(0から)。falseを返すとそこで止める
+typedef std::function<bool(const Board& board, const Move& next, int n)> ReplayFn;
+
+// 本手順（最初の子）を盤に打ちながらたどり、着手のたびにその前の盤面でfnを呼ぶ。
+// 最後の局面ではnextをMove()にして呼ぶ。パスは(20, 20)。
+// 途中のAB/AW/AEも盤に置く。打てない手があればそこで終わる。
+// 打った手数を返す
+int replay_main_line(std::shared_ptr<Node> root, const ReplayFn& fn);
+
+#endif
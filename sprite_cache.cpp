@@ -0,0 +1,224 @@
+#include <wx/graphics.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+#include "sprite_cache.h"
+#include "board.h"
+
+// 色
+wxColour board_color(214, 130, 34);
+wxBrush board_brush(board_color);
+
+static wxColour black_stone_colour(0x10, 0x10, 0x10);
+static wxColour white_stone_colour(0xe0, 0xe0, 0xe0);
+static wxBrush black_stone_brush(black_stone_colour);
+static wxBrush white_stone_brush(white_stone_colour);
+static wxBrush tr_black_stone_brush(wxColour(0x10, 0x10, 0x10, 0x80));
+static wxBrush tr_white_stone_brush(wxColour(0xe0, 0xe0, 0xe0, 0x80));
+static wxPen black_stone_pen(black_stone_colour, 3);
+static wxPen white_stone_pen(white_stone_colour, 3);
+
+static wxPen blue_pen(*wxBLUE, 5);
+static wxPen red_pen(*wxRED, 5);
+
+// 謎の数字
+static const double fzemgaqojefaslkjhfa = 0.866;
+
+bool SpriteCache::Key::operator<(const Key& k) const
+{
+    return std::tie(kind, stone, variant, label) < std::tie(k.kind, k.stone, k.variant, k.label);
+}
+
+void SpriteCache::set_cell(double space_w, double scale)
+{
+    if (space_w == m_space_w && scale == m_scale) {
+        return;
+    }
+
+    m_space_w = space_w;
+    m_scale = scale;
+    m_side = std::ceil(space_w) + 2;
+    m_sprites.clear();
+
+    m_fonts[0] = wxFont(space_w / 2, wxFONTFAMILY_DEFAULT,
+            wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+    m_fonts[1] = wxFont(space_w / 2.5, wxFONTFAMILY_DEFAULT,
+            wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+    m_fonts[2] = wxFont(space_w / 3, wxFONTFAMILY_DEFAULT,
+            wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+}
+
+const wxBitmap& SpriteCache::get(int kind, int stone, int variant, const std::string& label)
+{
+    Key key = {kind, stone, variant, label};
+
+    auto itr = m_sprites.find(key);
+    if (itr != m_sprites.end()) {
+        return itr->second;
+    }
+
+    return m_sprites[key] = render(key);
+}
+
+// 空点の記号は線を隠すために盤の色で塗りつぶす
+static void fill_space(wxGraphicsContext* gc, int stone, double c, double sp)
+{
+    if ((stone & 3) != CELL_SPACE) {
+        return;
+    }
+
+    gc->SetPen(wxNullPen);
+    gc->SetBrush(board_brush);
+    gc->DrawRectangle(c - sp, c - sp, sp*2, sp*2);
+}
+
+static const wxPen& stone_pen(int stone)
+{
+    if (stone == CELL_BLACK) {
+        return white_stone_pen;
+    }
+
+    return black_stone_pen;
+}
+
+wxBitmap SpriteCache::render(const Key& key)
+{
+    int n = std::ceil(m_side * m_scale);
+
+    wxImage img(n, n);
+    img.InitAlpha();
+    memset(img.GetAlpha(), 0, n * n);  // 透明
+
+    wxGraphicsContext* gc = wxGraphicsContext::Create(img);
+    if (!gc) {
+        return wxBitmap(img);
+    }
+
+    gc->SetAntialiasMode(wxANTIALIAS_DEFAULT);
+    gc->Scale(m_scale, m_scale);
+
+    double space_w = m_space_w;
+    double c = m_side / 2.0;  // 中心
+    double st_r = space_w / 2.1;
+    double focus_w = space_w / 3;
+
+    switch (key.kind) {
+    case SPRITE_STONE:
+        if (key.stone == CELL_BLACK) {
+            gc->SetPen(wxNullPen);
+            gc->SetBrush(black_stone_brush);
+        } else {
+            gc->SetPen(*wxBLACK_PEN);
+            gc->SetBrush(white_stone_brush);
+        }
+
+        gc->DrawEllipse(c - st_r, c - st_r, st_r*2, st_r*2);
+        break;
+
+    case SPRITE_GHOST:
+        gc->SetPen(wxNullPen);
+        if (key.stone == CELL_BLACK) {
+            gc->SetBrush(tr_black_stone_brush);
+        } else {
+            gc->SetBrush(tr_white_stone_brush);
+        }
+
+        gc->DrawEllipse(c - space_w/2, c - space_w/2, st_r*2, st_r*2);
+        break;
+
+    case SPRITE_MA:
+    {
+        int ma_d = space_w / 3.5;
+        int sp = space_w / 2.5;
+
+        fill_space(gc, key.stone, c, sp);
+
+        gc->SetPen(key.variant ? red_pen : stone_pen(key.stone));
+        gc->StrokeLine(c - ma_d, c - ma_d, c + ma_d, c + ma_d);
+        gc->StrokeLine(c + ma_d, c - ma_d, c - ma_d, c + ma_d);
+        break;
+    }
+
+    case SPRITE_TR:
+    {
+        double tr_d1 = space_w / 2.9;
+        double tr_d2 = tr_d1 * fzemgaqojefaslkjhfa;
+        double tr_d3 = tr_d1 / 2;
+        int sp = space_w / 2;
+
+        fill_space(gc, key.stone, c, sp);
+
+        gc->SetPen(stone_pen(key.stone));
+        gc->StrokeLine(c, c - tr_d1, c + tr_d2, c + tr_d3);
+        gc->StrokeLine(c + tr_d2, c + tr_d3, c - tr_d2, c + tr_d3);
+        gc->StrokeLine(c - tr_d2, c + tr_d3, c, c - tr_d1);
+        break;
+    }
+
+    case SPRITE_CR:
+    {
+        double cr_r = space_w / 2.9;
+        int sp = space_w / 2;
+
+        fill_space(gc, key.stone, c, sp);
+
+        gc->SetPen(key.variant ? blue_pen : stone_pen(key.stone));
+        gc->SetBrush(wxNullBrush);
+        gc->DrawEllipse(c - cr_r, c - cr_r, cr_r*2, cr_r*2);
+        break;
+    }
+
+    case SPRITE_LAST:
+    case SPRITE_FOCUS:
+        gc->SetPen(wxNullPen);
+        gc->SetBrush(key.kind == SPRITE_LAST ? *wxRED_BRUSH : *wxBLUE_BRUSH);
+        gc->DrawRectangle(c - focus_w / 2, c - focus_w / 2, focus_w, focus_w);
+        break;
+
+    case SPRITE_LABEL:
+    {
+        const std::string& s = key.label;
+        const wxFont& font = m_fonts[s.length() <= 1 ? 0 : (s.length() == 2 ? 1 : 2)];
+
+        if (key.stone == CELL_BLACK) {
+            gc->SetFont(font, *wxWHITE);
+        } else {
+            gc->SetFont(font, *wxBLACK);
+        }
+
+        double w, h;
+        gc->GetTextExtent(s, &w, &h);
+
+        if (key.stone == CELL_SPACE) {
+            gc->SetPen(wxNullPen);
+            gc->SetBrush(board_brush);
+            gc->DrawRectangle(c - w/2, c - h/2, w, h);
+        }
+
+        gc->DrawText(s, c - w/2, c - h/2);
+        break;
+    }
+
+    case SPRITE_HEAT:
+    {
+        int alpha = std::min(0x30 + key.variant * 2, 0xd0);
+        double heat_r = st_r * 0.8;
+
+        gc->SetPen(wxNullPen);
+        gc->SetBrush(wxBrush(wxColour(0xff, 0x20, 0x20, alpha)));
+        gc->DrawEllipse(c - heat_r, c - heat_r, heat_r*2, heat_r*2);
+
+        std::string s = std::to_string(key.variant);
+        double w, h;
+        gc->SetFont(m_fonts[2], *wxBLACK);
+        gc->GetTextExtent(s, &w, &h);
+        gc->DrawText(s, c - w/2, c - h/2);
+        break;
+    }
+    }
+
+    delete gc;  // ここでimgに書き戻される
+
+    return wxBitmap(img, -1, m_scale);
+}
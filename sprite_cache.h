@@ -0,0 +1,64 @@
+#ifndef SPRITE_CACHE_H
+#define SPRITE_CACHE_H
+
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+
+#include <map>
+#include <string>
+
+extern wxColour board_color;
+extern wxBrush board_brush;
+
+enum SpriteKind {
+    SPRITE_STONE,
+    SPRITE_GHOST,  // 半透明の石
+    SPRITE_MA,
+    SPRITE_TR,
+    SPRITE_CR,
+    SPRITE_LAST,   // 最後に打った石の印
+    SPRITE_FOCUS,
+    SPRITE_LABEL,
+    SPRITE_HEAT,   // 次の手の頻度
+};
+
+// 石や記号をアンチエイリアスをかけて一度だけ描いておき、描画時は貼るだけにする。
+// マスの大きさとHiDPIの倍率が変わったら全部作り直す。
+class SpriteCache
+{
+    struct Key
+    {
+        int kind;
+        int stone;    // 下にある石の色
+        int variant;  // 記号の色違い（間違い、正解）
+        std::string label;
+
+        bool operator<(const Key& k) const;
+    };
+
+    double m_space_w = 0;
+    double m_scale = 0;
+    int m_side = 0;  // 1つのスプライトの一辺
+    wxFont m_fonts[3];
+    std::map<Key, wxBitmap> m_sprites;
+
+    wxBitmap render(const Key& key);
+    const wxBitmap& get(int kind, int stone, int variant, const std::string& label="");
+public:
+    void set_cell(double space_w, double scale);
+
+    int side() const { return m_side; };
+    const wxFont& font(int i) const { return m_fonts[i]; };
+
+    const wxBitmap& stone(int stone) { return get(SPRITE_STONE, stone, 0); };
+    const wxBitmap& ghost(int stone) { return get(SPRITE_GHOST, stone, 0); };
+    const wxBitmap& markup(int kind, int stone, bool alt) { return get(kind, stone, alt); };
+    const wxBitmap& mark(int kind) { return get(kind, 0, 0); };
+    const wxBitmap& label(const std::string& s, int stone) { return get(SPRITE_LABEL, stone, 0, s); };
+    // percentは1-100。多いほど濃い
+    const wxBitmap& heat(int percent) { return get(SPRITE_HEAT, 0, percent); };
+};
+
+#endif
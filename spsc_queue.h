@@ -0,0 +1,73 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// 1つのスレッドが入れ、別の1つのスレッドが取り出す固定長のキュー。ロックは使わない。
+// 大きさは2のべき乗に切り上げる
+template <typename T>
+class SpscQueue
+{
+    std::vector<T> m_buf;
+    size_t m_mask;
+
+    // 入れる側と取り出す側で同じキャッシュラインを取り合わないように離す
+    char m_pad0[64];
+    std::atomic<size_t> m_head;  // 次に取り出す位置。取り出す側だけが書く
+    char m_pad1[64];
+    std::atomic<size_t> m_tail;  // 次に入れる位置。入れる側だけが書く
+    char m_pad2[64];
+public:
+    explicit SpscQueue(size_t capacity)
+        : m_head(0), m_tail(0)
+    {
+        size_t n = 1;
+        while (n < capacity) {
+            n <<= 1;
+        }
+
+        m_buf.resize(n);
+        m_mask = n - 1;
+    }
+
+    // 一杯ならfalse
+    bool push(T&& v)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+            return false;
+        }
+
+        m_buf[tail & m_mask] = std::move(v);
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // 空ならfalse
+    bool pop(T& v)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        v = std::move(m_buf[head & m_mask]);
+        m_buf[head & m_mask] = T();
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool empty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+};
+
+#endif
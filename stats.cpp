@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "stats.h"
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+
+    double rank = p / 100 * (sorted.size() - 1);
+    int lo = std::floor(rank);
+    int hi = std::ceil(rank);
+
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+Stats summarize(std::vector<double>& samples)
+{
+    Stats st;
+
+    if (samples.empty()) {
+        return st;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0;
+    for (double v : samples) {
+        sum += v;
+    }
+
+    st.n = samples.size();
+    st.min = samples.front();
+    st.max = samples.back();
+    st.mean = sum / samples.size();
+    st.p50 = percentile(samples, 50);
+    st.p90 = percentile(samples, 90);
+    st.p99 = percentile(samples, 99);
+
+    return st;
+}
+
+std::string json_str(const std::string& s)
+{
+    std::string r = "\"";
+
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') {
+            r += '\\';
+            r += ch;
+        } else if ((unsigned char) ch < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            r += buf;
+        } else {
+            r += ch;
+        }
+    }
+
+    r += "\"";
+
+    return r;
+}
@@ -0,0 +1,28 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <string>
+#include <vector>
+
+// 計測値（ナノ秒等）の要約。ベンチマークや操作のリプレイで使う
+struct Stats
+{
+    int n = 0;
+    double min = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// samplesは並べ替えられる
+Stats summarize(std::vector<double>& samples);
+
+// 並べ替え済みのsortedから百分位数を求める（線形補間）
+double percentile(const std::vector<double>& sorted, double p);
+
+// JSONの文字列リテラルにする
+std::string json_str(const std::string& s);
+
+#endif
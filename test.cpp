@@ -1,6 +1,22 @@
+#include <cstdio>
 #include <iostream>
+#include <sstream>
 #include "command.h"
 #include "g.h"
+#include "journal.h"
+#include "kifu_store.h"
+#include "replay.h"
+#include "zobrist.h"
+
+static bool failed = false;
+
+static void check(bool ok, const std::string& what)
+{
+    if (!ok) {
+        std::cerr << "NG: " << what << std::endl;
+        failed = true;
+    }
+}
 
 void create_tree(G& g) {
     (void)g;
@@ -9,7 +25,7 @@ void create_tree(G& g) {
 void test_load_sgf()
 {
     G g;
-    if (!g.load("a.sgf")) {
+    if (!g.load(Gmode::ANSWER, "a.sgf")) {
         return;
     }
 
@@ -38,10 +54,202 @@ void test_board()
     std::cout << g.board << std::endl;
 }
 
+// 回転・鏡映・黒白入れ替えをした局面は、同じcanonical()になる
+void test_sym_hash()
+{
+    const int size = 9;
+    const Move stones[] = {{CELL_BLACK, 3, 3}, {CELL_WHITE, 4, 3}, {CELL_BLACK, 7, 2}, {CELL_WHITE, 5, 8}};
+
+    SymHash base(size);
+    for (auto& m : stones) {
+        base.toggle(m.cell, m.x, m.y);
+    }
+    base.toggle_turn(CELL_BLACK);
+
+    for (int s = 0; s < N_SYMS; s++) {
+        for (int flip = 0; flip < 2; flip++) {
+            SymHash h(size);
+
+            for (auto& m : stones) {
+                Point pt = sym_transform(s, size, Point(m.x, m.y));
+                int stone = flip ? (m.cell == CELL_BLACK ? CELL_WHITE : CELL_BLACK) : m.cell;
+                h.toggle(stone, pt.x, pt.y);
+            }
+            h.toggle_turn(flip ? CELL_WHITE : CELL_BLACK);
+
+            check(h.canonical() == base.canonical(),
+                    "sym_hash: s = " + std::to_string(s) + ", flip = " + std::to_string(flip));
+        }
+    }
+
+    // 1つ動かせば別の局面
+    SymHash other(size);
+    for (auto& m : stones) {
+        other.toggle(m.cell, m.x, m.y == 8 ? 9 : m.y);
+    }
+    other.toggle_turn(CELL_BLACK);
+    check(other.canonical() != base.canonical(), "sym_hash: different position");
+
+    // 同じ石を2回toggleすると元に戻る
+    SymHash twice = base;
+    twice.toggle(CELL_WHITE, 1, 1);
+    twice.toggle(CELL_WHITE, 1, 1);
+    check(twice.canonical() == base.canonical(), "sym_hash: toggle twice");
+}
+
+static bool same_moves(const std::vector<Move>& a, const std::vector<Move>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!(a[i] == b[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool same_kifu(const KifuGame& a, const KifuGame& b)
+{
+    return a.info.size == b.info.size && a.info.black == b.info.black && a.info.white == b.info.white &&
+        a.info.result == b.info.result && a.info.date == b.info.date &&
+        same_moves(a.setup, b.setup) && same_moves(a.moves, b.moves);
+}
+
+// SGF → 詰める → 読む → SGF で、置き石、パス、続けて同じ色が打つ手、遠くへの手が残る
+void test_kifu_store()
+{
+    const char* sgf = "(;GM[1]FF[4]SZ[19]PB[Black]PW[White]RE[B+R]DT[2020-01-01]AB[dd][pp]AW[dp]"
+        ";W[pd];B[qf];W[tt];B[cc];B[aa];W[ss];B[jj])";
+    const char* file = "test.kifu";
+
+    std::istringstream is(sgf);
+    std::vector<std::shared_ptr<Node>> trees;
+    check(load_trees(is, trees) && trees.size() == 1, "kifu_store: load sgf");
+    if (trees.size() != 1) {
+        return;
+    }
+
+    KifuGame orig;
+    kifu_from_tree(trees[0], orig);
+    check(orig.setup.size() == 3 && orig.moves.size() == 7, "kifu_store: kifu_from_tree");
+
+    for (uint32_t flags : {0u, (uint32_t) KIFU_ENTROPY}) {
+        std::string what = "kifu_store(flags = " + std::to_string(flags) + "): ";
+
+        KifuWriter writer;
+        check(writer.open(file, flags) && writer.add(orig) && writer.close(), what + "write");
+
+        KifuReader reader;
+        KifuGame game;
+        check(reader.open(file) && reader.n_games() == 1 && reader.read(0, game), what + "read");
+        check(same_kifu(orig, game), what + "read back");
+        reader.close();
+
+        std::ostringstream os;
+        write_kifu_sgf(os, game);
+
+        std::istringstream is2(os.str());
+        std::vector<std::shared_ptr<Node>> trees2;
+        KifuGame again;
+        check(load_trees(is2, trees2) && trees2.size() == 1, what + "load written sgf");
+        if (trees2.size() == 1) {
+            kifu_from_tree(trees2[0], again);
+            check(same_kifu(orig, again), what + "sgf round trip");
+        }
+    }
+
+    std::remove(file);
+}
+
+static std::string games_sgf(G& g)
+{
+    std::string s;
+
+    for (auto game : g.get_games()) {
+        s += std::to_string(static_cast<int>(game->get_mode())) + " " + game->get_root()->to_sgf() + "\n";
+    }
+
+    return s;
+}
+
+// 記録しながら編集し、別のGで記録から戻すと同じ棋譜になる
+void test_journal()
+{
+    const std::string file = "test.journal";
+    std::string sgf;
+
+    {
+        G g;
+        Journal journal(g, file);
+        journal.recover();
+        check(journal.compact(), "journal: compact");
+        g.add_listener(&journal);
+
+        g.current().put_stone(CELL_BLACK, 3, 3);
+        g.current().put_stone(CELL_WHITE, 4, 4);
+        g.set_comment("comment");
+        g.current().undo();
+        g.current().put_stone(CELL_WHITE, 5, 5);
+
+        sgf = games_sgf(g);
+    }
+
+    {
+        G g;
+        Journal journal(g, file);
+        check(journal.recover(), "journal: recover");
+        check(games_sgf(g) == sgf, "journal: round trip");
+    }
+
+    std::remove(file.c_str());
+    std::remove((file + ".snap").c_str());
+}
+
+// 差分で更新したハッシュが、盤全体から作ったものと同じになる。取られた石と途中のAEも含む
+void test_board_hasher()
+{
+    const char* sgf = "(;GM[1]FF[4]SZ[9]AB[ee];B[ba];W[aa];B[ab];W[cc];AE[ee];B[dd];W[ef];B[ge])";
+
+    std::istringstream is(sgf);
+    std::vector<std::shared_ptr<Node>> trees;
+    if (!load_trees(is, trees) || trees.size() != 1) {
+        check(false, "board_hasher: load sgf");
+        return;
+    }
+
+    for (bool canonical : {false, true}) {
+        BoardHasher hasher(canonical);
+        bool same = true;
+
+        int n = replay_main_line(trees[0], [&](const Board& board, const Move& next, int n) {
+            (void) next;
+            (void) n;
+
+            int sym1, sym2;
+            uint64_t h1 = hasher.hash(board, &sym1);
+            uint64_t h2 = board_hash(board, canonical, &sym2);
+            same = same && h1 == h2 && sym1 == sym2;
+
+            return true;
+        });
+
+        check(n == 7, "board_hasher: replay");
+        check(same, std::string("board_hasher: canonical = ") + (canonical ? "true" : "false"));
+    }
+}
+
 int main()
 {
     test_board();
     test_load_sgf();
+    test_sym_hash();
+    test_board_hasher();
+    test_kifu_store();
+    test_journal();
 
-    return 0;
+    return failed ? 1 : 0;
 }
@@ -0,0 +1,135 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include "trace.h"
+
+std::atomic<bool> trace_enabled(false);
+
+// 1スレッド分の記録。書くのは持ち主のスレッドだけ
+struct TraceBuffer
+{
+    int tid;
+    std::atomic<uint64_t> head;  // これまでに書いた数
+    TraceEvent events[TRACE_BUFFER_SIZE];
+
+    TraceBuffer(int tid) : tid(tid), head(0) {};
+};
+
+static std::mutex buffers_mutex;
+static std::vector<TraceBuffer*> buffers;  // 終了時に書き出すので解放しない
+static std::string out_file = "";
+
+static const std::chrono::steady_clock::time_point trace_start = std::chrono::steady_clock::now();
+
+uint64_t trace_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - trace_start).count();
+}
+
+static TraceBuffer* get_buffer()
+{
+    static thread_local TraceBuffer* buf = nullptr;
+
+    if (buf == nullptr) {
+        std::lock_guard<std::mutex> lock(buffers_mutex);
+        buf = new TraceBuffer(buffers.size() + 1);
+        buffers.push_back(buf);
+    }
+
+    return buf;
+}
+
+void trace_record(const char* name, uint64_t start_ns, uint64_t end_ns)
+{
+    TraceBuffer* buf = get_buffer();
+    uint64_t head = buf->head.load(std::memory_order_relaxed);
+
+    TraceEvent& ev = buf->events[head % TRACE_BUFFER_SIZE];
+    ev.name = name;
+    ev.start_ns = start_ns;
+    ev.dur_ns = end_ns - start_ns;
+
+    buf->head.store(head + 1, std::memory_order_release);
+}
+
+// 開始と終了をまとめた "X" イベントで書き出す。リングバッファで古いものが
+// 消えても、開始と終了の対応が崩れない
+bool trace_write(const std::string& filename)
+{
+    std::ofstream ofs(filename);
+
+    if (!ofs) {
+        std::cerr << "Error: couldn't open file: " << filename << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+
+    bool first = true;
+    for (TraceBuffer* buf : buffers) {
+        uint64_t head = buf->head.load(std::memory_order_acquire);
+        uint64_t begin = head > TRACE_BUFFER_SIZE ? head - TRACE_BUFFER_SIZE : 0;
+
+        for (uint64_t i = begin; i < head; i++) {
+            const TraceEvent& ev = buf->events[i % TRACE_BUFFER_SIZE];
+            char line[256];
+
+            snprintf(line, sizeof(line),
+                    "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    first ? "" : ",\n", ev.name, buf->tid, ev.start_ns / 1e3, ev.dur_ns / 1e3);
+            ofs << line;
+            first = false;
+        }
+    }
+
+    ofs << std::endl << "]}" << std::endl;
+
+    return true;
+}
+
+#ifdef GOQ_TRACE
+static void write_at_exit()
+{
+    trace_enabled.store(false);
+
+    if (trace_write(out_file)) {
+        std::cerr << "trace: " << out_file << std::endl;
+    }
+}
+#endif
+
+void trace_enable(const std::string& out)
+{
+#ifndef GOQ_TRACE
+    (void) out;
+    std::cerr << "goq: built without GOQ_TRACE (make TRACE=1), tracing is not available" << std::endl;
+#else
+    if (trace_enabled.exchange(true)) {
+        return;
+    }
+
+    out_file = out;
+    atexit(write_at_exit);
+#endif
+}
+
+void trace_init()
+{
+    const char* env = getenv("GOQ_TRACE");
+
+    if (env == nullptr || env[0] == '\0' || std::string(env) == "0") {
+        return;
+    }
+
+    if (std::string(env) == "1") {
+        trace_enable("goq-trace.json");
+    } else {
+        trace_enable(env);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// タイムラインの記録。-DGOQ_TRACE（make TRACE=1）でコンパイルしたときだけ有効になる。
+// 環境変数 GOQ_TRACE か --trace でファイル名を指定すると記録を始め、終了時に
+// Chromeのtrace形式（chrome://tracing や Perfetto で開ける）のJSONを書き出す
+//
+//   TRACE_SCOPE("board_window.key");
+//
+// 記録はスレッドごとのリングバッファに書く。ロックは取らず、古いものから上書きする
+
+#define TRACE_BUFFER_SIZE (1 << 16)
+
+struct TraceEvent
+{
+    const char* name;  // 文字列リテラルに限る
+    uint64_t start_ns;
+    uint64_t dur_ns;
+};
+
+extern std::atomic<bool> trace_enabled;
+
+uint64_t trace_now();
+void trace_record(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+class TraceScope
+{
+    const char* m_name = nullptr;
+    uint64_t m_start = 0;
+public:
+    TraceScope(const char* name) {
+        if (trace_enabled.load(std::memory_order_relaxed)) {
+            m_name = name;
+            m_start = trace_now();
+        }
+    };
+    ~TraceScope() {
+        if (m_name) {
+            trace_record(m_name, m_start, trace_now());
+        }
+    };
+};
+
+// 環境変数 GOQ_TRACE を見て記録を始める
+void trace_init();
+void trace_enable(const std::string& out);
+bool trace_write(const std::string& filename);
+
+#define TRACE_CAT2(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT2(a, b)
+
+#ifdef GOQ_TRACE
+#define TRACE_SCOPE(name) TraceScope TRACE_CAT(trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+#endif
@@ -0,0 +1,373 @@
+#include <wx/imaglist.h>
+#include "tree_model.h"
+#include "node.h"
+#include "trace.h"
+
+TreeModel::TreeModel(wxImageList* images, G& g, std::recursive_mutex& lock)
+    : m_g(g), m_lock(lock)
+{
+    for (int i = 0; i <= 8; i++) {
+        m_icons.push_back(images->GetIcon(i));
+    }
+}
+
+static int tree_image(Game& g, Node* node, bool is_cur, bool in_route)
+{
+    int cell = CELL_SPACE;
+    if (node->has(PID::B)) {
+        cell = CELL_BLACK;
+    } else if (node->has(PID::W)) {
+        cell = CELL_WHITE;
+    }
+
+    cell = g.flip(cell);
+
+    int image_no = 0;
+
+    if (cell == CELL_SPACE) {
+        if (is_cur) {
+            image_no = 1;
+        } else if (in_route) {
+            image_no = 2;
+        } else {
+            image_no = 0;
+        }
+    } else if (cell == CELL_BLACK) {
+        if (is_cur) {
+            image_no = 4;
+        } else if (in_route) {
+            image_no = 5;
+        } else {
+            image_no = 3;
+        }
+    } else {
+        if (is_cur) {
+            image_no = 7;
+        } else if (in_route) {
+            image_no = 8;
+        } else {
+            image_no = 6;
+        }
+    }
+
+    return image_no;
+}
+
+void TreeModel::GetValue(wxVariant& variant, const wxDataViewItem& item, unsigned int col) const
+{
+    (void)col;
+
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+
+    Node* node = row_node(item);
+
+    if (node == nullptr || !is_current()) {
+        return;
+    }
+
+    std::string s;
+
+    auto itr = m_rows.find(node);
+    if (itr->second.branch >= 0) {
+        s += 'A' + itr->second.branch;
+        s += ": ";
+    }
+
+    s += node->to_string(*m_game);
+
+    bool is_cur = (m_cur.get() == node);
+    bool in_route = (m_route_set.count(node) != 0);
+    int image_no = tree_image(*m_game, node, is_cur, in_route);
+
+    variant << wxDataViewIconText(wxString::FromUTF8(s), m_icons[image_no]);
+}
+
+bool TreeModel::SetValue(const wxVariant& variant, const wxDataViewItem& item, unsigned int col)
+{
+    (void)variant;
+    (void)item;
+    (void)col;
+
+    return false;
+}
+
+wxDataViewItem TreeModel::GetParent(const wxDataViewItem& item) const
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+
+    Node* node = static_cast<Node*>(item.GetID());
+
+    auto itr = m_rows.find(node);
+    if (itr == m_rows.end()) {
+        return wxDataViewItem(nullptr);
+    }
+
+    return wxDataViewItem(itr->second.parent);
+}
+
+bool TreeModel::IsContainer(const wxDataViewItem& item) const
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+
+    if (item.GetID() == nullptr) {
+        return true;
+    }
+
+    Node* node = row_node(item);
+
+    if (node == nullptr || !is_current()) {
+        return false;
+    }
+
+    return node->children.size() >= 2;
+}
+
+// 子は展開されたときに初めて読み込まれる
+unsigned int TreeModel::GetChildren(const wxDataViewItem& item, wxDataViewItemArray& children) const
+{
+    std::lock_guard<std::recursive_mutex> lock(m_lock);
+
+    if (!is_current()) {
+        return 0;
+    }
+
+    Node* parent = row_node(item);
+
+    if (parent == nullptr && item.GetID() != nullptr) {
+        return 0;
+    }
+
+    m_loaded.insert(parent);
+
+    std::list<std::shared_ptr<Node>> heads;
+
+    if (parent == nullptr) {
+        heads.push_back(m_game->get_root());
+    } else if (parent->children.size() >= 2) {
+        heads = parent->children;
+    }
+
+    int branch = (parent == nullptr) ? -1 : 0;
+
+    for (auto head : heads) {
+        std::shared_ptr<Node> node = head;
+        m_rows[node.get()] = RowInfo{node, parent, branch};
+        children.Add(wxDataViewItem(node.get()));
+
+        // 一本道は同じ親の下に並べる
+        while (node->children.size() == 1) {
+            node = node->children.front();
+            m_rows[node.get()] = RowInfo{node, parent, -1};
+            children.Add(wxDataViewItem(node.get()));
+        }
+
+        if (branch >= 0) {
+            branch++;
+        }
+    }
+
+    return children.size();
+}
+
+// 行として持っているノード。持っていない（Cleared()より前の）行ならnullptr
+Node* TreeModel::row_node(const wxDataViewItem& item) const
+{
+    auto itr = m_rows.find(static_cast<Node*>(item.GetID()));
+
+    if (itr == m_rows.end()) {
+        return nullptr;
+    }
+
+    return itr->second.node.get();
+}
+
+bool TreeModel::is_loaded(Node* node) const
+{
+    return m_loaded.count(node) != 0;
+}
+
+// 棋譜が消されたり切り替わったりしたあと、RESETが届くまでは古い木を読まない
+bool TreeModel::is_current() const
+{
+    return m_game != nullptr && m_g.current().get_serial() == m_serial;
+}
+
+wxDataViewItem TreeModel::current_item()
+{
+    return wxDataViewItem(m_cur.get());
+}
+
+void TreeModel::changed(Node* node)
+{
+    auto itr = m_rows.find(node);
+
+    if (itr == m_rows.end() || !is_loaded(itr->second.parent)) {
+        return;
+    }
+
+    ItemChanged(wxDataViewItem(node));
+}
+
+// routeのfrom番目以降のノードの表示上の親を登録する。
+// 展開されていなくてもEnsureVisibleで親を辿れるようにするため
+void TreeModel::register_route(size_t from)
+{
+    for (size_t i = from; i < m_route.size(); i++) {
+        Node* node = m_route[i].get();
+
+        if (i == 0) {
+            m_rows[node] = RowInfo{m_route[i], nullptr, -1};
+            continue;
+        }
+
+        Node* parent = m_route[i-1].get();
+
+        if (parent->children.size() >= 2) {
+            int branch = 0;
+            for (auto n : parent->children) {
+                if (n.get() == node) {
+                    break;
+                }
+                branch++;
+            }
+
+            m_rows[node] = RowInfo{m_route[i], parent, branch};
+        } else {
+            m_rows[node] = RowInfo{m_route[i], m_rows[parent].parent, -1};
+        }
+    }
+}
+
+void TreeModel::reset(Game& g)
+{
+    TRACE_SCOPE("tree_model.reset");
+
+    m_game = &g;
+    m_serial = g.get_serial();
+    m_rows.clear();
+    m_loaded.clear();
+
+    Route& route = g.get_route();
+    m_route = route.get_nodes();
+    m_cur = route.current();
+
+    m_route_set.clear();
+    for (auto n : m_route) {
+        m_route_set.insert(n.get());
+    }
+
+    register_route(0);
+
+    Cleared();
+}
+
+// 今の木ではなく、イベントが起きたときの子と子の数で足す
+void TreeModel::add_child(std::shared_ptr<Node> node, std::shared_ptr<Node> child, int n_children)
+{
+    if (!child || n_children <= 0) {
+        reset(*m_game);
+        return;
+    }
+
+    // イベントが届く前に展開され、今の木からもう並べてある
+    if (m_rows.count(child.get()) != 0) {
+        return;
+    }
+
+    if (n_children == 1) {
+        // 一本道が伸びただけ
+        auto itr = m_rows.find(node.get());
+        if (itr == m_rows.end() || !is_loaded(itr->second.parent)) {
+            return;
+        }
+
+        Node* parent = itr->second.parent;
+        m_rows[child.get()] = RowInfo{child, parent, -1};
+        ItemAdded(wxDataViewItem(parent), wxDataViewItem(child.get()));
+    } else if (n_children >= 3) {
+        // 分岐が増えただけ
+        if (!is_loaded(node.get())) {
+            return;
+        }
+
+        m_rows[child.get()] = RowInfo{child, node.get(), n_children - 1};
+        ItemAdded(wxDataViewItem(node.get()), wxDataViewItem(child.get()));
+    } else {
+        // 一本道が分岐に変わったので、並びが変わる
+        reset(*m_game);
+    }
+}
+
+// routeが変わった行だけ更新する
+void TreeModel::update_route()
+{
+    Route& route = m_game->get_route();
+    const std::vector<std::shared_ptr<Node>>& nodes = route.get_nodes();
+    std::shared_ptr<Node> cur = route.current();
+
+    // 木の中の道なので、一度分かれたら同じノードは現れない
+    size_t same = 0;
+    while (same < nodes.size() && same < m_route.size() && nodes[same] == m_route[same]) {
+        same++;
+    }
+
+    std::vector<std::shared_ptr<Node>> old_route;
+    old_route.swap(m_route);
+    m_route = nodes;
+
+    for (size_t i = same; i < old_route.size(); i++) {
+        m_route_set.erase(old_route[i].get());
+    }
+
+    for (size_t i = same; i < m_route.size(); i++) {
+        m_route_set.insert(m_route[i].get());
+    }
+
+    register_route(same);
+
+    std::shared_ptr<Node> old_cur = m_cur;
+    m_cur = cur;
+
+    for (size_t i = same; i < old_route.size(); i++) {
+        changed(old_route[i].get());
+    }
+
+    for (size_t i = same; i < m_route.size(); i++) {
+        changed(m_route[i].get());
+    }
+
+    if (old_cur && old_cur != cur) {
+        changed(old_cur.get());
+    }
+
+    changed(cur.get());
+}
+
+void TreeModel::on_tree(Game& g, TreeEvent ev, std::shared_ptr<Node> node,
+        std::shared_ptr<Node> child, int n_children)
+{
+    if (m_game == nullptr || m_serial != g.get_serial() || ev == TreeEvent::RESET || (ev != TreeEvent::MOVED && !node)) {
+        reset(g);
+        return;
+    }
+
+    switch (ev) {
+    case TreeEvent::ADDED:
+        add_child(node, child, n_children);
+        break;
+
+    case TreeEvent::REMOVED:
+        // 削除されたノードのアドレスが使い回されるかもしれないので作り直す
+        reset(g);
+        return;
+
+    case TreeEvent::CHANGED:
+        changed(node.get());
+        break;
+
+    default:
+        break;
+    }
+
+    update_route();
+}
@@ -0,0 +1,74 @@
+#ifndef TREE_MODEL_H
+#define TREE_MODEL_H
+
+#include <wx/wxprec.h>
+#ifndef WX_PRECOMP
+    #include <wx/wx.h>
+#endif
+#include <wx/dataview.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "g.h"
+
+class wxImageList;
+
+// 変化の木をwxDataViewCtrlに見せる仮想モデル。
+// 表示する行はNode*そのもので、ラベルやアイコンは見えている行の分だけ作る。
+// 一本道は同じ親の下に並べ、分岐するノードの下に各分岐を並べる。
+// 木はモデルのスレッドが変えるので、読むときはlockを持ち、今の棋譜かどうかを確かめる。
+// イベントは遅れて届き、その間に木から外されたノードもあるので、行はshared_ptrで持って消させない
+class TreeModel : public wxDataViewModel
+{
+    struct RowInfo
+    {
+        std::shared_ptr<Node> node;
+        Node* parent;  // 表示上の親。nullptrなら一番上
+        int branch;    // 分岐の先頭なら何番目の分岐か。それ以外は-1
+    };
+
+    G& m_g;
+    std::recursive_mutex& m_lock;
+    Game* m_game = nullptr;
+    uint64_t m_serial = 0;  // m_gameのGame::get_serial()
+    std::vector<wxIcon> m_icons;
+
+    // 子を読み込んだ行と、その子の情報だけ持つ
+    mutable std::unordered_map<Node*, RowInfo> m_rows;
+    mutable std::unordered_set<Node*> m_loaded;
+
+    std::vector<std::shared_ptr<Node>> m_route;
+    std::unordered_set<Node*> m_route_set;
+    std::shared_ptr<Node> m_cur;
+
+    void reset(Game& g);
+    void add_child(std::shared_ptr<Node> node, std::shared_ptr<Node> child, int n_children);
+    Node* row_node(const wxDataViewItem& item) const;
+    void changed(Node* node);
+    void register_route(size_t from);
+    void update_route();
+    bool is_loaded(Node* node) const;
+    bool is_current() const;
+public:
+    TreeModel(wxImageList* images, G& g, std::recursive_mutex& lock);
+
+    // ADDEDのときは、イベントが起きたときに足された子とnodeの子の数を渡す
+    void on_tree(Game& g, TreeEvent ev, std::shared_ptr<Node> node,
+            std::shared_ptr<Node> child = nullptr, int n_children = 0);
+    wxDataViewItem current_item();
+
+    virtual unsigned int GetColumnCount() const { return 1; };
+    virtual wxString GetColumnType(unsigned int col) const { (void)col; return "wxDataViewIconText"; };
+
+    virtual void GetValue(wxVariant& variant, const wxDataViewItem& item, unsigned int col) const;
+    virtual bool SetValue(const wxVariant& variant, const wxDataViewItem& item, unsigned int col);
+
+    virtual wxDataViewItem GetParent(const wxDataViewItem& item) const;
+    virtual bool IsContainer(const wxDataViewItem& item) const;
+    virtual unsigned int GetChildren(const wxDataViewItem& item, wxDataViewItemArray& children) const;
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "wrong_log.h"
+
+WrongLog::WrongLog(const std::string& filename, size_t capacity, FsyncPolicy policy, int interval_ms)
+    : m_filename(filename), m_capacity(capacity), m_policy(policy), m_interval_ms(interval_ms)
+{
+    m_thread = std::thread(&WrongLog::run, this);
+}
+
+// 残っているものを書いてから終わる
+WrongLog::~WrongLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    m_thread.join();
+
+    if (m_fd != -1) {
+        if (m_policy != FsyncPolicy::NEVER) {
+            fsync(m_fd);
+        }
+        close(m_fd);
+    }
+}
+
+// 書くものがあればtrue。すでに書いた問題やキューが一杯のときはfalse
+bool WrongLog::push(size_t problem, const std::string& sgf)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_seen.count(problem) != 0) {
+            return false;
+        }
+
+        if (m_queue.size() >= m_capacity) {
+            m_dropped++;
+            return false;
+        }
+
+        m_seen.insert(problem);
+        m_queue.push_back({problem, sgf});
+    }
+
+    m_cond.notify_one();
+
+    return true;
+}
+
+// キューが空になり、書き終わるまで待つ
+void WrongLog::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_queue.empty() && !m_writing; });
+}
+
+int WrongLog::dropped()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void WrongLog::run()
+{
+    auto last_sync = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+
+        if (m_queue.empty()) {  // m_stop
+            break;
+        }
+
+        // 溜まっている分をまとめて1回で書く
+        std::string buf;
+        for (auto& e : m_queue) {
+            buf += e.sgf;
+            buf += '\n';
+        }
+        m_queue.clear();
+        m_writing = true;
+
+        lock.unlock();
+
+        if (write_batch(buf)) {
+            auto now = std::chrono::steady_clock::now();
+            bool do_sync = false;
+
+            if (m_policy == FsyncPolicy::BATCH) {
+                do_sync = true;
+            } else if (m_policy == FsyncPolicy::INTERVAL) {
+                do_sync = now - last_sync >= std::chrono::milliseconds(m_interval_ms);
+            }
+
+            if (do_sync) {
+                fsync(m_fd);
+                last_sync = now;
+            }
+        }
+
+        lock.lock();
+        m_writing = false;
+        m_done.notify_all();
+    }
+
+    m_done.notify_all();
+}
+
+bool WrongLog::write_batch(const std::string& buf)
+{
+    if (m_fd == -1) {
+        m_fd = open(m_filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+
+        if (m_fd == -1) {
+            std::cerr << "Error: couldn't open file: " << m_filename << std::endl;
+            return false;
+        }
+    }
+
+    const char* p = buf.data();
+    size_t left = buf.size();
+
+    while (left > 0) {
+        ssize_t n = write(m_fd, p, left);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            std::cerr << "Error: couldn't write file: " << m_filename << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        p += n;
+        left -= n;
+    }
+
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef WRONG_LOG_H
+#define WRONG_LOG_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+// いつfsyncするか
+enum class FsyncPolicy {
+    NEVER,     // OSに任せる
+    BATCH,     // まとめて書くたびに
+    INTERVAL,  // 前回からinterval_ms以上経っていたら
+};
+
+// 間違えた問題を別スレッドでファイルに追記する。
+// push()はキューに入れるだけなので、盤面の操作を止めない。
+// 同じ問題は一度しか書かない。キューが一杯のときは捨てる
+class WrongLog
+{
+    struct Entry
+    {
+        size_t problem;
+        std::string sgf;
+    };
+
+    std::string m_filename;
+    size_t m_capacity;
+    FsyncPolicy m_policy;
+    int m_interval_ms;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::condition_variable m_done;
+    std::deque<Entry> m_queue;
+    std::unordered_set<size_t> m_seen;
+    bool m_writing = false;
+    bool m_stop = false;
+    int m_dropped = 0;
+
+    int m_fd = -1;
+    std::thread m_thread;
+
+    void run();
+    bool write_batch(const std::string& buf);
+public:
+    WrongLog(const std::string& filename, size_t capacity=256,
+            FsyncPolicy policy=FsyncPolicy::BATCH, int interval_ms=1000);
+    ~WrongLog();
+
+    bool push(size_t problem, const std::string& sgf);
+    void flush();
+    int dropped();
+};
+
+#endif
@@ -0,0 +1,310 @@
+#include "zobrist.h"
+#include "node.h"
+
+namespace {
+
+struct Table
+{
+    uint64_t stone[CELLS_SIZE][CELLS_SIZE][2];
+    uint64_t size[CELLS_SIZE];
+    uint64_t turn[2];
+
+    Table() {
+        uint64_t seed = 0x676f712d7a6f6272ULL;
+
+        for (int y = 0; y < CELLS_SIZE; y++) {
+            for (int x = 0; x < CELLS_SIZE; x++) {
+                stone[y][x][0] = next(seed);
+                stone[y][x][1] = next(seed);
+            }
+        }
+
+        for (int i = 0; i < CELLS_SIZE; i++) {
+            size[i] = next(seed);
+        }
+
+        turn[0] = next(seed);
+        turn[1] = next(seed);
+    }
+
+    // splitmix64
+    static uint64_t next(uint64_t& x) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+};
+
+const Table& table()
+{
+    static const Table t;
+    return t;
+}
+
+// CELL_BLACK -> 0, CELL_WHITE -> 1
+inline int color_idx(int stone, bool color_flip)
+{
+    return ((stone & CELL_WHITE) ? 1 : 0) ^ (color_flip ? 1 : 0);
+}
+
+}
+
+Point sym_transform(int s, int size, Point pt)
+{
+    if (s & 4) {
+        pt.x = size - pt.x + 1;
+    }
+
+    switch (s & 3) {
+    case 0:
+        break;
+    case 1:
+        pt = Point(size - pt.y + 1, pt.x);
+        break;
+    case 2:
+        pt = Point(size - pt.x + 1, size - pt.y + 1);
+        break;
+    default:
+        pt = Point(pt.y, size - pt.x + 1);
+        break;
+    }
+
+    return pt;
+}
+
+SymHash::SymHash(int size)
+{
+    init(size);
+}
+
+void SymHash::init(int size)
+{
+    if (size < 1 || size > MAX_BOARD_SIZE) {
+        size = MAX_BOARD_SIZE;
+    }
+
+    m_size = size;
+
+    for (auto& h : m_h) {
+        h = table().size[size];
+    }
+}
+
+void SymHash::toggle(int stone, int x, int y)
+{
+    const Table& t = table();
+
+    for (int s = 0; s < N_SYMS; s++) {
+        Point pt = sym_transform(s, m_size, Point(x, y));
+
+        m_h[s * 2] ^= t.stone[pt.y][pt.x][color_idx(stone, false)];
+        m_h[s * 2 + 1] ^= t.stone[pt.y][pt.x][color_idx(stone, true)];
+    }
+}
+
+void SymHash::toggle_turn(int stone)
+{
+    const Table& t = table();
+
+    for (int s = 0; s < N_SYMS; s++) {
+        m_h[s * 2] ^= t.turn[color_idx(stone, false)];
+        m_h[s * 2 + 1] ^= t.turn[color_idx(stone, true)];
+    }
+}
+
+uint64_t SymHash::canonical() const
+{
+    return m_h[canonical_index()];
+}
+
+int SymHash::canonical_index() const
+{
+    int idx = 0;
+
+    for (int i = 1; i < N_SYMS * 2; i++) {
+        if (m_h[i] < m_h[idx]) {
+            idx = i;
+        }
+    }
+
+    return idx;
+}
+
+uint64_t board_hash(const Board& board, bool canonical, int* sym)
+{
+    int size = board.get_size();
+    SymHash h(size);
+
+    for (int y = 1; y <= size; y++) {
+        for (int x = 1; x <= size; x++) {
+            int stone = board.get_val(x, y) & 3;
+
+            if (stone != CELL_SPACE) {
+                h.toggle(stone, x, y);
+            }
+        }
+    }
+
+    int idx = canonical ? h.canonical_index() : 0;
+
+    if (sym) {
+        *sym = idx;
+    }
+
+    return h.get(idx / 2, idx % 2);
+}
+
+void BoardHasher::reset(int size)
+{
+    m_size = size;
+
+    for (auto& row : m_cells) {
+        for (auto& c : row) {
+            c = CELL_SPACE;
+        }
+    }
+
+    m_sym.init(size);
+    m_h = table().size[(size < 1 || size > MAX_BOARD_SIZE) ? MAX_BOARD_SIZE : size];
+}
+
+uint64_t BoardHasher::hash(const Board& board, int* sym)
+{
+    int size = board.get_size();
+
+    if (size != m_size) {
+        reset(size);
+    }
+
+    const Table& t = table();
+
+    for (int y = 1; y <= size; y++) {
+        for (int x = 1; x <= size; x++) {
+            int stone = board.get_val(x, y) & 3;
+            int old = m_cells[y][x];
+
+            if (stone == old) {
+                continue;
+            }
+
+            m_cells[y][x] = stone;
+
+            if (m_canonical) {
+                if (old != CELL_SPACE) {
+                    m_sym.toggle(old, x, y);
+                }
+                if (stone != CELL_SPACE) {
+                    m_sym.toggle(stone, x, y);
+                }
+            } else {
+                if (old != CELL_SPACE) {
+                    m_h ^= t.stone[y][x][color_idx(old, false)];
+                }
+                if (stone != CELL_SPACE) {
+                    m_h ^= t.stone[y][x][color_idx(stone, false)];
+                }
+            }
+        }
+    }
+
+    if (!m_canonical) {
+        if (sym) {
+            *sym = 0;
+        }
+        return m_h;
+    }
+
+    int idx = m_sym.canonical_index();
+
+    if (sym) {
+        *sym = idx;
+    }
+
+    return m_sym.get(idx / 2, idx % 2);
+}
+
+bool canonical_setup_hash(std::shared_ptr<Node> root, uint64_t& hash)
+{
+    int size = MAX_BOARD_SIZE;
+
+    for (auto& p : root->properties) {
+        if (p->pid() == PID::SZ) {
+            p->int_val(&size);
+            break;
+        }
+    }
+
+    if (size < 1 || size > MAX_BOARD_SIZE) {
+        size = MAX_BOARD_SIZE;
+    }
+
+    // AEや重複があるので、いったん盤に置いてから最後にハッシュする
+    int cells[CELLS_SIZE][CELLS_SIZE] = {};
+    int turn = 0;
+
+    // 配置は最初の着手の前のノードにもあるので、最初の子をたどる
+    for (std::shared_ptr<Node> node = root; node; ) {
+        for (auto& p : node->properties) {
+            PID pid = p->pid();
+
+            if (pid == PID::B || pid == PID::W) {
+                turn = (pid == PID::B) ? CELL_BLACK : CELL_WHITE;
+            }
+        }
+
+        if (turn) {
+            break;
+        }
+
+        for (auto& p : node->properties) {
+            int cell;
+
+            switch (p->pid()) {
+            case PID::AB:
+                cell = CELL_BLACK;
+                break;
+            case PID::AW:
+                cell = CELL_WHITE;
+                break;
+            case PID::AE:
+                cell = CELL_SPACE;
+                break;
+            default:
+                continue;
+            }
+
+            for (auto& pt : p->points()) {
+                if (pt.x >= 1 && pt.x <= size && pt.y >= 1 && pt.y <= size) {
+                    cells[pt.y][pt.x] = cell;
+                }
+            }
+        }
+
+        node = node->children.empty() ? nullptr : node->children.front();
+    }
+
+    SymHash h(size);
+    int n_stones = 0;
+
+    for (int y = 1; y <= size; y++) {
+        for (int x = 1; x <= size; x++) {
+            if (cells[y][x] != CELL_SPACE) {
+                h.toggle(cells[y][x], x, y);
+                n_stones++;
+            }
+        }
+    }
+
+    if (n_stones == 0) {
+        return false;
+    }
+
+    if (turn) {
+        h.toggle_turn(turn);
+    }
+
+    hash = h.canonical();
+
+    return true;
+}
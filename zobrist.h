@@ -0,0 +1,72 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include <cstdint>
+#include <memory>
+#include "board.h"
+
+class Node;
+
+// 対称変換の数。回転4 x 鏡映2
+#define N_SYMS (8)
+
+// Game::transformと同じ変換。s & 4 で鏡映、s & 3 で回転
+Point sym_transform(int s, int size, Point pt);
+
+// sym_transform(sym_inverse(s), size, sym_transform(s, size, pt)) == pt
+inline int sym_inverse(int s) { return (s & 4) ? s : (4 - s) & 3; }
+
+// 盤の8通りの対称変換と黒白の入れ替えを合わせた16通りのZobristハッシュ。
+// 石を置くたび・取るたびにtoggle()すれば、16通りとも差分で更新される。
+// 乱数表は種を固定して作るので、実行ごと・マシンごとに同じ値になる
+class SymHash
+{
+    int m_size;
+    uint64_t m_h[N_SYMS * 2];  // [s * 2 + 黒白を入れ替えたか]
+
+public:
+    SymHash(int size = 19);
+
+    void init(int size);
+
+    // stoneはCELL_BLACKかCELL_WHITE。同じ石を2回toggleすると元に戻る
+    void toggle(int stone, int x, int y);
+
+    // 最初に打つ石の色。入れ替えた方では逆の色になる
+    void toggle_turn(int stone);
+
+    uint64_t get(int s, bool color_flip) const { return m_h[s * 2 + color_flip]; };
+
+    // 16通りの最小値。回転・鏡映・黒白入れ替えで移り合う局面は同じ値になる
+    uint64_t canonical() const;
+    // canonical()になった変換。s * 2 + 黒白を入れ替えたか。同じ値なら小さい方
+    int canonical_index() const;
+};
+
+// 盤面の石だけのハッシュ。canonicalなら16通りの最小値、そうでなければ変換なし。
+// symにはその変換（canonical_index()）を入れる
+uint64_t board_hash(const Board& board, bool canonical, int* sym = nullptr);
+
+// replay_main_line()のように1手ずつ変わる盤を続けてハッシュする。board_hash()と同じ値になる。
+// 前の盤と違う交点（打った石、取られた石、途中のAB/AE）だけtoggleし、
+// canonicalでなければ変換なしの1通りだけを更新する。棋譜ごとに作る
+class BoardHasher
+{
+    bool m_canonical;
+    int m_size = 0;
+    int m_cells[CELLS_SIZE][CELLS_SIZE];
+    SymHash m_sym;     // canonicalのとき
+    uint64_t m_h = 0;  // canonicalでないとき
+
+    void reset(int size);
+public:
+    explicit BoardHasher(bool canonical) : m_canonical(canonical) {};
+
+    uint64_t hash(const Board& board, int* sym = nullptr);
+};
+
+// 問題の初期配置（最初の着手の前までのAB/AW/AE）と手番の正規化ハッシュ。
+// 置いた石がなければfalse。空の盤から打つ棋譜はどれも同じになるので、比べてはいけない
+bool canonical_setup_hash(std::shared_ptr<Node> root, uint64_t& hash);
+
+#endif